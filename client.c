@@ -1,196 +1,580 @@
-/**
- * Client implementation for Academia Portal
- * Course Registration System
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <termios.h>
-
-#define PORT 8080
-#define SERVER_IP "127.0.0.1"
-#define BUFFER_SIZE 1024
-
-// Function to get password input without echoing
-void get_password(char *password, int max_len) {
-    // Read password
-    fgets(password, max_len, stdin);
-    
-    // Remove trailing newline
-    password[strcspn(password, "\n")] = 0;
-}
-
-// Function to receive and display server response
-int receive_response(int socket_fd, char *response_buffer) {
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-    
-    int bytes_received = read(socket_fd, buffer, BUFFER_SIZE - 1);
-    if (bytes_received > 0) {
-        buffer[bytes_received] = '\0';
-        printf("%s", buffer);
-        
-        // Copy to response buffer if provided
-        if (response_buffer != NULL) {
-            strcpy(response_buffer, buffer);
-        }
-        
-        return bytes_received;
-    }
-    return 0;
-}
-
-// Function to clear the screen
-void clear_screen() {
-    #ifdef _WIN32
-        system("cls");
-    #else
-        system("clear");
-    #endif
-}
-
-// Function to send user input to server
-void send_input(int socket_fd, const char *input) {
-    write(socket_fd, input, strlen(input) + 1);
-}
-
-int main() {
-    int socket_fd;
-    struct sockaddr_in server_addr;
-    char buffer[BUFFER_SIZE];
-    char server_response[BUFFER_SIZE];
-    
-    // Create socket
-    if ((socket_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Prepare the sockaddr_in structure
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    
-    // Convert IP address from text to binary form
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
-        perror("Invalid address/Address not supported");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Connect to the server
-    if (connect(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    printf("Connected to Academia Portal Server\n\n");
-    
-    // Receive welcome message and role selection
-    receive_response(socket_fd, NULL);
-    
-    // Send role choice
-    fgets(buffer, BUFFER_SIZE, stdin);
-    buffer[strcspn(buffer, "\n")] = 0;
-    send_input(socket_fd, buffer);
-    
-    // Receive username prompt
-    receive_response(socket_fd, NULL);
-    
-    // Send username
-    fgets(buffer, BUFFER_SIZE, stdin);
-    buffer[strcspn(buffer, "\n")] = 0;
-    send_input(socket_fd, buffer);
-    
-    // Receive password prompt
-    receive_response(socket_fd, NULL);
-    
-    // Send password (hidden input)
-    char password[50];
-    // get_password(password, sizeof(password));
-    fgets(password, sizeof(password), stdin);
-    password[strcspn(password, "\n")] = 0;
-    send_input(socket_fd, password);
-    
-    // Receive login result
-    receive_response(socket_fd, server_response);
-    
-    // Check if login was successful
-    if (strstr(server_response, "Login failed") != NULL) {
-        close(socket_fd);
-        return 1;
-    }
-    
-    // If successful, continue with the menu loop
-    int count = 0;
-    while (1) {
-        // Receive menu
-        if(count != 0){
-            receive_response(socket_fd, server_response);
-        }
-        count++;
-        // Get user choice
-        fgets(buffer, BUFFER_SIZE, stdin);
-        buffer[strcspn(buffer, "\n")] = 0;
-        
-        // Send choice to server
-        send_input(socket_fd, buffer);
-        
-        // Check if user wants to exit
-        int choice = atoi(buffer);
-        if ((choice == 5) || (choice == 4 && strstr(server_response, "FACULTY") != NULL) || 
-            (choice == 5 && strstr(server_response, "STUDENT") != NULL)) {
-            // Exit chosen in any menu
-            receive_response(socket_fd, NULL);
-            break;
-        }
-        int outside =0;        
-        // For all other options, continue the interaction
-        while (1) {
-            // Receive server response
-            int bytes = receive_response(socket_fd, server_response);
-            if (bytes <= 0) break;
-            
-            // Check if we need more input by looking for prompt indicators
-            if (strstr(server_response, "Enter") != NULL ||
-                strrchr(server_response, ':') == (server_response + strlen(server_response) - 2) ||
-                strrchr(server_response, '?') == (server_response + strlen(server_response) - 2)) {
-                
-                // Server is asking for input
-                fgets(buffer, BUFFER_SIZE, stdin);
-                buffer[strcspn(buffer, "\n")] = 0;
-                
-                // Special handling for password input
-                // if (strstr(server_response, "password") || strstr(server_response, "Password")) {
-                //     get_password(buffer, BUFFER_SIZE);
-                // }
-                
-                send_input(socket_fd, buffer);
-            } else if (strstr(server_response, "successfully") != NULL ||
-                      strstr(server_response, "failed") != NULL ||
-                      strstr(server_response, "Invalid") != NULL ||
-                      strstr(server_response, "not found") != NULL) {
-                // Operation complete, break from sub-interaction loop
-                break;
-            } else if((choice == 5) || (choice == 4 && strstr(server_response, "FACULTY") != NULL) || (choice == 5 && strstr(server_response, "STUDENT") != NULL)) {
-                // Exit chosen in any menu
-                receive_response(socket_fd, NULL);
-                outside = 1;
-                break;
-            }
-        }
-        if(outside == 1){
-            break;
-        }
-    }
-    
-    // Close the connection
-    close(socket_fd);
-    printf("\nDisconnected from server.\n");
-    
-    return 0;
-}
\ No newline at end of file
+/**
+ * Client implementation for Academia Portal
+ * Course Registration System
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <termios.h>
+#include <poll.h>
+
+#include "protocol.h"
+
+#define PORT 8080
+#define SERVER_IP "127.0.0.1"
+#define BUFFER_SIZE 1024
+#define IMPORT_LINE_MAX 128     // Longer CSV lines are cut; they are invalid either way
+
+// Function to get password input without echoing
+void get_password(char *password, int max_len) {
+    // Read password
+    fgets(password, max_len, stdin);
+    
+    // Remove trailing newline
+    password[strcspn(password, "\n")] = 0;
+}
+
+// Function to receive and display server response
+int receive_response(int socket_fd, char *response_buffer) {
+    char buffer[BUFFER_SIZE];
+    memset(buffer, 0, BUFFER_SIZE);
+    
+    int bytes_received = read(socket_fd, buffer, BUFFER_SIZE - 1);
+    if (bytes_received > 0) {
+        buffer[bytes_received] = '\0';
+        printf("%s", buffer);
+        
+        // Copy to response buffer if provided
+        if (response_buffer != NULL) {
+            strcpy(response_buffer, buffer);
+        }
+        
+        return bytes_received;
+    }
+    return 0;
+}
+
+// Function to clear the screen
+void clear_screen() {
+    #ifdef _WIN32
+        system("cls");
+    #else
+        system("clear");
+    #endif
+}
+
+// Function to send user input to server
+void send_input(int socket_fd, const char *input) {
+    write(socket_fd, input, strlen(input) + 1);
+}
+
+// Build the request frame for one scripted command. Returns -1 if the
+// command is not recognised.
+int build_request(ProtoWriter *w, char *line) {
+    char *cmd = strtok(line, " \t");
+    char *rest = strtok(NULL, "");
+    char *arg1, *arg2, *arg3;
+    size_t frame;
+
+    if (cmd == NULL) {
+        return -1;
+    }
+    if (rest == NULL) {
+        rest = "";
+    }
+
+    if (strcmp(cmd, "login") == 0) {
+        arg1 = strtok(rest, " \t");
+        arg2 = strtok(NULL, " \t");
+        arg3 = strtok(NULL, " \t");
+        if (arg1 == NULL || arg2 == NULL || arg3 == NULL) return -1;
+        frame = proto_begin_frame(w, OP_LOGIN);
+        proto_put_u8(w, strcmp(arg1, "admin") == 0 ? PROTO_ROLE_ADMIN :
+                        strcmp(arg1, "faculty") == 0 ? PROTO_ROLE_FACULTY : PROTO_ROLE_STUDENT);
+        proto_put_str(w, arg2);
+        proto_put_str(w, arg3);
+    } else if (strcmp(cmd, "logout") == 0) {
+        frame = proto_begin_frame(w, OP_LOGOUT);
+    } else if (strcmp(cmd, "add-student") == 0 || strcmp(cmd, "add-faculty") == 0 || strcmp(cmd, "passwd") == 0) {
+        arg1 = strtok(rest, " \t");
+        arg2 = strtok(NULL, " \t");
+        if (arg1 == NULL || arg2 == NULL) return -1;
+        frame = proto_begin_frame(w, strcmp(cmd, "add-student") == 0 ? OP_ADD_STUDENT :
+                                     strcmp(cmd, "add-faculty") == 0 ? OP_ADD_FACULTY : OP_CHANGE_PASSWORD);
+        proto_put_str(w, arg1);
+        proto_put_str(w, arg2);
+    } else if (strcmp(cmd, "toggle") == 0) {
+        frame = proto_begin_frame(w, OP_TOGGLE_STUDENT);
+        proto_put_u32(w, atoi(rest));
+    } else if (strcmp(cmd, "update") == 0) {
+        arg1 = strtok(rest, " \t");
+        arg2 = strtok(NULL, " \t");
+        arg3 = strtok(NULL, " \t");
+        char *arg4 = strtok(NULL, " \t");
+        if (arg1 == NULL || arg2 == NULL || arg3 == NULL || arg4 == NULL) return -1;
+        frame = proto_begin_frame(w, OP_UPDATE_DETAILS);
+        proto_put_u8(w, strcmp(arg1, "faculty") == 0 ? PROTO_ROLE_FACULTY : PROTO_ROLE_STUDENT);
+        proto_put_u32(w, atoi(arg2));
+        proto_put_str(w, strcmp(arg3, ".") == 0 ? "" : arg3);
+        proto_put_str(w, strcmp(arg4, ".") == 0 ? "" : arg4);
+    } else if (strcmp(cmd, "courses") == 0) {
+        frame = proto_begin_frame(w, OP_LIST_COURSES);
+    } else if (strcmp(cmd, "enroll") == 0 || strcmp(cmd, "unenroll") == 0 || strcmp(cmd, "remove-course") == 0) {
+        frame = proto_begin_frame(w, strcmp(cmd, "enroll") == 0 ? OP_ENROLL :
+                                     strcmp(cmd, "unenroll") == 0 ? OP_UNENROLL : OP_REMOVE_COURSE);
+        proto_put_str(w, rest);
+    } else if (strcmp(cmd, "enrolled") == 0) {
+        frame = proto_begin_frame(w, OP_VIEW_ENROLLED);
+    } else if (strcmp(cmd, "wait") == 0 || strcmp(cmd, "unwait") == 0) {
+        frame = proto_begin_frame(w, strcmp(cmd, "wait") == 0 ? OP_JOIN_WAITLIST : OP_LEAVE_WAITLIST);
+        proto_put_str(w, rest);
+    } else if (strcmp(cmd, "waitlists") == 0) {
+        frame = proto_begin_frame(w, OP_VIEW_WAITLISTS);
+    } else if (strcmp(cmd, "add-course") == 0) {
+        arg1 = strtok(rest, " \t");
+        arg2 = strtok(NULL, "");
+        if (arg1 == NULL || arg2 == NULL) return -1;
+        frame = proto_begin_frame(w, OP_ADD_COURSE);
+        proto_put_str(w, arg2);
+        proto_put_u32(w, atoi(arg1));
+    } else if (strcmp(cmd, "enrollments") == 0) {
+        frame = proto_begin_frame(w, OP_VIEW_ENROLLMENTS);
+    } else if (strcmp(cmd, "trace") == 0) {
+        frame = proto_begin_frame(w, OP_DUMP_TRACE);
+        proto_put_u32(w, atoi(rest));
+    } else {
+        return -1;
+    }
+
+    proto_end_frame(w, frame, 0);
+    return 0;
+}
+
+// Build the next IMPORT_USERS frame from a CSV file, with up to
+// PROTO_IMPORT_MAX_ROWS lines numbered from *row. A line that would take the
+// frame past PROTO_MAX_REQUEST is left for the next one. Returns the number
+// of lines, 0 at the end of the file.
+int import_frame(ProtoWriter *w, FILE *f, int role, uint32_t *row) {
+    char line[IMPORT_LINE_MAX + 2];
+    size_t frame = proto_begin_frame(w, OP_IMPORT_USERS);
+    long start = ftell(f);
+    int rows = 0;
+    int c;
+
+    proto_put_u8(w, role);
+    proto_put_u8(w, PROTO_IMPORT_CSV);
+    proto_put_u32(w, *row);
+    while (rows < PROTO_IMPORT_MAX_ROWS && fgets(line, sizeof(line), f) != NULL) {
+        size_t len = strcspn(line, "\n");
+        if (line[len] != '\n') {
+            while ((c = fgetc(f)) != EOF && c != '\n');
+        }
+        line[len++] = '\n';
+        if (w->len - frame + len > PROTO_MAX_REQUEST) {
+            fseek(f, start, SEEK_SET);
+            break;
+        }
+        start = ftell(f);
+        proto_reserve(w, len);
+        memcpy(w->data + w->len, line, len);
+        w->len += len;
+        rows++;
+    }
+    proto_end_frame(w, frame, 0);
+    *row += rows;
+    return rows;
+}
+
+// Print one response frame as a status line followed by any listed items
+void print_response(uint16_t opcode, uint16_t status, const uint8_t *payload, uint32_t len) {
+    ProtoReader r = { payload, len, 0 };
+    char name[256];
+
+    printf("%s", proto_status_name(status));
+    if (status == PROTO_BUSY) {
+        printf(" retry_ms=%u\n", proto_get_u32(&r));
+        return;
+    }
+    if (status != PROTO_OK) {
+        printf("\n");
+        return;
+    }
+
+    switch (opcode) {
+        case OP_LOGIN:
+        case OP_ADD_STUDENT:
+        case OP_ADD_FACULTY:
+            printf(" id=%u\n", proto_get_u32(&r));
+            break;
+        case OP_TOGGLE_STUDENT:
+            printf(" active=%u\n", proto_get_u8(&r));
+            break;
+        case OP_IMPORT_USERS: {
+            uint32_t first_id = proto_get_u32(&r);
+            uint32_t added = proto_get_u32(&r);
+            uint32_t n = proto_get_u32(&r);
+            printf(" first_id=%u added=%u rejected=%u\n", first_id, added, n);
+            for (uint32_t i = 0; i < n && !r.error; i++) {
+                uint32_t row = proto_get_u32(&r);
+                printf("  row %u %s\n", row, proto_status_name(proto_get_u8(&r)));
+            }
+            break;
+        }
+        case OP_ENROLL:
+            printf(" seats_left=%u\n", proto_get_u32(&r));
+            break;
+        case OP_DUMP_TRACE:
+            proto_get_str(&r, name, sizeof(name));
+            printf(" file=%s\n", name);
+            break;
+        case OP_JOIN_WAITLIST:
+            printf(" position=%u\n", proto_get_u32(&r));
+            break;
+        case OP_VIEW_WAITLISTS: {
+            uint32_t n = proto_get_u32(&r);
+            printf(" count=%u\n", n);
+            for (uint32_t i = 0; i < n && !r.error; i++) {
+                proto_get_str(&r, name, sizeof(name));
+                uint32_t position = proto_get_u32(&r);
+                if (position > 0) {
+                    printf("  %s position=%u\n", name, position);
+                } else {
+                    printf("  %s enrolled\n", name);
+                }
+            }
+            break;
+        }
+        case OP_LIST_COURSES: {
+            uint32_t n = proto_get_u32(&r);
+            printf(" count=%u\n", n);
+            for (uint32_t i = 0; i < n && !r.error; i++) {
+                proto_get_str(&r, name, sizeof(name));
+                printf("  %s seats=%u\n", name, proto_get_u32(&r));
+            }
+            break;
+        }
+        case OP_VIEW_ENROLLED: {
+            uint32_t n = proto_get_u32(&r);
+            printf(" count=%u\n", n);
+            for (uint32_t i = 0; i < n && !r.error; i++) {
+                proto_get_str(&r, name, sizeof(name));
+                printf("  %s\n", name);
+            }
+            break;
+        }
+        case OP_VIEW_ENROLLMENTS: {
+            uint32_t n = proto_get_u32(&r);
+            printf(" count=%u\n", n);
+            for (uint32_t i = 0; i < n && !r.error; i++) {
+                proto_get_str(&r, name, sizeof(name));
+                uint32_t enrolled = proto_get_u32(&r);
+                uint32_t capacity = proto_get_u32(&r);
+                uint32_t students = proto_get_u32(&r);
+                printf("  %s enrolled=%u/%u\n", name, enrolled, capacity);
+                for (uint32_t j = 0; j < students && !r.error; j++) {
+                    uint32_t id = proto_get_u32(&r);
+                    proto_get_str(&r, name, sizeof(name));
+                    printf("    %u %s\n", id, name);
+                }
+            }
+            break;
+        }
+        case OP_BATCH: {
+            uint32_t n = proto_get_u32(&r);
+            printf(" count=%u\n", n);
+            for (uint32_t i = 0; i < n && r.left >= PROTO_HEADER_SIZE; i++) {
+                uint16_t sub_opcode, sub_status;
+                uint32_t sub_len;
+                proto_parse_header(r.p, &sub_opcode, &sub_status, &sub_len);
+                if (sub_len > r.left - PROTO_HEADER_SIZE) {
+                    break;
+                }
+                printf("- ");
+                print_response(sub_opcode, sub_status, r.p + PROTO_HEADER_SIZE, sub_len);
+                r.p += PROTO_HEADER_SIZE + sub_len;
+                r.left -= PROTO_HEADER_SIZE + sub_len;
+            }
+            break;
+        }
+        default:
+            printf("\n");
+    }
+}
+
+// Scripted binary mode: run one command per stdin line and print each result.
+// Up to window requests are sent before waiting for their responses; the
+// lines between "batch" and "end" are sent as a single BATCH request,
+// "import student|faculty FILE" streams a CSV file as IMPORT_USERS requests,
+// and "export csv|records FILE" writes the rows of an EXPORT_ENROLLMENTS to
+// FILE as they arrive.
+int run_binary(int socket_fd, int window) {
+    char line[BUFFER_SIZE];
+    ProtoWriter batch = {0};
+    int batch_count = -1;   // Sub-requests collected so far, -1 outside a batch
+    FILE *import = NULL;    // CSV file being imported
+    int import_role = 0;
+    uint32_t import_row = 1;
+    FILE *export = NULL;    // Where the running export's rows go
+    unsigned long export_rows = 0;
+    int outstanding = 0;
+    int input_done = 0;
+
+    if (proto_handshake(socket_fd) < 0) {
+        fprintf(stderr, "Binary handshake failed\n");
+        return -1;
+    }
+
+    while (1) {
+        // Send requests until the window is full or the script ends
+        while (!input_done && outstanding < window) {
+            ProtoWriter w = {0};
+
+            if (import != NULL) {
+                // An import sends its file one frame at a time
+                if (import_frame(&w, import, import_role, &import_row) == 0) {
+                    fclose(import);
+                    import = NULL;
+                    free(w.data);
+                    continue;
+                }
+            } else {
+                if (fgets(line, sizeof(line), stdin) == NULL) {
+                    input_done = 1;
+                    break;
+                }
+                line[strcspn(line, "\r\n")] = 0;
+                if (line[0] == '\0' || line[0] == '#') {
+                    continue;
+                }
+
+                if (strncmp(line, "import ", 7) == 0 && batch_count < 0) {
+                    char *role = strtok(line + 7, " \t");
+                    char *path = strtok(NULL, "");
+                    if (role == NULL || path == NULL || (strcmp(role, "student") != 0 && strcmp(role, "faculty") != 0)) {
+                        fprintf(stderr, "Usage: import student|faculty FILE\n");
+                    } else if ((import = fopen(path, "r")) == NULL) {
+                        perror(path);
+                    } else {
+                        import_role = strcmp(role, "student") == 0 ? PROTO_ROLE_STUDENT : PROTO_ROLE_FACULTY;
+                        import_row = 1;
+                    }
+                    continue;
+                }
+                if (strcmp(line, "batch") == 0) {
+                    batch.len = 0;
+                    batch_count = 0;
+                    continue;
+                }
+                if (strncmp(line, "export ", 7) == 0 && batch_count < 0) {
+                    char *format = strtok(line + 7, " \t");
+                    char *path = strtok(NULL, "");
+                    if (format == NULL || path == NULL || (strcmp(format, "csv") != 0 && strcmp(format, "records") != 0)) {
+                        fprintf(stderr, "Usage: export csv|records FILE\n");
+                        continue;
+                    }
+                    if (export != NULL) {
+                        fprintf(stderr, "An export is already running\n");
+                        continue;
+                    }
+                    if ((export = fopen(path, "w")) == NULL) {
+                        perror(path);
+                        continue;
+                    }
+                    export_rows = 0;
+                    size_t frame = proto_begin_frame(&w, OP_EXPORT_ENROLLMENTS);
+                    proto_put_u8(&w, strcmp(format, "csv") == 0 ? PROTO_EXPORT_CSV : PROTO_EXPORT_RECORDS);
+                    proto_end_frame(&w, frame, 0);
+                } else if (strcmp(line, "end") == 0 && batch_count >= 0) {
+                    size_t frame = proto_begin_frame(&w, OP_BATCH);
+                    proto_put_u32(&w, batch_count);
+                    proto_reserve(&w, batch.len);
+                    memcpy(w.data + w.len, batch.data, batch.len);
+                    w.len += batch.len;
+                    proto_end_frame(&w, frame, 0);
+                    batch_count = -1;
+                } else if (build_request(batch_count >= 0 ? &batch : &w, line) < 0) {
+                    fprintf(stderr, "Unknown or incomplete command: %s\n", line);
+                    continue;
+                } else if (batch_count >= 0) {
+                    batch_count++;
+                    continue;
+                }
+            }
+
+            if (proto_send_all(socket_fd, w.data, w.len) < 0) {
+                free(w.data);
+                free(batch.data);
+                if (import != NULL) {
+                    fclose(import);
+                }
+                if (export != NULL) {
+                    fclose(export);
+                }
+                return -1;
+            }
+            free(w.data);
+            outstanding++;
+        }
+        if (outstanding == 0) {
+            break;
+        }
+
+        // Responses arrive in request order
+        uint16_t opcode, status;
+        uint8_t *payload;
+        uint32_t len;
+        if (proto_read_frame(socket_fd, &opcode, &status, &payload, &len) < 0) {
+            free(batch.data);
+            if (export != NULL) {
+                fclose(export);
+            }
+            return -1;
+        }
+        if (opcode == OP_EXPORT_ENROLLMENTS && status == PROTO_OK) {
+            // Rows arrive over several frames; only the last one answers the request
+            ProtoReader r = { payload, len, 0 };
+            uint8_t more = proto_get_u8(&r);
+            export_rows += proto_get_u32(&r);
+            if (!r.error && export != NULL) {
+                fwrite(r.p, 1, r.left, export);
+            }
+            free(payload);
+            if (more && !r.error) {
+                continue;
+            }
+            printf("OK rows=%lu\n", export_rows);
+        } else {
+            print_response(opcode, status, payload, len);
+            free(payload);
+        }
+        if (opcode == OP_EXPORT_ENROLLMENTS && export != NULL) {
+            fclose(export);
+            export = NULL;
+        }
+        fflush(stdout);
+        outstanding--;
+        if (opcode == OP_LOGOUT) {
+            break;
+        }
+    }
+
+    if (import != NULL) {
+        fclose(import);
+    }
+    if (export != NULL) {
+        fclose(export);
+    }
+    free(batch.data);
+    return 0;
+}
+
+#ifndef ACADEMIA_NO_MAIN
+int main(int argc, char *argv[]) {
+    int socket_fd;
+    struct sockaddr_in server_addr;
+    char buffer[BUFFER_SIZE];
+    size_t pending = 0;
+    int binary = 0;
+    int window = 1;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--binary") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+            if (window < 1) window = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [--binary [--pipeline N]]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    // Create socket
+    if ((socket_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Prepare the sockaddr_in structure
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
+    
+    // Convert IP address from text to binary form
+    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
+        perror("Invalid address/Address not supported");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Connect to the server
+    if (connect(socket_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        perror("Connection failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (binary) {
+        int rc = run_binary(socket_fd, window);
+        close(socket_fd);
+        return rc < 0 ? EXIT_FAILURE : 0;
+    }
+    
+    printf("Connected to Academia Portal Server\n\n");
+    
+    // Relay server output to the terminal and each input line to the server.
+    // The server frames messages itself, so there is no need to guess from
+    // the prompt text when it expects input.
+    struct pollfd fds[2];
+    fds[0].fd = socket_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = STDIN_FILENO;
+    fds[1].events = POLLIN;
+    
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            perror("Poll failed");
+            break;
+        }
+        
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // Receive server response; zero bytes means the server closed the session
+            if (receive_response(socket_fd, NULL) <= 0) {
+                break;
+            }
+            fflush(stdout);
+        }
+        
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            // Send each complete input line to the server
+            ssize_t n = read(STDIN_FILENO, buffer + pending, BUFFER_SIZE - 1 - pending);
+            if (n <= 0) {
+                // End of input: send a trailing partial line, then wait for the server to finish
+                if (pending > 0) {
+                    buffer[pending] = 0;
+                    send_input(socket_fd, buffer);
+                }
+                shutdown(socket_fd, SHUT_WR);
+                fds[1].fd = -1;
+                continue;
+            }
+            pending += n;
+            
+            char *line = buffer;
+            char *newline;
+            while ((newline = memchr(line, '\n', pending - (line - buffer))) != NULL) {
+                *newline = 0;
+                send_input(socket_fd, line);
+                line = newline + 1;
+            }
+            pending -= line - buffer;
+            memmove(buffer, line, pending);
+            if (pending == BUFFER_SIZE - 1) {
+                // Overlong line: send what we have
+                buffer[pending] = 0;
+                send_input(socket_fd, buffer);
+                pending = 0;
+            }
+        }
+    }
+    
+    // Close the connection
+    close(socket_fd);
+    printf("\nDisconnected from server.\n");
+    
+    return 0;
+}
+#endif
@@ -0,0 +1,820 @@
+/**
+ * Load generator for Academia Portal
+ * Opens many concurrent binary protocol sessions against a running server,
+ * runs one scenario on all of them and reports throughput and latency
+ * percentiles per request type
+ *
+ * Build: gcc -O2 loadgen.c -o loadgen -lpthread
+ * Run:   ./loadgen [--scenario login|rush|mixed] [--connections N] [--threads N]
+ *                  [--duration SECONDS] [--pipeline N] [--reads PERCENT]
+ *                  [--students N] [--courses N] [--seats N] [--hot-seats N] [--seed]
+ *
+ * login  Every session connects, logs in as a random student, logs out and
+ *        starts over: a login storm.
+ * rush   Every session logs in once and keeps enrolling in the hot course,
+ *        dropping it again whenever it gets a seat: a registration rush.
+ * mixed  Every session logs in once and mixes reads (enrolled courses, the
+ *        course list) with enrolling in and dropping random courses.
+ *
+ * --seed first adds the students, faculty and courses the scenarios use,
+ * through the admin account (IMPORT_USERS) and each faculty account
+ * (ADD_COURSE). Existing ones are left alone, so seeding twice is harmless.
+ * All sessions connect at once, so the connect and login rows show the
+ * server taking a connection storm. Latency runs from sending a request to
+ * reading its response; for connect, from connect() to the end of the
+ * protocol handshake.
+ */
+
+#define ACADEMIA_NO_MAIN
+#include "client.c"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define LOADGEN_PASSWORD "secret"
+#define LOADGEN_ADMIN "admin"
+#define LOADGEN_ADMIN_PASSWORD "admin123"
+#define LOADGEN_HOT_COURSE "Hot Course"
+#define LOADGEN_COURSES_PER_FACULTY 50  // MAX_COURSES in the server
+#define LOADGEN_MAX_PIPELINE 64
+#define LOADGEN_TRACKED 8               // Enrollments a mixed session remembers, to drop them later
+#define LOADGEN_GRACE_MS 5000           // How long to wait for the last responses
+#define LOADGEN_EVENTS 256
+
+// Latency histograms: exact below HIST_SUB ns, then HIST_SUB buckets per
+// power of two, so a reported percentile is at most 1/16 above the real one
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef enum { SCENARIO_LOGIN, SCENARIO_RUSH, SCENARIO_MIXED } Scenario;
+
+// Request types timed separately
+enum { KIND_CONNECT, KIND_LOGIN, KIND_LOGOUT, KIND_ENROLL, KIND_UNENROLL, KIND_ENROLLED, KIND_COURSES, KIND_COUNT };
+static const char *kind_names[KIND_COUNT] = { "connect", "login", "logout", "enroll", "unenroll", "enrolled", "courses" };
+
+typedef struct {
+    long counts[HIST_BUCKETS];
+    long total;
+    long ok;
+    long max;
+} Histogram;
+
+typedef enum { CONN_IDLE, CONN_CONNECTING, CONN_HANDSHAKE, CONN_OPEN, CONN_CLOSING } ConnState;
+
+// A request sent and not answered yet
+typedef struct {
+    int kind;
+    int course;         // Course number of a mixed enroll or unenroll
+    long sent;
+} Pending;
+
+// One session. Responses come back in request order, so the pending
+// requests are a ring.
+typedef struct {
+    int fd;
+    ConnState state;
+    uint32_t events;
+    long started;
+    int student;
+    int logged_in;
+    int has_seat;
+    int enrolled[LOADGEN_TRACKED];
+    int enrolled_count;
+    unsigned seed;
+    uint8_t *in;
+    size_t in_len;
+    size_t in_cap;
+    ProtoWriter out;
+    size_t out_sent;
+    Pending pending[LOADGEN_MAX_PIPELINE];
+    int head;
+    int outstanding;
+} Conn;
+
+typedef struct {
+    int epfd;
+    Conn *conns;
+    int count;
+    int open;           // Sessions not finished yet
+    long dropped;       // Sessions closed by the server while in use
+    long finished;
+    long failures[PROTO_BUSY + 1];  // Responses by status
+    Histogram hist[KIND_COUNT];
+    pthread_t thread;
+} Worker;
+
+static struct {
+    Scenario scenario;
+    int connections;
+    int threads;
+    int duration;
+    int pipeline;
+    int reads;
+    int students;
+    int courses;
+    int seats;
+    int hot_seats;
+    int seed;
+} opts = { SCENARIO_MIXED, 1000, 4, 10, 1, 80, 10000, 200, 100, 10, 0 };
+
+static struct sockaddr_in server_addr;
+static long deadline;
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int hist_bucket(long ns) {
+    if (ns < HIST_SUB) {
+        return ns < 0 ? 0 : (int)ns;
+    }
+    int msb = 63 - __builtin_clzl(ns);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + (int)((ns >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// Largest latency that falls in a bucket
+static long hist_upper(int bucket) {
+    if (bucket < HIST_SUB) {
+        return bucket;
+    }
+    int shift = bucket / HIST_SUB - 1;
+    return ((long)(HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+static void hist_add(Histogram *h, long ns, int ok) {
+    h->counts[hist_bucket(ns)]++;
+    h->total++;
+    h->ok += ok;
+    if (ns > h->max) {
+        h->max = ns;
+    }
+}
+
+static void hist_merge(Histogram *dst, const Histogram *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->ok += src->ok;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+// Latency below which a fraction p of the samples fall
+static long hist_percentile(const Histogram *h, double p) {
+    long rank = (long)(p * h->total + 0.999999);
+    long seen = 0;
+
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            long upper = hist_upper(i);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Raise the descriptor limit so thousands of sessions fit in one process
+static void raise_fd_limit() {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// Watch for writability only while connecting or holding unsent requests
+static void conn_update(Worker *w, Conn *c) {
+    uint32_t want = EPOLLIN;
+    if (c->state == CONN_CONNECTING || c->out_sent < c->out.len) {
+        want |= EPOLLOUT;
+    }
+    if (want != c->events) {
+        struct epoll_event ev = { .events = want, .data.ptr = c };
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = want;
+    }
+}
+
+// Open a new session for c, as a random student
+static void conn_start(Worker *w, Conn *c) {
+    struct epoll_event ev;
+
+    c->state = CONN_CONNECTING;
+    c->started = now_ns();
+    c->student = rand_r(&c->seed) % opts.students;
+    c->logged_in = 0;
+    c->has_seat = 0;
+    c->enrolled_count = 0;
+    c->in_len = 0;
+    c->out.len = 0;
+    c->out_sent = 0;
+    c->head = 0;
+    c->outstanding = 0;
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0 ||
+        (connect(c->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS)) {
+        if (c->fd >= 0) {
+            close(c->fd);
+        }
+        hist_add(&w->hist[KIND_CONNECT], now_ns() - c->started, 0);
+        c->state = CONN_IDLE;
+        w->open--;
+        return;
+    }
+    c->events = EPOLLIN | EPOLLOUT;
+    ev.events = c->events;
+    ev.data.ptr = c;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+// End a session and start the next one until the run is over. A session
+// that failed to connect is not retried, so a missing server ends the run.
+static void conn_close(Worker *w, Conn *c, int retry) {
+    close(c->fd);
+    c->fd = -1;
+    if (retry && now_ns() < deadline) {
+        conn_start(w, c);
+    } else {
+        c->state = CONN_IDLE;
+        w->open--;
+    }
+}
+
+// Queue the next request of the scenario. Returns 0 if there is none. At
+// the deadline a session first drops the courses it got, so the next run
+// finds the seats free, and logs out once every response is in.
+static int conn_next(Conn *c) {
+    char line[128];
+    Pending *p = &c->pending[(c->head + c->outstanding) % LOADGEN_MAX_PIPELINE];
+    int ending = now_ns() >= deadline;
+
+    p->course = -1;
+    if (ending && c->has_seat) {
+        sprintf(line, "unenroll %s", LOADGEN_HOT_COURSE);
+        p->kind = KIND_UNENROLL;
+        c->has_seat = 0;
+    } else if (ending && c->enrolled_count > 0) {
+        p->course = c->enrolled[--c->enrolled_count];
+        sprintf(line, "unenroll Course %d", p->course);
+        p->kind = KIND_UNENROLL;
+    } else if (ending || (opts.scenario == SCENARIO_LOGIN && c->logged_in)) {
+        if (c->outstanding > 0) {
+            return 0;
+        }
+        strcpy(line, "logout");
+        p->kind = KIND_LOGOUT;
+        c->state = CONN_CLOSING;
+    } else if (!c->logged_in) {
+        sprintf(line, "login student student%d %s", c->student, LOADGEN_PASSWORD);
+        p->kind = KIND_LOGIN;
+        c->logged_in = 1;
+    } else if (opts.scenario == SCENARIO_RUSH) {
+        sprintf(line, "%s %s", c->has_seat ? "unenroll" : "enroll", LOADGEN_HOT_COURSE);
+        p->kind = c->has_seat ? KIND_UNENROLL : KIND_ENROLL;
+        c->has_seat = 0;
+    } else if ((int)(rand_r(&c->seed) % 100) < opts.reads) {
+        int list = rand_r(&c->seed) % 4 == 0;
+        strcpy(line, list ? "courses" : "enrolled");
+        p->kind = list ? KIND_COURSES : KIND_ENROLLED;
+    } else if (c->enrolled_count == LOADGEN_TRACKED || (c->enrolled_count > 0 && rand_r(&c->seed) % 2)) {
+        int i = rand_r(&c->seed) % c->enrolled_count;
+        p->course = c->enrolled[i];
+        c->enrolled[i] = c->enrolled[--c->enrolled_count];
+        sprintf(line, "unenroll Course %d", p->course);
+        p->kind = KIND_UNENROLL;
+    } else {
+        p->course = rand_r(&c->seed) % opts.courses;
+        sprintf(line, "enroll Course %d", p->course);
+        p->kind = KIND_ENROLL;
+    }
+
+    build_request(&c->out, line);
+    p->sent = now_ns();
+    c->outstanding++;
+    return 1;
+}
+
+// Keep the pipeline full
+static void conn_issue(Conn *c) {
+    while (c->state == CONN_OPEN && c->outstanding < opts.pipeline && conn_next(c));
+}
+
+// Send what the socket takes. Returns -1 if the connection failed.
+static int conn_flush(Conn *c) {
+    while (c->out_sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_sent, c->out.len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->out_sent += n;
+    }
+    c->out.len = 0;
+    c->out_sent = 0;
+    return 0;
+}
+
+// Read everything available. Returns 0 at end of file, -1 on error.
+static int conn_read(Conn *c) {
+    while (1) {
+        if (c->in_len == c->in_cap) {
+            c->in_cap = c->in_cap ? c->in_cap * 2 : 4096;
+            c->in = realloc(c->in, c->in_cap);
+            if (c->in == NULL) {
+                abort();
+            }
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+        }
+        c->in_len += n;
+    }
+}
+
+// Time one response and note what it changed for the scenario
+static void conn_response(Worker *w, Conn *c, uint16_t status) {
+    Pending *p = &c->pending[c->head];
+
+    c->head = (c->head + 1) % LOADGEN_MAX_PIPELINE;
+    c->outstanding--;
+    hist_add(&w->hist[p->kind], now_ns() - p->sent, status == PROTO_OK);
+    if (status != PROTO_OK) {
+        w->failures[status <= PROTO_BUSY ? status : PROTO_ERROR]++;
+    }
+    // A refused login is tried again before the next request, and a course
+    // the server was too busy to drop is dropped later
+    if (p->kind == KIND_LOGIN && status != PROTO_OK) {
+        c->logged_in = 0;
+    }
+    if ((p->kind == KIND_ENROLL && status == PROTO_OK) || (p->kind == KIND_UNENROLL && status == PROTO_BUSY)) {
+        if (opts.scenario == SCENARIO_RUSH) {
+            c->has_seat = 1;
+        } else if (c->enrolled_count < LOADGEN_TRACKED) {
+            c->enrolled[c->enrolled_count++] = p->course;
+        }
+    }
+}
+
+// Handle the buffered input: the end of the banner, then response frames.
+// Returns -1 on a protocol error.
+static int conn_parse(Worker *w, Conn *c) {
+    size_t pos = 0;
+
+    if (c->state == CONN_HANDSHAKE) {
+        for (pos = 0; pos + PROTO_MAGIC_LEN <= c->in_len; pos++) {
+            if (memcmp(c->in + pos, PROTO_MAGIC, PROTO_MAGIC_LEN) == 0) {
+                break;
+            }
+        }
+        if (pos + PROTO_MAGIC_LEN > c->in_len) {
+            return 0;
+        }
+        hist_add(&w->hist[KIND_CONNECT], now_ns() - c->started, 1);
+        pos += PROTO_MAGIC_LEN;
+        c->state = CONN_OPEN;
+    }
+
+    while (c->in_len - pos >= PROTO_HEADER_SIZE) {
+        uint16_t opcode, status;
+        uint32_t len;
+        proto_parse_header(c->in + pos, &opcode, &status, &len);
+        if (len > PROTO_MAX_PAYLOAD || c->outstanding == 0) {
+            return -1;
+        }
+        if (c->in_len - pos - PROTO_HEADER_SIZE < len) {
+            break;
+        }
+        conn_response(w, c, status);
+        pos += PROTO_HEADER_SIZE + len;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    conn_issue(c);
+    return 0;
+}
+
+static void conn_event(Worker *w, Conn *c, uint32_t events) {
+    if (c->state == CONN_CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            hist_add(&w->hist[KIND_CONNECT], now_ns() - c->started, 0);
+            conn_close(w, c, 0);
+            return;
+        }
+        c->state = CONN_HANDSHAKE;
+        proto_reserve(&c->out, PROTO_MAGIC_LEN);
+        memcpy(c->out.data, PROTO_MAGIC, PROTO_MAGIC_LEN);
+        c->out.len = PROTO_MAGIC_LEN;
+    }
+
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        int result = conn_read(c);
+        if (result < 0 || conn_parse(w, c) < 0 || result == 0) {
+            // Closing after LOGOUT is the normal end of a session; closing
+            // before the handshake means the server turned the session away
+            if (c->state == CONN_HANDSHAKE) {
+                hist_add(&w->hist[KIND_CONNECT], now_ns() - c->started, 0);
+            } else if (c->state != CONN_CLOSING || c->outstanding > 0) {
+                w->dropped++;
+            } else {
+                w->finished++;
+            }
+            conn_close(w, c, 1);
+            return;
+        }
+    }
+    if (conn_flush(c) < 0) {
+        w->dropped++;
+        conn_close(w, c, 1);
+        return;
+    }
+    conn_update(w, c);
+}
+
+static void *worker_run(void *arg) {
+    Worker *w = arg;
+    struct epoll_event events[LOADGEN_EVENTS];
+    int draining = 0;
+
+    w->epfd = epoll_create1(0);
+    w->open = w->count;
+    for (int i = 0; i < w->count; i++) {
+        conn_start(w, &w->conns[i]);
+    }
+
+    while (w->open > 0) {
+        long now = now_ns();
+        if (now >= deadline + LOADGEN_GRACE_MS * 1000000L) {
+            break;
+        }
+        // At the deadline idle sessions log out; busy ones do after their
+        // next response
+        if (!draining && now >= deadline) {
+            draining = 1;
+            for (int i = 0; i < w->count; i++) {
+                Conn *c = &w->conns[i];
+                if (c->state == CONN_OPEN && c->outstanding == 0) {
+                    conn_issue(c);
+                    if (conn_flush(c) < 0) {
+                        w->dropped++;
+                        conn_close(w, c, 0);
+                    } else {
+                        conn_update(w, c);
+                    }
+                }
+            }
+        }
+        int timeout = now < deadline ? (int)((deadline - now) / 1000000) + 1 : 100;
+        int n = epoll_wait(w->epfd, events, LOADGEN_EVENTS, timeout);
+        for (int i = 0; i < n; i++) {
+            conn_event(w, events[i].data.ptr, events[i].events);
+        }
+    }
+
+    for (int i = 0; i < w->count; i++) {
+        if (w->conns[i].state != CONN_IDLE) {
+            close(w->conns[i].fd);
+        }
+        free(w->conns[i].in);
+        free(w->conns[i].out.data);
+    }
+    close(w->epfd);
+    return NULL;
+}
+
+// Connect and log in with a blocking socket for seeding. Returns the
+// socket, or -1.
+static int seed_login(const char *role, const char *username, const char *password) {
+    ProtoWriter w = {0};
+    char line[BUFFER_SIZE];
+    uint16_t opcode, status = PROTO_ERROR;
+    uint8_t *payload;
+    uint32_t len;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 ||
+        proto_handshake(fd) < 0) {
+        perror("Seeding connection failed");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    snprintf(line, sizeof(line), "login %s %s %s", role, username, password);
+    build_request(&w, line);
+    if (proto_send_all(fd, w.data, w.len) == 0 && proto_read_frame(fd, &opcode, &status, &payload, &len) == 0) {
+        free(payload);
+    }
+    free(w.data);
+    if (status != PROTO_OK) {
+        fprintf(stderr, "Seeding: %s login as %s failed: %s\n", role, username, proto_status_name(status));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void seed_logout(int fd) {
+    ProtoWriter w = {0};
+    char line[] = "logout";
+    uint16_t opcode, status;
+    uint8_t *payload;
+    uint32_t len;
+
+    build_request(&w, line);
+    if (proto_send_all(fd, w.data, w.len) == 0 && proto_read_frame(fd, &opcode, &status, &payload, &len) == 0) {
+        free(payload);
+    }
+    free(w.data);
+    close(fd);
+}
+
+// Add count users named prefix0, prefix1, ... through IMPORT_USERS.
+// Returns the number added, or -1.
+static int seed_users(int fd, int role, const char *prefix, int count) {
+    ProtoWriter w = {0};
+    uint32_t row = 1;
+    int added = 0;
+
+    FILE *csv = tmpfile();
+    if (csv == NULL) {
+        perror("tmpfile");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(csv, "%s%d,%s\n", prefix, i, LOADGEN_PASSWORD);
+    }
+    rewind(csv);
+
+    while (1) {
+        uint16_t opcode, status;
+        uint8_t *payload;
+        uint32_t len;
+
+        w.len = 0;
+        if (import_frame(&w, csv, role, &row) == 0) {
+            break;
+        }
+        if (proto_send_all(fd, w.data, w.len) < 0 || proto_read_frame(fd, &opcode, &status, &payload, &len) < 0) {
+            added = -1;
+            break;
+        }
+        if (status != PROTO_OK) {
+            fprintf(stderr, "Seeding: import failed: %s\n", proto_status_name(status));
+            free(payload);
+            added = -1;
+            break;
+        }
+        ProtoReader r = { payload, len, 0 };
+        proto_get_u32(&r);
+        added += proto_get_u32(&r);
+        free(payload);
+    }
+    fclose(csv);
+    free(w.data);
+    return added;
+}
+
+// Add the courses of one faculty member in one pipelined burst. Returns the
+// number added, or -1.
+static int seed_courses(int fd, int first, int count, int seats) {
+    ProtoWriter w = {0};
+    char line[BUFFER_SIZE];
+    int added = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (first < 0) {
+            snprintf(line, sizeof(line), "add-course %d %s", seats, LOADGEN_HOT_COURSE);
+        } else {
+            snprintf(line, sizeof(line), "add-course %d Course %d", seats, first + i);
+        }
+        build_request(&w, line);
+    }
+    if (proto_send_all(fd, w.data, w.len) < 0) {
+        free(w.data);
+        return -1;
+    }
+    free(w.data);
+
+    for (int i = 0; i < count; i++) {
+        uint16_t opcode, status;
+        uint8_t *payload;
+        uint32_t len;
+
+        if (proto_read_frame(fd, &opcode, &status, &payload, &len) < 0) {
+            return -1;
+        }
+        free(payload);
+        if (status == PROTO_OK) {
+            added++;
+        } else if (status != PROTO_EXISTS) {
+            fprintf(stderr, "Seeding: add course failed: %s\n", proto_status_name(status));
+        }
+    }
+    return added;
+}
+
+// Create the accounts and courses the scenarios expect: students
+// student0..., courses "Course 0"... offered by faculty0... with
+// LOADGEN_COURSES_PER_FACULTY each, and the hot course on a faculty member
+// of its own
+static int seed_data() {
+    char username[32];
+    int faculty = (opts.courses + LOADGEN_COURSES_PER_FACULTY - 1) / LOADGEN_COURSES_PER_FACULTY + 1;
+    int courses = 0;
+    long start = now_ns();
+
+    int fd = seed_login("admin", LOADGEN_ADMIN, LOADGEN_ADMIN_PASSWORD);
+    if (fd < 0) {
+        return -1;
+    }
+    int students = seed_users(fd, PROTO_ROLE_STUDENT, "student", opts.students);
+    int faculty_added = seed_users(fd, PROTO_ROLE_FACULTY, "faculty", faculty);
+    seed_logout(fd);
+    if (students < 0 || faculty_added < 0) {
+        return -1;
+    }
+
+    for (int f = 0; f < faculty; f++) {
+        int first = f * LOADGEN_COURSES_PER_FACULTY;
+        int count = opts.courses - first < LOADGEN_COURSES_PER_FACULTY ? opts.courses - first : LOADGEN_COURSES_PER_FACULTY;
+        sprintf(username, "faculty%d", f);
+        fd = seed_login("faculty", username, LOADGEN_PASSWORD);
+        if (fd < 0) {
+            return -1;
+        }
+        int added = f == faculty - 1 ? seed_courses(fd, -1, 1, opts.hot_seats) : seed_courses(fd, first, count, opts.seats);
+        seed_logout(fd);
+        if (added < 0) {
+            return -1;
+        }
+        courses += added;
+    }
+    printf("Seeded %d students, %d faculty and %d courses in %ld ms\n",
+           students, faculty_added, courses, (now_ns() - start) / 1000000);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--scenario login|rush|mixed] [--connections N] [--threads N]\n"
+            "       [--duration SECONDS] [--pipeline N] [--reads PERCENT]\n"
+            "       [--students N] [--courses N] [--seats N] [--hot-seats N] [--seed]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *scenario_names[] = { "login", "rush", "mixed" };
+    static const struct option options[] = {
+        { "scenario", required_argument, NULL, 'S' },
+        { "connections", required_argument, NULL, 'c' },
+        { "threads", required_argument, NULL, 't' },
+        { "duration", required_argument, NULL, 'd' },
+        { "pipeline", required_argument, NULL, 'p' },
+        { "reads", required_argument, NULL, 'r' },
+        { "students", required_argument, NULL, 'n' },
+        { "courses", required_argument, NULL, 'C' },
+        { "seats", required_argument, NULL, 's' },
+        { "hot-seats", required_argument, NULL, 'H' },
+        { "seed", no_argument, NULL, 'D' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 'S':
+                if (strcmp(optarg, "login") == 0) {
+                    opts.scenario = SCENARIO_LOGIN;
+                } else if (strcmp(optarg, "rush") == 0) {
+                    opts.scenario = SCENARIO_RUSH;
+                } else if (strcmp(optarg, "mixed") == 0) {
+                    opts.scenario = SCENARIO_MIXED;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'c': opts.connections = atoi(optarg); break;
+            case 't': opts.threads = atoi(optarg); break;
+            case 'd': opts.duration = atoi(optarg); break;
+            case 'p': opts.pipeline = atoi(optarg); break;
+            case 'r': opts.reads = atoi(optarg); break;
+            case 'n': opts.students = atoi(optarg); break;
+            case 'C': opts.courses = atoi(optarg); break;
+            case 's': opts.seats = atoi(optarg); break;
+            case 'H': opts.hot_seats = atoi(optarg); break;
+            case 'D': opts.seed = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind < argc || opts.connections <= 0 || opts.threads <= 0 || opts.duration < 0 ||
+        opts.pipeline < 1 || opts.pipeline > LOADGEN_MAX_PIPELINE || opts.reads < 0 || opts.reads > 100 ||
+        opts.students <= 0 || opts.courses <= 0 || opts.seats <= 0 || opts.hot_seats <= 0) {
+        usage(argv[0]);
+    }
+    if (opts.threads > opts.connections) {
+        opts.threads = opts.connections;
+    }
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
+    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+    raise_fd_limit();
+
+    if (opts.seed && seed_data() < 0) {
+        return EXIT_FAILURE;
+    }
+    if (opts.duration == 0) {
+        return 0;
+    }
+
+    Worker *workers = calloc(opts.threads, sizeof(Worker));
+    Conn *conns = calloc(opts.connections, sizeof(Conn));
+    for (int t = 0, first = 0; t < opts.threads; t++) {
+        workers[t].count = opts.connections / opts.threads + (t < opts.connections % opts.threads);
+        workers[t].conns = conns + first;
+        first += workers[t].count;
+    }
+    for (int i = 0; i < opts.connections; i++) {
+        conns[i].seed = i + 1;
+    }
+
+    printf("%s: %d connections on %d threads for %d s, pipeline %d\n", scenario_names[opts.scenario],
+           opts.connections, opts.threads, opts.duration, opts.pipeline);
+    fflush(stdout);
+
+    long start = now_ns();
+    deadline = start + opts.duration * 1000000000L;
+    for (int t = 0; t < opts.threads; t++) {
+        pthread_create(&workers[t].thread, NULL, worker_run, &workers[t]);
+    }
+
+    Histogram *total = calloc(KIND_COUNT, sizeof(Histogram));
+    long dropped = 0, finished = 0;
+    long failures[PROTO_BUSY + 1] = {0};
+    for (int t = 0; t < opts.threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        for (int k = 0; k < KIND_COUNT; k++) {
+            hist_merge(&total[k], &workers[t].hist[k]);
+        }
+        dropped += workers[t].dropped;
+        finished += workers[t].finished;
+        for (int s = 0; s <= PROTO_BUSY; s++) {
+            failures[s] += workers[t].failures[s];
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    long requests = 0;
+    printf("%-9s %10s %10s %10s %9s %9s %9s %9s\n", "op", "count", "ok", "ops/s", "p50 us", "p99 us", "p999 us", "max us");
+    for (int k = 0; k < KIND_COUNT; k++) {
+        Histogram *h = &total[k];
+        if (h->total == 0) {
+            continue;
+        }
+        if (k != KIND_CONNECT) {
+            requests += h->total;
+        }
+        printf("%-9s %10ld %10ld %10.0f %9.1f %9.1f %9.1f %9.1f\n", kind_names[k], h->total, h->ok, h->total / seconds,
+               hist_percentile(h, 0.50) / 1e3, hist_percentile(h, 0.99) / 1e3,
+               hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+    }
+    printf("%ld requests in %.2f s: %.0f requests/s; %ld sessions completed, %ld dropped\n",
+           requests, seconds, requests / seconds, finished, dropped);
+    const char *separator = "Not OK:";
+    for (int s = 1; s <= PROTO_BUSY; s++) {
+        if (failures[s] > 0) {
+            printf("%s %s %ld", separator, proto_status_name(s), failures[s]);
+            separator = ",";
+        }
+    }
+    if (separator[0] == ',') {
+        printf("\n");
+    }
+
+    free(total);
+    free(conns);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * Data file migration for Academia Portal
+ * Converts version 1 data files (no header, course names stored inline in
+ * every student and faculty record) to the format described in records.h
+ *
+ * Build: gcc migrate.c -o migrate -lpthread
+ * Run:   ./migrate [directory]
+ *
+ * Stop the server first. The new files are written next to the old ones and
+ * renamed into place at the end; the old files are kept as *.v1.
+ */
+
+#define ACADEMIA_NO_MAIN
+#include "server.c"
+
+// Version 1 records
+typedef struct {
+    int id;
+    char username[50];
+    char password[50];
+    int active;
+    char courses[MAX_COURSES][50];
+    int course_count;
+} StudentV1;
+
+typedef struct {
+    int id;
+    char username[50];
+    char password[50];
+    char courses[MAX_COURSES][50];
+    int seats[MAX_COURSES];
+    int initial_seats[MAX_COURSES];
+    int course_count;
+} FacultyV1;
+
+// Open a version 1 file for reading; a missing file counts as empty
+int open_v1(const char *path, size_t record_size, int *count) {
+    struct stat st;
+    char magic[RECORD_MAGIC_LEN];
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        *count = 0;
+        return errno == ENOENT ? -2 : -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+        memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_LEN) == 0) {
+        fprintf(stderr, "%s is already in the current format\n", path);
+        exit(EXIT_SUCCESS);
+    }
+    if (st.st_size % record_size != 0) {
+        fprintf(stderr, "%s: ignoring %ld trailing bytes\n", path, (long)(st.st_size % record_size));
+    }
+    *count = st.st_size / record_size;
+    return fd;
+}
+
+// Write a new table to path.tmp; finish_table() moves it into place
+int create_table(Table *t, const char *tmp_path, size_t record_size) {
+    unlink(tmp_path);
+    return table_open(t, tmp_path, record_size);
+}
+
+// Keep the old file as path.v1 and move the new one into place
+int finish_table(Table *t, const char *path) {
+    char backup[PATH_MAX];
+
+    if (fsync(t->fd) == -1) {
+        perror(t->path);
+        return -1;
+    }
+    snprintf(backup, sizeof(backup), "%s.v1", path);
+    if (access(path, F_OK) == 0 && rename(path, backup) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (rename(t->path, path) == -1) {
+        perror(t->path);
+        return -1;
+    }
+    printf("%-13s %6d records, %8ld bytes\n", path, table_count(t), (long)table_offset(t, table_count(t)));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int admin_fd, student_fd, faculty_fd;
+    int admins, students, faculty_count;
+    struct stat st;
+    long old_bytes = 0;
+
+    if (argc > 2 || (argc == 2 && chdir(argv[1]) == -1)) {
+        fprintf(stderr, "Usage: %s [directory]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (access("courses.dat", F_OK) == 0) {
+        fprintf(stderr, "courses.dat exists; the data files are already in the current format\n");
+        return EXIT_SUCCESS;
+    }
+
+    admin_fd = open_v1("admin.dat", sizeof(Admin), &admins);
+    student_fd = open_v1("students.dat", sizeof(StudentV1), &students);
+    faculty_fd = open_v1("faculty.dat", sizeof(FacultyV1), &faculty_count);
+    if (admin_fd == -1 || student_fd == -1 || faculty_fd == -1) {
+        perror("Error opening data file");
+        return EXIT_FAILURE;
+    }
+    old_bytes = (long)admins * sizeof(Admin) + (long)students * sizeof(StudentV1) +
+                (long)faculty_count * sizeof(FacultyV1);
+
+    // The tables are written straight to their files
+    config.storage = STORAGE_FILE;
+    if (create_table(&admin_table, "admin.dat.tmp", sizeof(Admin)) < 0 ||
+        create_table(&student_table, "students.dat.tmp", sizeof(Student)) < 0 ||
+        create_table(&faculty_table, "faculty.dat.tmp", sizeof(Faculty)) < 0 ||
+        create_table(&course_table, "courses.dat.tmp", sizeof(Course)) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    for (int id = 0; id < admins; id++) {
+        Admin admin;
+        if (pread(admin_fd, &admin, sizeof(admin), (off_t)id * sizeof(admin)) != (ssize_t)sizeof(admin) ||
+            table_append(&admin_table, &admin) != STATUS_OK) {
+            fprintf(stderr, "Error converting admin.dat\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Intern every offered course in the order the server used to find them
+    for (int id = 0; id < faculty_count; id++) {
+        FacultyV1 old;
+        Faculty faculty;
+
+        if (pread(faculty_fd, &old, sizeof(old), (off_t)id * sizeof(old)) != (ssize_t)sizeof(old)) {
+            fprintf(stderr, "Error reading faculty.dat\n");
+            return EXIT_FAILURE;
+        }
+        memset(&faculty, 0, sizeof(faculty));
+        faculty.id = id;
+        memcpy(faculty.username, old.username, sizeof(faculty.username) - 1);
+        memcpy(faculty.password, old.password, sizeof(faculty.password) - 1);
+
+        for (int i = 0; i < old.course_count && i < MAX_COURSES; i++) {
+            Course course;
+            old.courses[i][49] = '\0';
+            if (index_find(&course_index, old.courses[i]) != NULL) {
+                fprintf(stderr, "faculty %d: dropping duplicate course \"%s\"\n", id, old.courses[i]);
+                continue;
+            }
+            memset(&course, 0, sizeof(course));
+            course.id = table_count(&course_table);
+            copy_field(course.name, old.courses[i]);
+            course.faculty_id = id;
+            course.seats = old.seats[i];
+            course.capacity = old.initial_seats[i];
+            if (table_append(&course_table, &course) != STATUS_OK ||
+                index_insert(&course_index, course.name, course.id) < 0) {
+                fprintf(stderr, "Error writing courses.dat\n");
+                return EXIT_FAILURE;
+            }
+            faculty.courses[faculty.course_count++] = course.id;
+        }
+        if (table_append(&faculty_table, &faculty) != STATUS_OK) {
+            fprintf(stderr, "Error writing faculty.dat\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int id = 0; id < students; id++) {
+        StudentV1 old;
+        Student student;
+
+        if (pread(student_fd, &old, sizeof(old), (off_t)id * sizeof(old)) != (ssize_t)sizeof(old)) {
+            fprintf(stderr, "Error reading students.dat\n");
+            return EXIT_FAILURE;
+        }
+        memset(&student, 0, sizeof(student));
+        student.id = id;
+        memcpy(student.username, old.username, sizeof(student.username) - 1);
+        memcpy(student.password, old.password, sizeof(student.password) - 1);
+        student.active = old.active;
+
+        for (int i = 0; i < old.course_count && i < MAX_COURSES; i++) {
+            old.courses[i][49] = '\0';
+            IndexEntry *entry = index_find(&course_index, old.courses[i]);
+            if (entry == NULL) {
+                fprintf(stderr, "student %d: dropping unknown course \"%s\"\n", id, old.courses[i]);
+                continue;
+            }
+            student.courses[student.course_count++] = entry->id;
+        }
+        if (table_append(&student_table, &student) != STATUS_OK) {
+            fprintf(stderr, "Error writing students.dat\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (finish_table(&admin_table, "admin.dat") < 0 ||
+        finish_table(&student_table, "students.dat") < 0 ||
+        finish_table(&faculty_table, "faculty.dat") < 0 ||
+        finish_table(&course_table, "courses.dat") < 0) {
+        return EXIT_FAILURE;
+    }
+
+    long new_bytes = 0;
+    const char *files[] = { "admin.dat", "students.dat", "faculty.dat", "courses.dat" };
+    for (int i = 0; i < 4; i++) {
+        if (stat(files[i], &st) == 0) {
+            new_bytes += st.st_size;
+        }
+    }
+    printf("Migrated %ld bytes to %ld bytes\n", old_bytes, new_bytes);
+    return 0;
+}
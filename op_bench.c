@@ -0,0 +1,263 @@
+/**
+ * Operation benchmark for Academia Portal
+ * Times the server's data-access functions on generated datasets of growing
+ * size, without sockets, so changes to the storage path show up as numbers
+ *
+ * Build: gcc -O2 op_bench.c -o op_bench -lpthread
+ * Run:   ./op_bench [iterations] [directory] [max_students]
+ *
+ * Each dataset (1k, 100k and 1M students, up to max_students) is generated
+ * in its own process on fresh data files in a temporary directory under the
+ * given one (default: current directory), with the server's default storage
+ * settings. It has one course per OP_BENCH_STUDENTS_PER_COURSE students,
+ * OP_BENCH_COURSES_PER_FACULTY courses per faculty member, and every student
+ * enrolled in one course, so the courses are half full. The syscalls column
+ * counts pread, pwrite, write, ftruncate, msync, fsync and fdatasync calls
+ * per operation and the bytes column the bytes passed to pwrite and write.
+ * storage_bench compares the storage backends instead.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdatomic.h>
+
+// Count the data file system calls made by the storage layer, and the bytes
+// they write
+static atomic_long bench_syscalls;
+static atomic_long bench_bytes;
+#define COUNTED(call) (atomic_fetch_add(&bench_syscalls, 1), call)
+#define WRITTEN(n, call) (atomic_fetch_add(&bench_bytes, (long)(n)), COUNTED(call))
+#define pread(...) COUNTED(pread(__VA_ARGS__))
+#define pwrite(fd, buf, n, off) WRITTEN(n, pwrite(fd, buf, n, off))
+#define write(fd, buf, n) WRITTEN(n, write(fd, buf, n))
+#define ftruncate(...) COUNTED(ftruncate(__VA_ARGS__))
+#define msync(...) COUNTED(msync(__VA_ARGS__))
+#define fsync(...) COUNTED(fsync(__VA_ARGS__))
+#define fdatasync(...) COUNTED(fdatasync(__VA_ARGS__))
+
+#define ACADEMIA_NO_MAIN
+#include "server.c"
+
+#define OP_BENCH_STUDENTS_PER_COURSE (MAX_SEATS / 2)
+#define OP_BENCH_COURSES_PER_FACULTY MAX_COURSES
+#define OP_BENCH_IMPORT_BATCH PROTO_IMPORT_MAX_ROWS
+#define OP_BENCH_MAX_REMOVES 1000
+
+static const int dataset_sizes[] = { 1000, 100000, 1000000 };
+
+static long bench_start_ns;
+static long bench_start_calls;
+static long bench_start_bytes;
+
+static void bench_begin() {
+    bench_start_calls = atomic_load(&bench_syscalls);
+    bench_start_bytes = atomic_load(&bench_bytes);
+    bench_start_ns = now_ns();
+}
+
+static void bench_end(int students, const char *op, int ops, int ok) {
+    long ns = now_ns() - bench_start_ns;
+    long calls = atomic_load(&bench_syscalls) - bench_start_calls;
+    long bytes = atomic_load(&bench_bytes) - bench_start_bytes;
+    printf("%-9d %-9s %8d %8d %10.0f %10.2f %10.1f\n", students, op, ops, ok,
+           (double)ns / ops, (double)calls / ops, (double)bytes / ops);
+}
+
+static void course_name(char *name, int course) {
+    sprintf(name, "Course %d", course);
+}
+
+// Add the students, faculty, courses and enrollments of one dataset
+static int generate(int students, int courses) {
+    int faculty = (courses + OP_BENCH_COURSES_PER_FACULTY - 1) / OP_BENCH_COURSES_PER_FACULTY;
+    ImportRow *rows = calloc(OP_BENCH_IMPORT_BATCH, sizeof(ImportRow));
+    char name[50];
+    int first_id, added, n;
+
+    // Students first, then faculty, never both in one batch
+    for (int first = 0; first < students + faculty; first += n) {
+        int end = first < students ? students : students + faculty;
+        n = end - first < OP_BENCH_IMPORT_BATCH ? end - first : OP_BENCH_IMPORT_BATCH;
+        for (int i = 0; i < n; i++) {
+            int id = first + i;
+            sprintf(rows[i].username, id < students ? "student%d" : "faculty%d", id < students ? id : id - students);
+            strcpy(rows[i].password, "secret");
+            rows[i].status = STATUS_OK;
+        }
+        if (import_users(first < students ? "student" : "faculty", rows, n, &first_id, &added) != STATUS_OK ||
+            added != n) {
+            free(rows);
+            return -1;
+        }
+    }
+    free(rows);
+
+    for (int c = 0; c < courses; c++) {
+        course_name(name, c);
+        if (add_course(c / OP_BENCH_COURSES_PER_FACULTY, name, MAX_SEATS) != STATUS_OK) {
+            return -1;
+        }
+    }
+    for (int s = 0; s < students; s++) {
+        course_name(name, s % courses);
+        if (enroll_course(s, name, NULL) != STATUS_OK) {
+            return -1;
+        }
+    }
+    seat_flush();
+    return 0;
+}
+
+// Run every operation on one dataset; called in a child process
+static int bench_dataset(int students, int iterations) {
+    int courses = students / OP_BENCH_STUDENTS_PER_COURSE;
+    int faculty = (courses + OP_BENCH_COURSES_PER_FACULTY - 1) / OP_BENCH_COURSES_PER_FACULTY;
+    char username[50], password[50], name[50];
+    char student_role[] = "student";
+    int *picks = malloc(iterations * 2 * sizeof(int));
+
+    srand(1);
+
+    // Keep the server's start-up messages out of the results
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    freopen("/dev/null", "w", stdout);
+    initialize_files();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    long start = now_ns();
+    if (generate(students, courses) < 0) {
+        fprintf(stderr, "Error generating %d students\n", students);
+        return -1;
+    }
+    fprintf(stderr, "%d students, %d faculty, %d courses generated in %ld ms\n",
+            students, faculty, courses, (now_ns() - start) / 1000000);
+
+    int ok = 0;
+    strcpy(password, "secret");
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        sprintf(username, "student%d", rand() % students);
+        ok += authenticate_user(username, password, student_role) >= 0;
+    }
+    bench_end(students, "login", iterations, ok);
+
+    ok = 0;
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        course_name(name, rand() % courses);
+        ok += check_course_exists(name);
+    }
+    bench_end(students, "lookup", iterations, ok);
+
+    // Enroll random students in random courses, then drop the same courses.
+    // Seat counts reach courses.dat from the seat writer thread; flushing
+    // them before the clock stops counts those writes too. On small
+    // datasets many courses fill up, and the ok column shows it.
+    for (int i = 0; i < iterations; i++) {
+        picks[2 * i] = rand() % students;
+        picks[2 * i + 1] = rand() % courses;
+    }
+    ok = 0;
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        course_name(name, picks[2 * i + 1]);
+        ok += enroll_course(picks[2 * i], name, NULL) == STATUS_OK;
+    }
+    seat_flush();
+    bench_end(students, "enroll", iterations, ok);
+
+    ok = 0;
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        course_name(name, picks[2 * i + 1]);
+        ok += unenroll_course(picks[2 * i], name) == STATUS_OK;
+    }
+    seat_flush();
+    bench_end(students, "unenroll", iterations, ok);
+
+    ok = 0;
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        CourseInfo *list;
+        RosterEntry *roster;
+        int course_count, count;
+        if (view_enrollments(rand() % faculty, &list, &course_count, &roster, &count) == STATUS_OK) {
+            free(list);
+            free(roster);
+            ok++;
+        }
+    }
+    bench_end(students, "view", iterations, ok);
+
+    // Every removal drops a course from its students' lists, so it runs on
+    // fewer courses; the last courses go first
+    int removes = courses / 2 < OP_BENCH_MAX_REMOVES ? courses / 2 : OP_BENCH_MAX_REMOVES;
+    ok = 0;
+    bench_begin();
+    for (int i = 0; i < removes; i++) {
+        int c = courses - 1 - i;
+        course_name(name, c);
+        ok += remove_course(c / OP_BENCH_COURSES_PER_FACULTY, name) == STATUS_OK;
+    }
+    bench_end(students, "remove", removes, ok);
+
+    free(picks);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    const char *dir = argc > 2 ? argv[2] : ".";
+    int max_students = argc > 3 ? atoi(argv[3]) : 1000000;
+
+    if (iterations <= 0 || max_students <= 0) {
+        fprintf(stderr, "Usage: %s [iterations] [directory] [max_students]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-9s %-9s %8s %8s %10s %10s %10s\n", "students", "op", "ops", "ok", "ns/op", "syscalls", "bytes");
+    fflush(stdout);
+
+    for (size_t i = 0; i < sizeof(dataset_sizes) / sizeof(dataset_sizes[0]) && dataset_sizes[i] <= max_students; i++) {
+        char path[PATH_MAX];
+        int status = 0;
+        snprintf(path, sizeof(path), "%s/academia-ops-XXXXXX", dir);
+        if (mkdtemp(path) == NULL) {
+            perror("Error creating benchmark directory");
+            return EXIT_FAILURE;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (chdir(path) == -1) {
+                perror("Error entering benchmark directory");
+                _exit(EXIT_FAILURE);
+            }
+            int result = bench_dataset(dataset_sizes[i], iterations);
+            fflush(stdout);
+            _exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        waitpid(pid, &status, 0);
+
+        const char *files[] = { "admin.dat", "students.dat", "faculty.dat", "courses.dat", "wal.log" };
+        for (int f = 0; f < 5; f++) {
+            char file[PATH_MAX + 16];
+            snprintf(file, sizeof(file), "%s/%s", path, files[f]);
+            unlink(file);
+        }
+        rmdir(path);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,328 @@
+/**
+ * Binary protocol for Academia Portal
+ * Shared by the server and the clients
+ *
+ * A client selects the binary protocol by sending PROTO_MAGIC right after
+ * connecting. The server answers with the same magic after its text welcome
+ * banner, which the client skips. From then on every request and every
+ * response is one frame:
+ *
+ *   uint16 opcode | uint16 status | uint32 payload length | payload
+ *
+ * All integers are in network byte order. Payload fields are u8, u32 and
+ * str (u16 length followed by the bytes, no terminator). Requests carry
+ * status 0; a response repeats the request opcode.
+ *
+ * Requests may be pipelined: a client can send any number of frames without
+ * waiting, and the server answers them one by one in the order received.
+ * EXPORT_ENROLLMENTS is the one request answered with several frames.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#define PROTO_MAGIC "\xAC" "AP1"
+#define PROTO_MAGIC_LEN 4
+#define PROTO_HEADER_SIZE 8
+#define PROTO_MAX_PAYLOAD (1 << 20)
+#define PROTO_MAX_REQUEST 65536     // Largest request frame, header included; the server
+                                    // closes the connection on a longer one
+
+// Roles, as used by LOGIN and UPDATE_DETAILS (same numbers as the text menu)
+#define PROTO_ROLE_ADMIN 1
+#define PROTO_ROLE_FACULTY 2
+#define PROTO_ROLE_STUDENT 3
+
+// IMPORT_USERS data formats. CSV is one "username,password" line per row
+// (a trailing \r is ignored); records are u32 n, n x (str username, str
+// password). Rows are numbered from first_row in the request, so a client
+// streaming a file over several frames, each within PROTO_MAX_REQUEST, gets
+// errors by line number.
+#define PROTO_IMPORT_CSV 1
+#define PROTO_IMPORT_RECORDS 2
+#define PROTO_IMPORT_MAX_ROWS 4096    // Per frame; more is answered with LIMIT
+
+// EXPORT_ENROLLMENTS data formats, one row per enrolled course. CSV starts
+// with the header line "student_id,student,course_id,course,faculty_id,faculty";
+// records are u32 student_id, str student, u32 course_id, str course,
+// u32 faculty_id, str faculty. A course being removed has faculty_id
+// 0xFFFFFFFF (-1 in CSV) and an empty faculty name.
+#define PROTO_EXPORT_CSV 1
+#define PROTO_EXPORT_RECORDS 2
+
+// Opcodes. Request payload -> response payload on success.
+enum {
+    OP_LOGIN = 1,               // u8 role, str username, str password -> u32 user_id
+    OP_LOGOUT = 2,              // -> (connection is closed)
+
+    OP_ADD_STUDENT = 10,        // str username, str password -> u32 id
+    OP_ADD_FACULTY = 11,        // str username, str password -> u32 id
+                                // (the new user's ID; EXISTS and other failures carry no id)
+    OP_TOGGLE_STUDENT = 12,     // u32 id -> u8 active
+    OP_UPDATE_DETAILS = 13,     // u8 role, u32 id, str username, str password ("" keeps current)
+    OP_IMPORT_USERS = 14,       // u8 role, u8 format, u32 first_row, rows to the end of the payload
+                                // -> u32 first_id, u32 added, u32 n, n x (u32 row, u8 status)
+                                // (added rows get IDs first_id, first_id + 1, ... in row order;
+                                //  the n rejected rows are listed with EXISTS or INVALID)
+    OP_EXPORT_ENROLLMENTS = 15, // u8 format -> a series of frames, each u8 more, u32 rows, data
+                                // (rows as of one snapshot; the frame with more = 0, or any
+                                //  failed frame, is the last; UNAVAILABLE while another export runs)
+    OP_DUMP_TRACE = 16,         // u32 seconds (0: the server's --trace window) -> str file
+                                // (writes the spans of the last seconds to file in the server's
+                                //  directory; UNAVAILABLE without --trace)
+
+    OP_LIST_COURSES = 20,       // -> u32 n, n x (str name, u32 seats_left)
+    OP_ENROLL = 21,             // str course -> u32 seats_left
+    OP_UNENROLL = 22,           // str course
+    OP_VIEW_ENROLLED = 23,      // -> u32 n, n x str course
+    OP_CHANGE_PASSWORD = 24,    // str old_password, str new_password
+    OP_JOIN_WAITLIST = 25,      // str course -> u32 position (0: a seat was free, now enrolled;
+                                //  joining again only reports the position)
+    OP_LEAVE_WAITLIST = 26,     // str course
+    OP_VIEW_WAITLISTS = 27,     // -> u32 n, n x (str course, u32 position); position 0 for a
+                                //  course entered from its waitlist since the last view
+
+    OP_ADD_COURSE = 30,         // str course, u32 seats
+    OP_REMOVE_COURSE = 31,      // str course
+    OP_VIEW_ENROLLMENTS = 32,   // -> u32 n, n x (str course, u32 enrolled, u32 capacity,
+                                //                u32 m, m x (u32 student_id, str username))
+
+    OP_BATCH = 40               // u32 n, n x request frame -> u32 n, n x response frame
+                                // (run in order, each with its own record locks)
+};
+
+// Response status codes
+enum {
+    PROTO_OK = 0,
+    PROTO_ERROR = 1,            // Server could not access its data files
+    PROTO_NOT_FOUND = 2,        // No such student/faculty
+    PROTO_EXISTS = 3,           // Already enrolled / course or username already exists
+    PROTO_UNAVAILABLE = 4,      // Course not found or no seats available
+    PROTO_NOT_ENROLLED = 5,     // Course not in the caller's list
+    PROTO_WRONG_PASSWORD = 6,   // Old password incorrect
+    PROTO_LIMIT = 7,            // Course limit reached
+    PROTO_INVALID = 8,          // Invalid value (e.g. seat count, empty username)
+    PROTO_DENIED = 9,           // Login failed, or operation not allowed for the role
+    PROTO_BAD_REQUEST = 10,     // Malformed payload or unknown opcode
+    PROTO_BUSY = 11             // Server overloaded; payload is u32 retry_after_ms
+};
+
+static inline const char *proto_status_name(int status) {
+    static const char *names[] = {
+        "OK", "ERROR", "NOT_FOUND", "EXISTS", "UNAVAILABLE", "NOT_ENROLLED",
+        "WRONG_PASSWORD", "LIMIT", "INVALID", "DENIED", "BAD_REQUEST", "BUSY"
+    };
+    return status >= 0 && status <= PROTO_BUSY ? names[status] : "UNKNOWN";
+}
+
+// Growable output buffer for building frames
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} ProtoWriter;
+
+// Bounds-checked cursor over a received payload. error is set on underrun.
+typedef struct {
+    const uint8_t *p;
+    size_t left;
+    int error;
+} ProtoReader;
+
+static inline void proto_reserve(ProtoWriter *w, size_t n) {
+    if (w->len + n > w->cap) {
+        size_t cap = w->cap ? w->cap : 256;
+        while (cap < w->len + n) {
+            cap *= 2;
+        }
+        uint8_t *grown = realloc(w->data, cap);
+        if (grown == NULL) {
+            abort();
+        }
+        w->data = grown;
+        w->cap = cap;
+    }
+}
+
+static inline void proto_put_u8(ProtoWriter *w, uint8_t v) {
+    proto_reserve(w, 1);
+    w->data[w->len++] = v;
+}
+
+static inline void proto_put_u16(ProtoWriter *w, uint16_t v) {
+    uint16_t n = htons(v);
+    proto_reserve(w, 2);
+    memcpy(w->data + w->len, &n, 2);
+    w->len += 2;
+}
+
+static inline void proto_put_u32(ProtoWriter *w, uint32_t v) {
+    uint32_t n = htonl(v);
+    proto_reserve(w, 4);
+    memcpy(w->data + w->len, &n, 4);
+    w->len += 4;
+}
+
+static inline void proto_put_str(ProtoWriter *w, const char *s) {
+    size_t n = strlen(s);
+    if (n > 0xFFFF) {
+        n = 0xFFFF;
+    }
+    proto_put_u16(w, (uint16_t)n);
+    proto_reserve(w, n);
+    memcpy(w->data + w->len, s, n);
+    w->len += n;
+}
+
+// Start a frame; returns its offset for proto_end_frame
+static inline size_t proto_begin_frame(ProtoWriter *w, uint16_t opcode) {
+    size_t start = w->len;
+    proto_put_u16(w, opcode);
+    proto_put_u16(w, 0);
+    proto_put_u32(w, 0);
+    return start;
+}
+
+// Fill in the status and payload length of a frame started at start
+static inline void proto_end_frame(ProtoWriter *w, size_t start, uint16_t status) {
+    uint16_t st = htons(status);
+    uint32_t len = htonl((uint32_t)(w->len - start - PROTO_HEADER_SIZE));
+    memcpy(w->data + start + 2, &st, 2);
+    memcpy(w->data + start + 4, &len, 4);
+}
+
+static inline void proto_parse_header(const uint8_t *p, uint16_t *opcode, uint16_t *status, uint32_t *len) {
+    uint16_t op, st;
+    uint32_t n;
+    memcpy(&op, p, 2);
+    memcpy(&st, p + 2, 2);
+    memcpy(&n, p + 4, 4);
+    *opcode = ntohs(op);
+    *status = ntohs(st);
+    *len = ntohl(n);
+}
+
+static inline uint8_t proto_get_u8(ProtoReader *r) {
+    if (r->left < 1) {
+        r->error = 1;
+        return 0;
+    }
+    r->left--;
+    return *r->p++;
+}
+
+static inline uint16_t proto_get_u16(ProtoReader *r) {
+    uint16_t v;
+    if (r->left < 2) {
+        r->error = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, 2);
+    r->p += 2;
+    r->left -= 2;
+    return ntohs(v);
+}
+
+static inline uint32_t proto_get_u32(ProtoReader *r) {
+    uint32_t v;
+    if (r->left < 4) {
+        r->error = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, 4);
+    r->p += 4;
+    r->left -= 4;
+    return ntohl(v);
+}
+
+// Read a str field into dest, truncating to size - 1 bytes
+static inline void proto_get_str(ProtoReader *r, char *dest, size_t size) {
+    uint16_t n = proto_get_u16(r);
+    if (r->error || r->left < n) {
+        r->error = 1;
+        dest[0] = '\0';
+        return;
+    }
+    size_t copy = n < size - 1 ? n : size - 1;
+    memcpy(dest, r->p, copy);
+    dest[copy] = '\0';
+    r->p += n;
+    r->left -= n;
+}
+
+// Blocking helpers for simple clients
+
+static inline int proto_send_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static inline int proto_recv_all(int fd, void *data, size_t len) {
+    uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Switch a freshly connected socket to the binary protocol, skipping the
+// text welcome banner. Returns 0 on success.
+static inline int proto_handshake(int fd) {
+    char window[PROTO_MAGIC_LEN] = {0};
+    uint8_t c;
+
+    if (proto_send_all(fd, PROTO_MAGIC, PROTO_MAGIC_LEN) < 0) {
+        return -1;
+    }
+    while (memcmp(window, PROTO_MAGIC, PROTO_MAGIC_LEN) != 0) {
+        if (proto_recv_all(fd, &c, 1) < 0) {
+            return -1;
+        }
+        memmove(window, window + 1, PROTO_MAGIC_LEN - 1);
+        window[PROTO_MAGIC_LEN - 1] = (char)c;
+    }
+    return 0;
+}
+
+// Read one response frame. *payload is malloc'd and must be freed by the caller.
+static inline int proto_read_frame(int fd, uint16_t *opcode, uint16_t *status, uint8_t **payload, uint32_t *len) {
+    uint8_t header[PROTO_HEADER_SIZE];
+
+    if (proto_recv_all(fd, header, sizeof(header)) < 0) {
+        return -1;
+    }
+    proto_parse_header(header, opcode, status, len);
+    if (*len > PROTO_MAX_PAYLOAD) {
+        return -1;
+    }
+    *payload = malloc(*len ? *len : 1);
+    if (*payload == NULL || proto_recv_all(fd, *payload, *len) < 0) {
+        free(*payload);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
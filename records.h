@@ -0,0 +1,62 @@
+/**
+ * On-disk record format for Academia Portal
+ * Shared by the server and the migration tool
+ *
+ * Every data file starts with a FileHeader followed by fixed-size records;
+ * record i is at offset sizeof(FileHeader) + i * record_size. Course names
+ * are interned in courses.dat: a course's ID is its record number there and
+ * never changes, even after the course is removed. Students and faculty
+ * refer to courses by ID.
+ *
+ * Version 1 files had no header and stored each course name inline
+ * (char[50][50] per student and faculty record). Convert them with migrate.
+ */
+
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdint.h>
+
+#define RECORD_MAGIC "ACDB"
+#define RECORD_MAGIC_LEN 4
+#define RECORD_VERSION 2
+#define MAX_COURSES 50
+
+typedef struct {
+    char magic[RECORD_MAGIC_LEN];
+    uint32_t version;
+    uint32_t record_size;   // Checked on open, so a changed struct is not misread
+    uint32_t reserved;
+} FileHeader;
+
+typedef struct {
+    int id;
+    char username[50];
+    char password[50];
+    int active;
+    int course_count;
+    int courses[MAX_COURSES];   // Enrolled course IDs, course_count used
+} Student;
+
+typedef struct {
+    int id;
+    char username[50];
+    char password[50];
+    int course_count;
+    int courses[MAX_COURSES];   // Offered course IDs, course_count used
+} Faculty;
+
+typedef struct {
+    char username[50];
+    char password[50];
+} Admin;
+
+typedef struct {
+    int id;
+    char name[50];
+    int faculty_id;         // Offering faculty, -1 once the course is removed
+    int seats;              // Available seats
+    int capacity;           // Seats the course was created with
+} Course;
+
+#endif
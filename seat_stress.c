@@ -0,0 +1,342 @@
+/**
+ * Seat reservation stress test for Academia Portal
+ * Hammers the server's own enroll/unenroll functions from many threads and
+ * checks that no course is ever oversold
+ *
+ * Build: gcc -O2 seat_stress.c -o seat_stress -lpthread
+ * Run:   ./seat_stress [threads] [iterations] [directory]
+ *
+ * Runs once per enroll mode (cas, combine), each in its own process on fresh
+ * data files in a temporary directory under the given one (default: current
+ * directory). Three phases:
+ *   rush   every thread tries to enroll every student in one course with
+ *          STRESS_RUSH_SEATS seats; exactly that many enrollments succeed
+ *   wait   threads enroll in, join and leave the waitlist of a course with
+ *          STRESS_WAIT_SEATS seats and unenroll again; afterwards no seat
+ *          may be free while students wait, and every waiting student must
+ *          be on the course's waitlist
+ *   churn  threads enroll and unenroll a few students in a few small
+ *          courses while another thread removes and re-adds them and another
+ *          keeps reading rosters and student records, which must never be
+ *          torn; afterwards every course's enrollments must match its seat
+ *          count, roster and the seats stored in courses.dat
+ * Exits with status 1 if any check fails.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/wait.h>
+
+#define ACADEMIA_NO_MAIN
+#include "server.c"
+
+#define STRESS_STUDENTS 2000
+#define STRESS_RUSH_SEATS 100
+#define STRESS_COURSES 8
+#define STRESS_SEATS 20
+#define STRESS_CHURN_STUDENTS 64    // Few enough that unenrolling frees seats
+#define STRESS_WAIT_SEATS 10
+#define STRESS_WAIT_STUDENTS 200    // Students 1000 on, so rush and churn are not affected
+
+typedef struct {
+    int thread;
+    int threads;
+    int iterations;
+    atomic_int *done;
+} StressJob;
+
+static atomic_int rush_enrolled;
+static atomic_int oversold;
+static atomic_int torn;
+static long reads;
+static int failures;
+
+static void check(int ok, const char *what, int course) {
+    if (!ok) {
+        printf("FAIL: %s (course %d)\n", what, course);
+        failures++;
+    }
+}
+
+// Every thread walks all students, so each seat is contended by all of them
+static void *rush_run(void *arg) {
+    StressJob *job = arg;
+    int seats_left;
+
+    for (int i = 0; i < STRESS_STUDENTS; i++) {
+        int student = (i + job->thread * STRESS_STUDENTS / job->threads) % STRESS_STUDENTS;
+        if (enroll_course(student, "Rush", &seats_left) == STATUS_OK) {
+            atomic_fetch_add(&rush_enrolled, 1);
+            if (seats_left < 0) {
+                atomic_fetch_add(&oversold, 1);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Each thread has its own students, who join the waitlist, enroll from it,
+// unenroll and sometimes leave it
+static void *wait_run(void *arg) {
+    StressJob *job = arg;
+    unsigned seed = job->thread + 100;
+    Student student;
+    int position;
+
+    for (int i = 0; i < job->iterations; i++) {
+        int k = rand_r(&seed) % (STRESS_WAIT_STUDENTS / job->threads);
+        int id = 1000 + k * job->threads + job->thread;
+        read_student(id, &student);
+        int enrolled = 0;
+        for (int c = 0; c < student.course_count; c++) {
+            enrolled |= student.courses[c] == course_lookup("Wait", NULL);
+        }
+        if (enrolled) {
+            unenroll_course(id, "Wait");
+        } else if (rand_r(&seed) % 8 == 0) {
+            leave_waitlist(id, "Wait");
+        } else if (rand_r(&seed) % 4 == 0) {
+            enroll_course(id, "Wait", NULL);
+        } else if (join_waitlist(id, "Wait", &position) == STATUS_OK && position > STRESS_WAIT_STUDENTS) {
+            atomic_fetch_add(&oversold, 1);
+        }
+        int seats = seat_count(course_lookup("Wait", NULL));
+        if (seats < 0 || seats > STRESS_WAIT_SEATS) {
+            atomic_fetch_add(&oversold, 1);
+        }
+    }
+    return NULL;
+}
+
+// Random enrollments in the small courses; seats are checked as they go
+static void *churn_run(void *arg) {
+    StressJob *job = arg;
+    unsigned seed = job->thread + 1;
+    char course[50];
+    int seats_left;
+
+    for (int i = 0; i < job->iterations; i++) {
+        int c = rand_r(&seed) % STRESS_COURSES;
+        int student = rand_r(&seed) % STRESS_CHURN_STUDENTS;
+        sprintf(course, "Course %d", c);
+        if (rand_r(&seed) % 2 == 0) {
+            if (enroll_course(student, course, &seats_left) == STATUS_OK && seats_left < 0) {
+                atomic_fetch_add(&oversold, 1);
+            }
+        } else {
+            unenroll_course(student, course);
+        }
+        int seats = seat_count(course_lookup(course, NULL));
+        if (seats < 0 || seats > STRESS_SEATS) {
+            atomic_fetch_add(&oversold, 1);
+        }
+    }
+    atomic_fetch_add(job->done, 1);
+    return NULL;
+}
+
+// Remove and re-add the small courses until the churn threads finish
+static void *faculty_run(void *arg) {
+    StressJob *job = arg;
+    unsigned seed = 12345;
+    char course[50];
+
+    while (atomic_load(job->done) < job->threads) {
+        sprintf(course, "Course %d", rand_r(&seed) % STRESS_COURSES);
+        remove_course(0, course);
+        add_course(0, course, STRESS_SEATS);
+    }
+    return NULL;
+}
+
+// Read rosters and student records while they change; every copy must be
+// one that existed: rosters sorted and within capacity, course IDs valid
+static void *reader_run(void *arg) {
+    StressJob *job = arg;
+    unsigned seed = 54321;
+    CourseInfo *courses;
+    RosterEntry *roster;
+    Student student;
+    int course_count, count;
+
+    while (atomic_load(job->done) < job->threads) {
+        if (view_enrollments(0, &courses, &course_count, &roster, &count) == STATUS_OK) {
+            for (int k = 0; k < count; k++) {
+                int course = roster[k].course;
+                if (course < 0 || course >= course_count || roster[k].id < 0 || roster[k].id >= STRESS_STUDENTS ||
+                    (k > 0 && course == roster[k - 1].course && roster[k].id <= roster[k - 1].id) ||
+                    (k >= courses[course].capacity && roster[k - courses[course].capacity].course == course)) {
+                    atomic_fetch_add(&torn, 1);
+                }
+            }
+            free(courses);
+            free(roster);
+        }
+
+        read_student(rand_r(&seed) % STRESS_CHURN_STUDENTS, &student);
+        if (student.course_count < 0 || student.course_count > MAX_COURSES) {
+            atomic_fetch_add(&torn, 1);
+        }
+        for (int i = 0; i < student.course_count && i < MAX_COURSES; i++) {
+            if (student.courses[i] < 0 || student.courses[i] >= table_count(&course_table)) {
+                atomic_fetch_add(&torn, 1);
+            }
+        }
+        reads++;
+    }
+    return NULL;
+}
+
+static void run_threads(void *(*fn)(void *), StressJob *jobs, int threads) {
+    pthread_t ids[threads];
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&ids[t], NULL, fn, &jobs[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+}
+
+// Compare every course with the student records, its roster and its record
+static void check_courses() {
+    Student student;
+    Course course;
+    CourseRoster *roster;
+    int count = table_count(&course_table);
+    int enrolled[count];
+
+    memset(enrolled, 0, sizeof(enrolled));
+    for (int id = 0; id < table_count(&student_table); id++) {
+        read_student(id, &student);
+        for (int i = 0; i < student.course_count; i++) {
+            enrolled[student.courses[i]]++;
+        }
+    }
+
+    storage_flush();
+    for (int id = 0; id < count; id++) {
+        table_read(&course_table, id, &course);
+        course_lookup(course.name, &roster);
+        check(enrolled[id] <= course.capacity, "more students than seats", id);
+        check(enrolled[id] == course.capacity - seat_count(id), "seat count does not match enrollments", id);
+        check(enrolled[id] == roster->count, "roster does not match enrollments", id);
+        check(course.seats == seat_count(id), "stored seats differ from the counter", id);
+        printf("  %-10s %3d/%-3d enrolled\n", course.name, enrolled[id], course.capacity);
+    }
+}
+
+// Run both phases with one enroll mode; called in a child process
+static int stress(int threads, int iterations, const char *dir) {
+    char path[PATH_MAX], username[50], course[50];
+    atomic_int done = 0;
+    int id;
+
+    snprintf(path, sizeof(path), "%s/academia-stress-XXXXXX", dir);
+    if (mkdtemp(path) == NULL || chdir(path) == -1) {
+        perror("Error creating stress directory");
+        return EXIT_FAILURE;
+    }
+
+    // Keep the server's start-up messages out of the results
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    freopen("/dev/null", "w", stdout);
+    initialize_files();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    add_faculty("faculty", "secret", &id);
+    add_course(id, "Rush", STRESS_RUSH_SEATS);
+    add_course(id, "Wait", STRESS_WAIT_SEATS);
+    for (int c = 0; c < STRESS_COURSES; c++) {
+        sprintf(course, "Course %d", c);
+        add_course(id, course, STRESS_SEATS);
+    }
+    for (int i = 0; i < STRESS_STUDENTS; i++) {
+        sprintf(username, "student%d", i);
+        add_student(username, "secret", &id);
+    }
+
+    StressJob jobs[threads + 1];
+    for (int t = 0; t <= threads; t++) {
+        jobs[t] = (StressJob){ t, threads, iterations, &done };
+    }
+
+    long start = now_ns();
+    run_threads(rush_run, jobs, threads);
+    printf("rush:  %d threads, %d enrollments for %d seats in %.1f ms\n", threads,
+           atomic_load(&rush_enrolled), STRESS_RUSH_SEATS, (now_ns() - start) / 1e6);
+    check(atomic_load(&rush_enrolled) == STRESS_RUSH_SEATS, "rush enrollments differ from the seats", 0);
+
+    start = now_ns();
+    run_threads(wait_run, jobs, threads);
+    CourseRoster *roster;
+    int wait_id = course_lookup("Wait", &roster);
+    int waiting = waitlist_length(roster);
+    printf("wait:  %d threads x %d operations in %.1f ms, %d enrolled, %d waiting\n", threads, iterations,
+           (now_ns() - start) / 1e6, roster->count, waiting);
+    check(waiting == 0 || seat_count(wait_id) == 0, "a seat is free while students wait", wait_id);
+    for (int i = 0; i < STRESS_WAIT_STUDENTS; i++) {
+        StudentWaits *w = student_waits(1000 + i, 0);
+        int listed = w != NULL && w->waiting_count == 1 && w->waiting[0] == wait_id;
+        check(listed == (waitlist_position(roster, 1000 + i) > 0), "waitlist and student disagree", wait_id);
+    }
+
+    start = now_ns();
+    pthread_t faculty, reader;
+    pthread_create(&faculty, NULL, faculty_run, &jobs[threads]);
+    pthread_create(&reader, NULL, reader_run, &jobs[threads]);
+    run_threads(churn_run, jobs, threads);
+    pthread_join(faculty, NULL);
+    pthread_join(reader, NULL);
+    printf("churn: %d threads x %d operations in %.1f ms, %ld reads alongside\n", threads, iterations,
+           (now_ns() - start) / 1e6, reads);
+    check(atomic_load(&oversold) == 0, "seat count went out of range", -1);
+    check(atomic_load(&torn) == 0, "a read saw a torn roster or record", -1);
+
+    check_courses();
+
+    const char *files[] = { "admin.dat", "students.dat", "faculty.dat", "courses.dat" };
+    for (int f = 0; f < 4; f++) {
+        unlink(files[f]);
+    }
+    if (chdir("..") == 0) {
+        rmdir(strrchr(path, '/') + 1);
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 8;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+    const char *dir = argc > 3 ? argv[3] : ".";
+    const EnrollMode modes[] = { ENROLL_CAS, ENROLL_COMBINE };
+    const char *names[] = { "cas", "combine" };
+    int failed = 0;
+
+    if (threads <= 0 || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [threads] [iterations] [directory]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (int m = 0; m < 2; m++) {
+        int status;
+        printf("--enroll %s\n", names[m]);
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            config.enroll = modes[m];
+            int result = stress(threads, iterations, dir);
+            fflush(stdout);
+            _exit(result);
+        }
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
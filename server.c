@@ -1,1434 +1,6516 @@
-/**
- * Server implementation for Academia Portal
- * Course Registration System
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <pthread.h>
-#include <fcntl.h>
-#include <semaphore.h>
-#include <sys/stat.h>
-#include <signal.h>
-
-#define PORT 8080
-#define MAX_CLIENTS 100
-#define BUFFER_SIZE 1024
-#define MAX_COURSES 50
-#define MAX_SEATS 100
-
-// Structures
-typedef struct {
-    int id;
-    char username[50];
-    char password[50];
-    int active;
-    char courses[MAX_COURSES][50]; // Enrolled courses
-    int course_count;
-} Student;
-
-typedef struct {
-    int id;
-    char username[50];
-    char password[50];
-    char courses[MAX_COURSES][50]; // Offered courses
-    int seats[MAX_COURSES];        // Available seats for each course
-    int initial_seats[MAX_COURSES]; // <--- Add this line
-    int course_count;
-} Faculty;
-
-typedef struct {
-    char username[50];
-    char password[50];
-} Admin;
-
-// Global variables
-pthread_mutex_t student_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t faculty_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t course_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Function declarations
-void handle_client(int client_socket);
-void admin_menu(int client_socket);
-void student_menu(int client_socket, int student_id);
-void faculty_menu(int client_socket, int faculty_id);
-int authenticate_user(char *username, char *password, char *role);
-void add_student(int client_socket);
-void add_faculty(int client_socket);
-void toggle_student_status(int client_socket);
-void update_details(int client_socket);
-void enroll_course(int client_socket, int student_id);
-void unenroll_course(int client_socket, int student_id);
-void view_enrolled_courses(int client_socket, int student_id);
-void change_password(int client_socket, char *role, int id);
-void add_course(int client_socket, int faculty_id);
-void remove_course(int client_socket, int faculty_id);
-void view_enrollments(int client_socket, int faculty_id);
-int check_course_exists(char *course_name);
-void initialize_files();
-
-void signal_handler(int sig) {
-    // Clean up and exit gracefully
-    pthread_mutex_destroy(&student_mutex);
-    pthread_mutex_destroy(&faculty_mutex);
-    pthread_mutex_destroy(&course_mutex);
-    exit(0);
-}
-
-// Main function
-int main() {
-    int server_fd, client_socket;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    int opt = 1;
-    pthread_t thread_id;
-    
-    // Set up signal handler
-    signal(SIGINT, signal_handler);
-    
-    // Initialize files if they don't exist
-    initialize_files();
-    
-    // Create socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Set socket options
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-        perror("Setsockopt failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Prepare the sockaddr_in structure
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-    
-    // Bind the socket
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("Bind failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Listen for connections
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
-        perror("Listen failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    printf("Server started on port %d\n", PORT);
-    
-    // Accept connections and create threads for each client
-    while (1) {
-        if ((client_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {            perror("Accept failed");
-            continue;
-        }
-        
-        printf("New client connected\n");
-        
-        // Create a new thread for the client
-        if (pthread_create(&thread_id, NULL, (void *)handle_client, (void *)(intptr_t)client_socket) != 0) {
-            perror("Thread creation failed");
-            close(client_socket);
-        } else {
-            // Detach the thread so it cleans itself up when finished
-            pthread_detach(thread_id);
-        }
-    }
-    
-    // Clean up
-    close(server_fd);
-    pthread_mutex_destroy(&student_mutex);
-    pthread_mutex_destroy(&faculty_mutex);
-    pthread_mutex_destroy(&course_mutex);
-    
-    return 0;
-}
-
-// Initialize files if they don't exist
-void initialize_files() {
-    int fd;
-    Admin admin = {"admin", "admin123"};
-    
-    // Create admin file if it doesn't exist
-    if ((fd = open("admin.dat", O_RDWR | O_CREAT | O_EXCL, 0644)) != -1) {
-        write(fd, &admin, sizeof(Admin));
-        close(fd);
-        printf("Admin file created and initialized\n");
-    }
-    
-    // Create students file if it doesn't exist
-    if ((fd = open("students.dat", O_RDWR | O_CREAT, 0644)) == -1) {
-        perror("Error creating students file");
-    } else {
-        close(fd);
-    }
-    
-    // Create faculty file if it doesn't exist
-    if ((fd = open("faculty.dat", O_RDWR | O_CREAT, 0644)) == -1) {
-        perror("Error creating faculty file");
-    } else {
-        close(fd);
-    }
-}
-
-// Handle client connections
-void handle_client(int client_socket) {
-    char buffer[BUFFER_SIZE] = {0};
-    char username[50], password[50], role[10];
-    int choice, authenticated = 0, user_id = -1;
-    
-    // Send welcome message
-    char *welcome_msg = "Welcome to Academia Portal\n1. Admin\n2. Faculty\n3. Student\nEnter your choice: ";
-    write(client_socket, welcome_msg, strlen(welcome_msg));
-    
-    // Read role choice
-    read(client_socket, buffer, BUFFER_SIZE);
-    choice = atoi(buffer);
-    
-    // Ask for username and password
-    write(client_socket, "Enter username: ", strlen("Enter username: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(username, buffer);
-    
-    write(client_socket, "Enter password: ", strlen("Enter password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(password, buffer);
-    
-    // Set role based on choice
-    switch (choice) {
-        case 1:
-            strcpy(role, "admin");
-            break;
-        case 2:
-            strcpy(role, "faculty");
-            break;
-        case 3:
-            strcpy(role, "student");
-            break;
-        default:
-            write(client_socket, "Invalid choice\n", strlen("Invalid choice\n"));
-            close(client_socket);
-            return;
-    }
-    
-    // Authenticate user
-    user_id = authenticate_user(username, password, role);
-    if (user_id >= 0) {
-        authenticated = 1;
-        write(client_socket, "Login successful\n", strlen("Login successful\n"));
-    } else {
-        write(client_socket, "Login failed\n", strlen("Login failed\n"));
-        close(client_socket);
-        return;
-    }
-    
-    // If authenticated, redirect to respective menu
-    if (authenticated) {
-        if (strcmp(role, "admin") == 0) {
-            admin_menu(client_socket);
-        } else if (strcmp(role, "faculty") == 0) {
-            faculty_menu(client_socket, user_id);
-        } else if (strcmp(role, "student") == 0) {
-            student_menu(client_socket, user_id);
-        }
-    }
-    
-    // Close the connection
-    close(client_socket);
-}
-
-// Admin menu
-void admin_menu(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    int choice = 0;
-    
-    while (1) {
-        // Display admin menu
-        char *menu = "\n===== ADMIN MENU =====\n1. Add Student\n2. Add Faculty\n3. Activate/Deactivate Student\n4. Update Student/Faculty details\n5. Exit\nEnter your choice: ";
-        write(client_socket, menu, strlen(menu));
-        
-        // Read choice
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        choice = atoi(buffer);
-        
-        switch (choice) {
-            case 1:
-                add_student(client_socket);
-                break;
-            case 2:
-                add_faculty(client_socket);
-                break;
-            case 3:
-                toggle_student_status(client_socket);
-                break;
-            case 4:
-                update_details(client_socket);
-                break;
-            case 5:
-                write(client_socket, "Goodbye!\n", strlen("Goodbye!\n"));
-                return;
-            default:
-                write(client_socket, "Invalid choice\n", strlen("Invalid choice\n"));
-        }
-    }
-}
-
-// Student menu
-void student_menu(int client_socket, int student_id) {
-    char buffer[BUFFER_SIZE];
-    int choice = 0;
-    
-    while (1) {
-        // Display student menu
-        char *menu = "\n===== STUDENT MENU =====\n1. Enroll to new Courses\n2. Unenroll from already enrolled Courses\n3. View enrolled Courses\n4. Password Change\n5. Exit\nEnter your choice: ";
-        write(client_socket, menu, strlen(menu));
-        
-        // Read choice
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        choice = atoi(buffer);
-        
-        switch (choice) {
-            case 1:
-                enroll_course(client_socket, student_id);
-                break;
-            case 2:
-                unenroll_course(client_socket, student_id);
-                break;
-            case 3:
-                view_enrolled_courses(client_socket, student_id);
-                break;
-            case 4:
-                change_password(client_socket, "student", student_id);
-                break;
-            case 5:
-                write(client_socket, "Goodbye!\n", strlen("Goodbye!\n"));
-                return;
-            default:
-                write(client_socket, "Invalid choice\n", strlen("Invalid choice\n"));
-        }
-    }
-}
-
-// Faculty menu
-void faculty_menu(int client_socket, int faculty_id) {
-    char buffer[BUFFER_SIZE];
-    int choice = 0;
-    
-    while (1) {
-        // Display faculty menu
-        char *menu = "\n===== FACULTY MENU =====\n1. Add new Course\n2. Remove offered Course\n3. View enrollments in Courses\n4. Password Change\n5. Exit\nEnter your choice: ";
-        write(client_socket, menu, strlen(menu));
-        
-        // Read choice
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        choice = atoi(buffer);
-        
-        switch (choice) {
-            case 1:
-                add_course(client_socket, faculty_id);
-                break;
-            case 2:
-                remove_course(client_socket, faculty_id);
-                break;
-            case 3:
-                view_enrollments(client_socket, faculty_id);
-                break;
-            case 4:
-                change_password(client_socket, "faculty", faculty_id);
-                break;
-            case 5:
-                write(client_socket, "Goodbye!\n", strlen("Goodbye!\n"));
-                return;
-            default:
-                write(client_socket, "Invalid choice\n", strlen("Invalid choice\n"));
-        }
-    }
-}
-
-// Authenticate user
-int authenticate_user(char *username, char *password, char *role) {
-    if (strcmp(role, "admin") == 0) {
-        int fd = open("admin.dat", O_RDONLY);
-        if (fd == -1) {
-            perror("Error opening admin file");
-            return -1;
-        }
-        
-        Admin admin;
-        read(fd, &admin, sizeof(Admin));
-        close(fd);
-        
-        if (strcmp(admin.username, username) == 0 && strcmp(admin.password, password) == 0) {
-            return 0; // Success for admin
-        }
-    } else if (strcmp(role, "faculty") == 0) {
-        int fd = open("faculty.dat", O_RDONLY);
-        if (fd == -1) {
-            perror("Error opening faculty file");
-            printf("hello\n");
-            return -1;
-        }
-        
-        Faculty faculty;
-        int found = 0, id = 0;
-        while (read(fd, &faculty, sizeof(Faculty)) > 0) {
-            if (strcmp(faculty.username, username) == 0 && strcmp(faculty.password, password) == 0) {
-                found = 1;
-                break;
-            }
-            id++;
-        }
-        
-        close(fd);
-        
-        if (found) {
-            return id; // Return faculty ID
-        }
-    } else if (strcmp(role, "student") == 0) {
-        int fd = open("students.dat", O_RDONLY);
-        if (fd == -1) {
-            perror("Error opening students file");
-            return -1;
-        }
-        
-        Student student;
-        int found = 0, id = 0;
-        
-        while (read(fd, &student, sizeof(Student)) > 0) {
-            if (strcmp(student.username, username) == 0 && strcmp(student.password, password) == 0 && student.active) {
-                found = 1;
-                break;
-            }
-            id++;
-        }
-        
-        close(fd);
-        
-        if (found) {
-            return id; // Return student ID
-        }
-    }
-    
-    return -1; // Authentication failed
-}
-
-// Add student (Admin function)
-void add_student(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    Student new_student;
-    
-    // Get student details
-    write(client_socket, "Enter student username: ", strlen("Enter student username: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(new_student.username, buffer);
-    
-    write(client_socket, "Enter student password: ", strlen("Enter student password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(new_student.password, buffer);
-    
-    // Initialize other fields
-    new_student.active = 1;
-    new_student.course_count = 0;
-    
-    // Acquire lock for students file
-    pthread_mutex_lock(&student_mutex);
-    
-    // Open students file and find next available ID
-    int fd = open("students.dat", O_RDWR | O_APPEND);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Failed to add student\n", strlen("Failed to add student\n"));
-        return;
-    }
-    
-    // Determine student ID (count records in file)
-    struct stat st;
-    fstat(fd, &st);
-    new_student.id = st.st_size / sizeof(Student);
-    
-    // Write new student to file
-    write(fd, &new_student, sizeof(Student));
-    close(fd);
-    
-    // Release lock
-    pthread_mutex_unlock(&student_mutex);
-    
-    char response[100];
-    sprintf(response, "Student added successfully with ID: %d\n", new_student.id);
-    write(client_socket, response, strlen(response));
-}
-
-// Add faculty (Admin function)
-void add_faculty(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    Faculty new_faculty;
-    
-    // Get faculty details
-    write(client_socket, "Enter faculty username: ", strlen("Enter faculty username: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(new_faculty.username, buffer);
-    
-    write(client_socket, "Enter faculty password: ", strlen("Enter faculty password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(new_faculty.password, buffer);
-
-    // Initialize other fields
-    new_faculty.course_count = 0;
-    
-    // Acquire lock for faculty file
-    pthread_mutex_lock(&faculty_mutex);
-    
-    // Open faculty file and find next available ID
-    int fd = open("faculty.dat", O_RDWR | O_APPEND);
-    if (fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Failed to add faculty\n", strlen("Failed to add faculty\n"));
-        return;
-    }
-    
-    // Determine faculty ID (count records in file)
-    struct stat st;
-    fstat(fd, &st);
-    new_faculty.id = st.st_size / sizeof(Faculty);
-    
-    // Write new faculty to file
-    write(fd, &new_faculty, sizeof(Faculty));
-    close(fd);
-    
-    // Release lock
-    pthread_mutex_unlock(&faculty_mutex);
-    
-    char response[100];
-    sprintf(response, "Faculty added successfully with ID: %d\n", new_faculty.id);
-    write(client_socket, response, strlen(response));
-}
-
-// Activate/Deactivate student (Admin function)
-void toggle_student_status(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    int student_id;
-    
-    // Get student ID
-    write(client_socket, "Enter student ID: ", strlen("Enter student ID: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    student_id = atoi(buffer);
-    
-    // Acquire lock for students file
-    pthread_mutex_lock(&student_mutex);
-    
-    // Open students file
-    int fd = open("students.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Failed to toggle student status\n", strlen("Failed to toggle student status\n"));
-        return;
-    }
-    
-    // Find the student by ID
-    Student student;
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Student not found\n", strlen("Student not found\n"));
-        return;
-    }
-    
-    // Toggle active status
-    student.active = !student.active;
-    
-    // Write back to file
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    write(fd, &student, sizeof(Student));
-    close(fd);
-    
-    // Release lock
-    pthread_mutex_unlock(&student_mutex);
-    
-    char status[20] = {0};
-    strcpy(status, student.active ? "activated" : "deactivated");
-    
-    char response[100];
-    sprintf(response, "Student %s successfully\n", status);
-    write(client_socket, response, strlen(response));
-}
-
-// Update student/faculty details (Admin function)
-void update_details(int client_socket) {
-    char buffer[BUFFER_SIZE];
-    int choice, id;
-    
-    // Ask for role to update
-    write(client_socket, "Update: 1. Student 2. Faculty\nEnter choice: ", strlen("Update: 1. Student 2. Faculty\nEnter choice: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    choice = atoi(buffer);
-    
-    // Ask for ID
-    write(client_socket, "Enter ID: ", strlen("Enter ID: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    id = atoi(buffer);
-    
-    if (choice == 1) { // Update student
-        // Acquire lock for students file
-        pthread_mutex_lock(&student_mutex);
-        
-        // Open students file
-        int fd = open("students.dat", O_RDWR);
-        if (fd == -1) {
-            perror("Error opening students file");
-            pthread_mutex_unlock(&student_mutex);
-            write(client_socket, "Failed to update student\n", strlen("Failed to update student\n"));
-            return;
-        }
-        
-        // Find the student by ID
-        Student student;
-        lseek(fd, id * sizeof(Student), SEEK_SET);
-        if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-            close(fd);
-            pthread_mutex_unlock(&student_mutex);
-            write(client_socket, "Student not found\n", strlen("Student not found\n"));
-            return;
-        }
-        
-        // Get new details
-        write(client_socket, "Enter new username (or . to keep current): ", strlen("Enter new username (or . to keep current): "));
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        if (strcmp(buffer, ".") != 0) {
-            strcpy(student.username, buffer);
-        }
-        
-        write(client_socket, "Enter new password (or . to keep current): ", strlen("Enter new password (or . to keep current): "));
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        if (strcmp(buffer, ".") != 0) {
-            strcpy(student.password, buffer);
-        }
-        
-        // Write back to file
-        lseek(fd, id * sizeof(Student), SEEK_SET);
-        write(fd, &student, sizeof(Student));
-        close(fd);
-        
-        // Release lock
-        pthread_mutex_unlock(&student_mutex);
-        
-        write(client_socket, "Student details updated successfully\n", strlen("Student details updated successfully\n"));
-    } else if (choice == 2) { // Update faculty
-        // Acquire lock for faculty file
-        pthread_mutex_lock(&faculty_mutex);
-        
-        // Open faculty file
-        int fd = open("faculty.dat", O_RDWR);
-        if (fd == -1) {
-            perror("Error opening faculty file");
-            pthread_mutex_unlock(&faculty_mutex);
-            write(client_socket, "Failed to update faculty\n", strlen("Failed to update faculty\n"));
-            return;
-        }
-        
-        // Find the faculty by ID
-        Faculty faculty;
-        lseek(fd, id * sizeof(Faculty), SEEK_SET);
-        if (read(fd, &faculty, sizeof(Faculty)) != sizeof(Faculty)) {
-            close(fd);
-            pthread_mutex_unlock(&faculty_mutex);
-            write(client_socket, "Faculty not found\n", strlen("Faculty not found\n"));
-            return;
-        }
-        
-        // Get new details
-        write(client_socket, "Enter new username (or . to keep current): ", strlen("Enter new username (or . to keep current): "));
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        if (strcmp(buffer, ".") != 0) {
-            strcpy(faculty.username, buffer);
-        }
-        
-        write(client_socket, "Enter new password (or . to keep current): ", strlen("Enter new password (or . to keep current): "));
-        memset(buffer, 0, BUFFER_SIZE);
-        read(client_socket, buffer, BUFFER_SIZE);
-        if (strcmp(buffer, ".") != 0) {
-            strcpy(faculty.password, buffer);
-        }
-        
-        // Write back to file
-        lseek(fd, id * sizeof(Faculty), SEEK_SET);
-        write(fd, &faculty, sizeof(Faculty));
-        close(fd);
-        
-        // Release lock
-        pthread_mutex_unlock(&faculty_mutex);
-        
-        write(client_socket, "Faculty details updated successfully\n", strlen("Faculty details updated successfully\n"));
-    } else {
-        write(client_socket, "Invalid choice\n", strlen("Invalid choice\n"));
-    }
-}
-
-// Enroll in a course (Student function)
-void enroll_course(int client_socket, int student_id) {
-    char buffer[BUFFER_SIZE], course_list[BUFFER_SIZE];
-    char course_name[50];
-    
-    // Acquire read lock for courses (to display available courses)
-    pthread_mutex_lock(&course_mutex);
-    
-    // Open faculty file to get available courses
-    int fd = open("faculty.dat", O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Failed to get available courses\n", strlen("Failed to get available courses\n"));
-        return;
-    }
-    
-    // Build list of available courses with seats
-    Faculty faculty;
-    strcpy(course_list, "Available Courses:\n");
-    
-    while (read(fd, &faculty, sizeof(Faculty)) > 0) {
-        for (int i = 0; i < faculty.course_count; i++) {
-            if (faculty.seats[i] > 0) {
-                char course_info[100];
-                sprintf(course_info, "- %s (Available seats: %d)\n", faculty.courses[i], faculty.seats[i]);
-                strcat(course_list, course_info);
-            }
-        }
-    }
-    close(fd);
-    
-    // Release read lock
-    pthread_mutex_unlock(&course_mutex);
-    
-    // Send course list to client
-    write(client_socket, course_list, strlen(course_list));
-    
-    // Ask for course to enroll
-    write(client_socket, "Enter course name to enroll: ", strlen("Enter course name to enroll: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(course_name, buffer);
-    
-    // Acquire write lock for course enrollment
-    pthread_mutex_lock(&course_mutex);
-    pthread_mutex_lock(&student_mutex);
-    
-    // Check if student already enrolled in this course
-    fd = open("students.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Failed to enroll in course\n", strlen("Failed to enroll in course\n"));
-        return;
-    }
-    
-    Student student;
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Student not found\n", strlen("Student not found\n"));
-        return;
-    }
-    
-    // Check if already enrolled
-    for (int i = 0; i < student.course_count; i++) {
-        if (strcmp(student.courses[i], course_name) == 0) {
-            close(fd);
-            pthread_mutex_unlock(&student_mutex);
-            pthread_mutex_unlock(&course_mutex);
-            write(client_socket, "Already enrolled in this course\n", strlen("Already enrolled in this course\n"));
-            return;
-        }
-    }
-    
-    // Check course availability and reduce seats
-    int faculty_fd = open("faculty.dat", O_RDWR);
-    if (faculty_fd == -1) {
-        perror("Error opening faculty file");
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Failed to enroll in course\n", strlen("Failed to enroll in course\n"));
-        return;
-    }
-    
-    int course_found = 0, faculty_id = -1;
-    int course_index = -1;
-    
-    while (read(faculty_fd, &faculty, sizeof(Faculty)) > 0) {
-        for (int i = 0; i < faculty.course_count; i++) {
-            if (strcmp(faculty.courses[i], course_name) == 0 && faculty.seats[i] > 0) {
-                course_found = 1;
-                faculty_id = faculty.id;
-                course_index = i;
-                faculty.seats[i]--; // Reduce available seats
-                break;
-            }
-        }
-        if (course_found) break;
-    }
-    
-    if (!course_found) {
-        close(fd);
-        close(faculty_fd);
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Course not found or no seats available\n", strlen("Course not found or no seats available\n"));
-        return;
-    }
-    
-    // Update faculty file with reduced seats
-    lseek(faculty_fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    write(faculty_fd, &faculty, sizeof(Faculty));
-    close(faculty_fd);
-    
-    // Add course to student's enrolled courses
-    strcpy(student.courses[student.course_count], course_name);
-    student.course_count++;
-    
-    // Update student file
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    write(fd, &student, sizeof(Student));
-    close(fd);
-    
-    // Release locks
-    pthread_mutex_unlock(&student_mutex);
-    pthread_mutex_unlock(&course_mutex);
-    
-    write(client_socket, "Successfully enrolled in course\n", strlen("Successfully enrolled in course\n"));
-}
-
-// Unenroll from a course (Student function)
-void unenroll_course(int client_socket, int student_id) {
-    char buffer[BUFFER_SIZE], enrolled_courses[BUFFER_SIZE];
-    char course_name[50];
-    
-    // Acquire read lock for student courses
-    pthread_mutex_lock(&student_mutex);
-    
-    // Open students file to get enrolled courses
-    int fd = open("students.dat", O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Failed to get enrolled courses\n", strlen("Failed to get enrolled courses\n"));
-        return;
-    }
-    
-    Student student;
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Student not found\n", strlen("Student not found\n"));
-        return;
-    }
-    close(fd);
-    
-    // Build list of enrolled courses
-    strcpy(enrolled_courses, "Your enrolled courses:\n");
-    if (student.course_count == 0) {
-        strcat(enrolled_courses, "No courses enrolled\n");
-    } else {
-        for (int i = 0; i < student.course_count; i++) {
-            char course_info[100];
-            sprintf(course_info, "- %s\n", student.courses[i]);
-            strcat(enrolled_courses, course_info);
-        }
-    }
-    
-    // Release read lock
-    pthread_mutex_unlock(&student_mutex);
-    
-    // Send enrolled courses to client
-    write(client_socket, enrolled_courses, strlen(enrolled_courses));
-    
-    if (student.course_count == 0) {
-        return;
-    }
-    
-    // Ask for course to unenroll
-    write(client_socket, "Enter course name to unenroll: ", strlen("Enter course name to unenroll: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(course_name, buffer);
-    
-    // Acquire write lock for unenrollment
-    pthread_mutex_lock(&course_mutex);
-    pthread_mutex_lock(&student_mutex);
-    
-    // Open students file
-    fd = open("students.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Failed to unenroll from course\n", strlen("Failed to unenroll from course\n"));
-        return;
-    }
-    
-    // Read student record again
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Student not found\n", strlen("Student not found\n"));
-        return;
-    }
-    
-    // Find and remove the course
-    int course_found = 0;
-    for (int i = 0; i < student.course_count; i++) {
-        if (strcmp(student.courses[i], course_name) == 0) {
-            course_found = 1;
-            // Shift remaining courses
-            for (int j = i; j < student.course_count - 1; j++) {
-                strcpy(student.courses[j], student.courses[j + 1]);
-            }
-            student.course_count--;
-            break;
-        }
-    }
-    
-    if (!course_found) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Course not found in your enrolled courses\n", strlen("Course not found in your enrolled courses\n"));
-        return;
-    }
-    
-    // Update student file
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    write(fd, &student, sizeof(Student));
-    close(fd);
-    
-    // Increase available seats for the course
-    int faculty_fd = open("faculty.dat", O_RDWR);
-    if (faculty_fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&student_mutex);
-        pthread_mutex_unlock(&course_mutex);
-        write(client_socket, "Warning: Failed to update course seats\n", strlen("Warning: Failed to update course seats\n"));
-        return;
-    }
-    
-    Faculty faculty;
-    int faculty_id = -1;
-    int course_index = -1;
-    
-    while (read(faculty_fd, &faculty, sizeof(Faculty)) > 0) {
-        for (int i = 0; i < faculty.course_count; i++) {
-            if (strcmp(faculty.courses[i], course_name) == 0) {
-                faculty_id = faculty.id;
-                course_index = i;
-                faculty.seats[i]++; // Increase available seats
-                break;
-            }
-        }
-        if (faculty_id != -1) break;
-    }
-    
-    if (faculty_id != -1) {
-        lseek(faculty_fd, faculty_id * sizeof(Faculty), SEEK_SET);
-        write(faculty_fd, &faculty, sizeof(Faculty));
-    }
-    
-    close(faculty_fd);
-    
-    // Release locks
-    pthread_mutex_unlock(&student_mutex);
-    pthread_mutex_unlock(&course_mutex);
-    
-    write(client_socket, "Successfully unenrolled from course\n", strlen("Successfully unenrolled from course\n"));
-}
-
-// View enrolled courses (Student function)
-void view_enrolled_courses(int client_socket, int student_id) {
-    // Acquire read lock for students file
-    pthread_mutex_lock(&student_mutex);
-    
-    // Open students file
-    int fd = open("students.dat", O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Failed to view enrolled courses\n", strlen("Failed to view enrolled courses\n"));
-        return;
-    }
-    
-    // Read student record
-    Student student;
-    lseek(fd, student_id * sizeof(Student), SEEK_SET);
-    if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-        close(fd);
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Student not found\n", strlen("Student not found\n"));
-        return;
-    }
-    
-    close(fd);
-    
-    // Release lock
-    pthread_mutex_unlock(&student_mutex);
-    
-    // Build and send course list
-    char course_list[BUFFER_SIZE];
-    strcpy(course_list, "\n=== Your Enrolled Courses ===\n");
-    
-    if (student.course_count == 0) {
-        strcat(course_list, "You are not enrolled in any courses.\n");
-    } else {
-        char count_info[50];
-        sprintf(count_info, "Total courses enrolled: %d\n\n", student.course_count);
-        strcat(course_list, count_info);
-        
-        for (int i = 0; i < student.course_count; i++) {
-            char course_info[100];
-            sprintf(course_info, "%d. %s\n", i + 1, student.courses[i]);
-            strcat(course_list, course_info);
-        }
-    }
-    
-    write(client_socket, course_list, strlen(course_list));
-}
-
-// Change password (Common function for all roles)
-void change_password(int client_socket, char *role, int id) {
-    char buffer[BUFFER_SIZE];
-    char old_password[50], new_password[50], confirm_password[50];
-    
-    // Get old password
-    write(client_socket, "Enter old password: ", strlen("Enter old password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(old_password, buffer);
-    
-    // Get new password
-    write(client_socket, "Enter new password: ", strlen("Enter new password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(new_password, buffer);
-    
-    // Confirm new password
-    write(client_socket, "Confirm new password: ", strlen("Confirm new password: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(confirm_password, buffer);
-    
-    // Check if new passwords match
-    if (strcmp(new_password, confirm_password) != 0) {
-        write(client_socket, "New passwords do not match\n", strlen("New passwords do not match\n"));
-        return;
-    }
-    
-    if (strcmp(role, "student") == 0) {
-        pthread_mutex_lock(&student_mutex);
-        
-        int fd = open("students.dat", O_RDWR);
-        if (fd == -1) {
-            perror("Error opening students file");
-            pthread_mutex_unlock(&student_mutex);
-            write(client_socket, "Failed to change password\n", strlen("Failed to change password\n"));
-            return;
-        }
-        
-        Student student;
-        lseek(fd, id * sizeof(Student), SEEK_SET);
-        if (read(fd, &student, sizeof(Student)) != sizeof(Student)) {
-            close(fd);
-            pthread_mutex_unlock(&student_mutex);
-            write(client_socket, "Student not found\n", strlen("Student not found\n"));
-            return;
-        }
-        
-        // Verify old password
-        if (strcmp(student.password, old_password) != 0) {
-            close(fd);
-            pthread_mutex_unlock(&student_mutex);
-            write(client_socket, "Incorrect old password\n", strlen("Incorrect old password\n"));
-            return;
-        }
-        
-        // Update password
-        strcpy(student.password, new_password);
-        lseek(fd, id * sizeof(Student), SEEK_SET);
-        write(fd, &student, sizeof(Student));
-        close(fd);
-        
-        pthread_mutex_unlock(&student_mutex);
-    } else if (strcmp(role, "faculty") == 0) {
-        pthread_mutex_lock(&faculty_mutex);
-        
-        int fd = open("faculty.dat", O_RDWR);
-        if (fd == -1) {
-            perror("Error opening faculty file");
-            pthread_mutex_unlock(&faculty_mutex);
-            write(client_socket, "Failed to change password\n", strlen("Failed to change password\n"));
-            return;
-        }
-        
-        Faculty faculty;
-        lseek(fd, id * sizeof(Faculty), SEEK_SET);
-        if (read(fd, &faculty, sizeof(Faculty)) != sizeof(Faculty)) {
-            close(fd);
-            pthread_mutex_unlock(&faculty_mutex);
-            write(client_socket, "Faculty not found\n", strlen("Faculty not found\n"));
-            return;
-        }
-        
-        // Verify old password
-        if (strcmp(faculty.password, old_password) != 0) {
-            close(fd);
-            pthread_mutex_unlock(&faculty_mutex);
-            write(client_socket, "Incorrect old password\n", strlen("Incorrect old password\n"));
-            return;
-        }
-        
-        // Update password
-        strcpy(faculty.password, new_password);
-        lseek(fd, id * sizeof(Faculty), SEEK_SET);
-        write(fd, &faculty, sizeof(Faculty));
-        close(fd);
-        
-        pthread_mutex_unlock(&faculty_mutex);
-    }
-    
-    write(client_socket, "Password changed successfully\n", strlen("Password changed successfully\n"));
-}
-
-// Add a new course (Faculty function)
-void add_course(int client_socket, int faculty_id) {
-    char buffer[BUFFER_SIZE];
-    char course_name[50];
-    int seats;
-
-    // Get course details
-    write(client_socket, "Enter course name: ", strlen("Enter course name: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(course_name, buffer);
-
-    // Check if course already exists
-    if (check_course_exists(course_name)) {
-        write(client_socket, "Course already exists\n", strlen("Course already exists\n"));
-        return;
-    }
-
-    write(client_socket, "Enter number of seats: ", strlen("Enter number of seats: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    seats = atoi(buffer);
-
-    if (seats <= 0 || seats > MAX_SEATS) {
-        write(client_socket, "Invalid number of seats\n", strlen("Invalid number of seats\n"));
-        return;
-    }
-
-    // Acquire lock for faculty file
-    pthread_mutex_lock(&faculty_mutex);
-
-    // Open faculty file
-    int fd = open("faculty.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Failed to add course\n", strlen("Failed to add course\n"));
-        return;
-    }
-
-    // Read faculty record
-    Faculty faculty;
-    lseek(fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    if (read(fd, &faculty, sizeof(Faculty)) != sizeof(Faculty)) {
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Faculty not found\n", strlen("Faculty not found\n"));
-        return;
-    }
-
-    // Check if faculty can add more courses
-    if (faculty.course_count >= MAX_COURSES) {
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Maximum courses limit reached\n", strlen("Maximum courses limit reached\n"));
-        return;
-    }
-
-    // Add course to faculty's course list
-    // Add course to faculty's course list
-    strcpy(faculty.courses[faculty.course_count], course_name);
-    faculty.seats[faculty.course_count] = seats; // Available seats
-    faculty.initial_seats[faculty.course_count] = seats; // Store initial seats
-    faculty.course_count++; // Increment the course count
-
-    // Update faculty file
-    lseek(fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    write(fd, &faculty, sizeof(Faculty));
-    close(fd);
-
-    // Release lock
-    pthread_mutex_unlock(&faculty_mutex);
-
-    write(client_socket, "Course added successfully\n", strlen("Course added successfully\n"));
-}
-// Remove an offered course (Faculty function)
-void remove_course(int client_socket, int faculty_id) {
-    char buffer[BUFFER_SIZE], course_list[BUFFER_SIZE];
-    char course_name[50];
-    
-    // Acquire lock for faculty file
-    pthread_mutex_lock(&faculty_mutex);
-    
-    // Open faculty file
-    int fd = open("faculty.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Failed to get offered courses\n", strlen("Failed to get offered courses\n"));
-        return;
-    }
-    
-    // Read faculty record
-    Faculty faculty;
-    lseek(fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    if (read(fd, &faculty, sizeof(Faculty)) != sizeof(Faculty)) {
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Faculty not found\n", strlen("Faculty not found\n"));
-        return;
-    }
-    
-    // Build list of offered courses
-    strcpy(course_list, "Your offered courses:\n");
-    if (faculty.course_count == 0) {
-        strcat(course_list, "No courses offered\n");
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, course_list, strlen(course_list));
-        return;
-    }
-    
-    for (int i = 0; i < faculty.course_count; i++) {
-        char course_info[100];
-        sprintf(course_info, "- %s (Seats: %d)\n", faculty.courses[i], faculty.seats[i]);
-        strcat(course_list, course_info);
-    }
-    
-    // Send course list to client
-    write(client_socket, course_list, strlen(course_list));
-    
-    // Ask for course to remove
-    write(client_socket, "Enter course name to remove: ", strlen("Enter course name to remove: "));
-    memset(buffer, 0, BUFFER_SIZE);
-    read(client_socket, buffer, BUFFER_SIZE);
-    strcpy(course_name, buffer);
-    
-    // Find and remove the course
-    int course_found = 0;
-    for (int i = 0; i < faculty.course_count; i++) {
-        if (strcmp(faculty.courses[i], course_name) == 0) {
-            course_found = 1;
-            // Shift remaining courses
-            for (int j = i; j < faculty.course_count - 1; j++) {
-                strcpy(faculty.courses[j], faculty.courses[j + 1]);
-                faculty.seats[j] = faculty.seats[j + 1];
-            }
-            faculty.course_count--;
-            break;
-        }
-    }
-    
-    if (!course_found) {
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Course not found in your offered courses\n", strlen("Course not found in your offered courses\n"));
-        return;
-    }
-    
-    // Update faculty file
-    lseek(fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    write(fd, &faculty, sizeof(Faculty));
-    close(fd);
-    
-    // Release lock
-    pthread_mutex_unlock(&faculty_mutex);
-    
-    // Now remove course from all enrolled students
-    pthread_mutex_lock(&student_mutex);
-    
-    fd = open("students.dat", O_RDWR);
-    if (fd == -1) {
-        perror("Error opening students file");
-        pthread_mutex_unlock(&student_mutex);
-        write(client_socket, "Course removed, but warning: failed to update student enrollments\n", strlen("Course removed, but warning: failed to update student enrollments\n"));
-        return;
-    }
-    
-    // Update all students who have this course
-    Student student;
-    int student_count = 0;
-    while (read(fd, &student, sizeof(Student)) > 0) {
-        int modified = 0;
-        for (int i = 0; i < student.course_count; i++) {
-            if (strcmp(student.courses[i], course_name) == 0) {
-                // Remove course from student
-                for (int j = i; j < student.course_count - 1; j++) {
-                    strcpy(student.courses[j], student.courses[j + 1]);
-                }
-                student.course_count--;
-                modified = 1;
-                break;
-            }
-        }
-        
-        if (modified) {
-            // Write back updated student record
-            lseek(fd, student_count * sizeof(Student), SEEK_SET);
-            write(fd, &student, sizeof(Student));
-        }
-        student_count++;
-    }
-    
-    close(fd);
-    pthread_mutex_unlock(&student_mutex);
-    
-    write(client_socket, "Course removed successfully\n", strlen("Course removed successfully\n"));
-}
-
-// View enrollments in courses (Faculty function)
-void view_enrollments(int client_socket, int faculty_id) {
-    char enrollment_list[BUFFER_SIZE];
-    
-    // Acquire read lock for faculty file
-    pthread_mutex_lock(&faculty_mutex);
-    
-    // Open faculty file
-    int fd = open("faculty.dat", O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening faculty file");
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Failed to view enrollments\n", strlen("Failed to view enrollments\n"));
-        return;
-    }
-    
-    // Read faculty record
-    Faculty faculty;
-    lseek(fd, faculty_id * sizeof(Faculty), SEEK_SET);
-    if (read(fd, &faculty, sizeof(Faculty)) != sizeof(Faculty)) {
-        close(fd);
-        pthread_mutex_unlock(&faculty_mutex);
-        write(client_socket, "Faculty not found\n", strlen("Faculty not found\n"));
-        return;
-    }
-    
-    close(fd);
-    pthread_mutex_unlock(&faculty_mutex);
-    
-    // Build enrollment list
-    strcpy(enrollment_list, "\n=== Course Enrollments ===\n");
-    
-    if (faculty.course_count == 0) {
-        strcat(enrollment_list, "You have not offered any courses.\n");
-        write(client_socket, enrollment_list, strlen(enrollment_list));
-        return;
-    }
-    
-    // For each course, show enrolled students
-    for (int i = 0; i < faculty.course_count; i++) {
-        char course_info[200];
-        int enrolled_count = faculty.initial_seats[i] - faculty.seats[i]; // Calculate enrolled students
-        sprintf(course_info, "\nCourse: %s\nEnrolled Students: %d/%d\n", faculty.courses[i], enrolled_count, faculty.initial_seats[i]); // Use initial_seats
-        strcat(enrollment_list, course_info);
-        
-        // Get list of enrolled students
-        if (enrolled_count > 0) {
-            strcat(enrollment_list, "Students enrolled:\n");
-            
-            // Acquire read lock for students file
-            pthread_mutex_lock(&student_mutex);
-            
-            fd = open("students.dat", O_RDONLY);
-            if (fd != -1) {
-                Student student;
-                while (read(fd, &student, sizeof(Student)) > 0) {
-                    for (int j = 0; j < student.course_count; j++) {
-                        if (strcmp(student.courses[j], faculty.courses[i]) == 0) {
-                            char student_info[100];
-                            sprintf(student_info, "  - %s (ID: %d)\n", student.username, student.id);
-                            strcat(enrollment_list, student_info);
-                            break;
-                        }
-                    }
-                }
-                close(fd);
-            }
-            
-            pthread_mutex_unlock(&student_mutex);
-        } else {
-            strcat(enrollment_list, "No students enrolled yet.\n");
-        }
-        
-        strcat(enrollment_list, "------------------------\n");
-    }
-    
-    write(client_socket, enrollment_list, strlen(enrollment_list));
-}
-
-// Check if a course exists (Helper function)
-int check_course_exists(char *course_name) {
-    pthread_mutex_lock(&faculty_mutex);
-    
-    int fd = open("faculty.dat", O_RDONLY);
-    if (fd == -1) {
-        pthread_mutex_unlock(&faculty_mutex);
-        return 0;
-    }
-    
-    Faculty faculty;
-    int exists = 0;
-    
-    while (read(fd, &faculty, sizeof(Faculty)) > 0) {
-        for (int i = 0; i < faculty.course_count; i++) {
-            if (strcmp(faculty.courses[i], course_name) == 0) {
-                exists = 1;
-                break;
-            }
-        }
-        if (exists) break;
-    }
-    
-    close(fd);
-    pthread_mutex_unlock(&faculty_mutex);
-    
-    return exists;
-}
\ No newline at end of file
+/**
+ * Server implementation for Academia Portal
+ * Course Registration System
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <limits.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include "protocol.h"
+#include "records.h"
+
+#define PORT 8080
+#define LISTEN_BACKLOG 4096     // Connections waiting for accept(); capped by net.core.somaxconn
+#define BUFFER_SIZE 1024
+#define MAX_SEATS 100
+#define MAX_PENDING_INPUT 65536 // Unterminated input allowed per session before it is dropped
+#define MAX_EVENTS 256          // epoll_wait batch size
+#define DEFAULT_REACTORS 4
+#define DEFAULT_WORKERS 8
+#define DEFAULT_QUEUE_DEPTH 1024
+#define DEFAULT_STACK_KB 256
+#define DEFAULT_MAX_SESSIONS 1024
+#define SESSION_RETRY_MS 1000   // Retry hint when thread mode is at its session limit
+#define TABLE_CHUNK_RECORDS 256 // Records per allocation in memory storage
+#define TABLE_MAX_CHUNKS 4096   // Chunk directory size, so records never move once loaded
+#define MAX_PENDING_OUTPUT 262144 // Buffered replies before a session stops running requests
+#define INDEX_MIN_CAPACITY 64   // Initial slots of a name index
+#define SNAPSHOT_CHUNK 1024     // Records per block of versions kept for an export
+#define EXPORT_CHUNK_BYTES 65536 // Rows per export frame, roughly
+#define MAX_WAITLISTS 8         // Course waitlists a student can be on at once
+
+#define RECORD_STRIPES 64      // Record locks per table; record id uses stripe id % RECORD_STRIPES
+#define SEAT_FLUSH_MS 10        // How often changed seat counts are written to courses.dat
+#define DEFAULT_CHECKPOINT_SEC 60
+#define METRIC_OPS (OP_BATCH + 1)   // Requests are counted by opcode
+#define METRIC_BUCKETS 16           // Request latency histogram buckets, not counting +Inf
+#define LOCK_PROFILE_SLOTS 512      // (function, mutex) pairs the lock profiler can tell apart
+#define LOCK_PROFILE_DEPTH 16       // Mutexes a thread can hold at once and still have timed
+#define TRACE_RING_SPANS 16384      // Spans kept per thread for --trace; older ones are overwritten
+
+// Every mutex is taken through these, so the lock profiler can charge the
+// wait and hold times to the function that took it
+#define mutex_lock(mutex) profile_lock(mutex, __func__, #mutex)
+#define mutex_unlock(mutex) profile_unlock(mutex)
+#define mutex_wait(cond, mutex) profile_wait(cond, mutex)
+
+// Structures (the record types are in records.h)
+
+// Result of a storage operation; the session layer turns it into a reply.
+// Values are the binary protocol status codes.
+typedef enum {
+    STATUS_OK = PROTO_OK,
+    STATUS_ERROR = PROTO_ERROR,                     // Data file could not be opened
+    STATUS_NOT_FOUND = PROTO_NOT_FOUND,             // No student/faculty record with that ID
+    STATUS_EXISTS = PROTO_EXISTS,                   // Already enrolled / course already offered
+    STATUS_UNAVAILABLE = PROTO_UNAVAILABLE,         // Course not found or no seats available
+    STATUS_NOT_ENROLLED = PROTO_NOT_ENROLLED,       // Course not in the user's course list
+    STATUS_WRONG_PASSWORD = PROTO_WRONG_PASSWORD,
+    STATUS_LIMIT = PROTO_LIMIT,                     // MAX_COURSES reached
+    STATUS_INVALID = PROTO_INVALID                  // Empty or overlong field in an imported row
+} Status;
+
+// A course as listed by list_available_courses, list_offered_courses and
+// view_enrolled_courses
+typedef struct {
+    char name[50];
+    int seats;              // Available seats
+    int capacity;
+} CourseInfo;
+
+// A student enrolled in one of a faculty's courses, as listed by view_enrollments
+typedef struct {
+    int course;             // Index into the faculty's course list
+    int id;
+    char username[50];
+} RosterEntry;
+
+// A course waitlist a student is on, as listed by view_waitlists
+typedef struct {
+    char name[50];
+    int position;           // 1 at the head of the waitlist, 0 once given a seat
+} WaitlistInfo;
+
+// One row of a bulk import (import_users): the user to add, then its ID or
+// why it was rejected
+typedef struct {
+    char username[50];
+    char password[50];
+    Status status;          // Set by the parser for malformed rows, then by the import
+    int id;
+} ImportRow;
+
+// One row of the enrollment export: a student, one of their courses and the
+// course's faculty
+typedef struct {
+    int student_id;
+    char student[50];
+    int course_id;
+    char course[50];
+    int faculty_id;         // -1 while the course is being removed
+    char faculty[50];
+} EnrollmentRow;
+
+// An enrollment export in progress (export_enrollments_begin); students are
+// read one at a time from the snapshot taken when it began
+typedef struct {
+    int next;               // Next student ID
+    int count;              // Students in the snapshot
+    int format;             // Binary protocol: PROTO_EXPORT_CSV or PROTO_EXPORT_RECORDS
+} EnrollmentExport;
+
+// Growable byte buffer used for session input/output
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// Each step of the login sequence and of every menu sub-prompt is a state,
+// so a session can be parked between messages without holding a thread
+typedef enum {
+    STATE_ROLE,
+    STATE_USERNAME,
+    STATE_PASSWORD,
+    STATE_MENU,
+    STATE_ADD_STUDENT_USERNAME,
+    STATE_ADD_STUDENT_PASSWORD,
+    STATE_ADD_FACULTY_USERNAME,
+    STATE_ADD_FACULTY_PASSWORD,
+    STATE_TOGGLE_ID,
+    STATE_UPDATE_CHOICE,
+    STATE_UPDATE_ID,
+    STATE_UPDATE_USERNAME,
+    STATE_UPDATE_PASSWORD,
+    STATE_ENROLL_COURSE,
+    STATE_UNENROLL_COURSE,
+    STATE_JOIN_WAITLIST,
+    STATE_LEAVE_WAITLIST,
+    STATE_OLD_PASSWORD,
+    STATE_NEW_PASSWORD,
+    STATE_CONFIRM_PASSWORD,
+    STATE_ADD_COURSE_NAME,
+    STATE_ADD_COURSE_SEATS,
+    STATE_REMOVE_COURSE_NAME,
+    STATE_CLOSED
+} SessionState;
+
+typedef struct Reactor Reactor;
+
+typedef struct Session {
+    int fd;
+    SessionState state;
+    char role[10];
+    int user_id;
+    int choice;             // Role choice during login, target role during update
+    int target_id;          // Record being updated/toggled by the admin
+    char field1[50];        // Values collected by earlier sub-prompts
+    char field2[50];
+    uint32_t events;        // Current epoll interest set (reactor mode)
+    int eof;                // Peer finished sending (reactor mode)
+    int busy;               // Owned by a worker thread until the job completes
+    int binary;             // Client switched to the framed binary protocol
+    EnrollmentExport *export;   // EXPORT_ENROLLMENTS still sending chunks
+    Reactor *reactor;
+    struct Session *next;   // Link in the reactor's completion list
+    Buffer in;
+    Buffer out;
+} Session;
+
+typedef enum {
+    MODE_THREADS,           // One detached thread per connection
+    MODE_EPOLL,             // Fixed set of epoll reactor threads
+    MODE_REUSEPORT          // One SO_REUSEPORT listener and pinned reactor per core
+} ServerMode;
+
+typedef enum {
+    STORAGE_FILE,           // pread/pwrite on the data file for every access
+    STORAGE_MEMORY,         // Records loaded at startup, changes written through
+    STORAGE_MMAP            // Data files mapped into memory, records accessed in place
+} StorageMode;
+
+typedef enum {
+    PERSIST_SYNC,           // Memory storage writes a change before the operation returns
+    PERSIST_ASYNC           // A background thread writes changed records
+} PersistMode;
+
+typedef enum {
+    MSYNC_NONE,             // Mmap storage leaves writeback to the kernel
+    MSYNC_ASYNC,            // Schedule writeback of a changed record's pages
+    MSYNC_SYNC              // Wait for a changed record to reach the disk
+} MsyncPolicy;
+
+typedef enum {
+    ENROLL_CAS,             // Reserve seats with compare-and-swap
+    ENROLL_COMBINE          // Queue enrollments per course; one thread applies them in order
+} EnrollMode;
+
+typedef enum {
+    WAL_OFF,                // No log; data files are written as --persist says
+    WAL_NONE,               // Log every operation, leave syncing the log to the kernel
+    WAL_OP,                 // Sync the log once per operation
+    WAL_GROUP               // Sync the log once per group of operations (group commit)
+} WalPolicy;
+
+typedef struct {
+    ServerMode mode;
+    StorageMode storage;
+    PersistMode persist;
+    MsyncPolicy msync;
+    EnrollMode enroll;
+    WalPolicy wal;
+    int wal_window;         // Group commit: microseconds to gather operations before a sync
+    int checkpoint;         // Seconds between log checkpoints, 0 for none
+    int reactors;           // 0 picks the mode's default
+    int workers;            // Storage worker threads in reactor modes, 0 runs inline
+    int queue_depth;        // Pending storage jobs before clients are told to retry
+    size_t stack_size;      // Stack size of every server thread
+    int max_sessions;       // Concurrent connections in thread mode
+    int metrics_port;       // Local port of the metrics endpoint, 0 for none
+    int lock_profile;       // Time mutex waits and holds per function; SIGUSR1 prints them
+    int trace;              // Seconds of request spans a trace dump covers, 0 for no tracing
+} ServerConfig;
+
+struct Reactor {
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;            // eventfd signalled when a worker finishes a job
+    int cpu;                // CPU the reactor is pinned to, -1 if unpinned
+    pthread_t thread;
+    pthread_mutex_t done_lock;
+    Session *done;          // Sessions handed back by workers
+};
+
+// Bounded queue of sessions waiting for a storage worker
+typedef struct {
+    Session **jobs;
+    int capacity;
+    int head;
+    int count;
+    int threads;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    long avg_job_ns;        // Moving average of job run time, for retry hints
+} WorkerPool;
+
+// A table as it was when an export began (copy-before-write). While it is
+// active, a record about to change for the first time leaves its old version
+// here, unless the export has already read past it.
+typedef struct {
+    int active;             // Set and cleared under the table's write lock
+    int count;              // Records when the snapshot was taken
+    int cursor;             // The export no longer needs records below this
+    char ***saved;          // Old versions by ID, in blocks of SNAPSHOT_CHUNK
+    int failed;             // A version could not be kept; the export fails
+    pthread_mutex_t lock;   // Guards saved, cursor and failed
+} TableSnapshot;
+
+// A data file of fixed-size records addressed by ID (record i is at offset
+// base + i * record_size, after the file header). With memory storage the records are kept in chunks that
+// never move; with mmap storage in one mapping sized for the largest table,
+// so it never moves either. Writers hold the lock, readers copy a record
+// without it and retry if a write to the same stripe overlapped (a seqlock).
+typedef struct {
+    const char *path;
+    size_t record_size;
+    off_t base;             // Size of the file header
+    int fd;
+    atomic_int count;
+    char *chunks[TABLE_MAX_CHUNKS];
+    char *dirty;            // Async persistence: record is queued for the writer
+    int dirty_cap;
+    char *map;              // Mmap storage: the mapped data file
+    int map_records;        // Records the mapping can hold
+    pthread_rwlock_t lock;  // Exclusive for changes and the async writer's copy; shared for msync
+                            // and for file storage writes
+    atomic_uint seq[RECORD_STRIPES];    // Seqlock per stripe of record IDs
+    TableSnapshot snapshot;
+} Table;
+
+typedef struct {
+    Table *table;
+    int id;
+} DirtyRecord;
+
+// Records waiting for the background writer (async persistence)
+typedef struct {
+    DirtyRecord *items;
+    int capacity;
+    int head;
+    int count;
+    long queued;            // Records ever queued
+    long written;           // Of those, records the writer has stored (in queue order)
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t advanced;    // written moved on
+} PersistQueue;
+
+// Write-ahead log entry (--wal): the records one operation changed, each a
+// WalRecord followed by the record as stored in its data file
+typedef struct {
+    uint32_t length;        // Bytes after this header
+    uint32_t checksum;      // FNV-1a of those bytes, then of lsn
+    uint64_t lsn;           // Log sequence number, one more than the previous entry's
+} WalEntry;
+
+typedef struct {
+    uint32_t table;         // Index into wal_tables
+    uint32_t id;
+} WalRecord;
+
+// A record changed by an operation in progress; its new version is at
+// offset in the operation's entry
+typedef struct {
+    Table *table;
+    int id;
+    size_t offset;
+} WalChange;
+
+// An operation in progress with the log enabled. Its changes are held here,
+// where only its own reads see them, until wal_commit() logs them as one
+// entry and then stores them.
+typedef struct {
+    Buffer entry;
+    WalChange *changes;
+    int count;
+    int capacity;
+} WalTxn;
+
+// The log file and the entries waiting to be written to it
+typedef struct {
+    int fd;
+    Buffer pending;         // Entries the log writer has yet to write
+    uint64_t appended;      // LSN of the last committed entry
+    uint64_t done;          // Entries up to here are written (--wal none) or synced
+    atomic_int storing;     // Commits logged whose changes are not stored yet
+    int writing;            // The log writer is writing a batch outside the lock
+    int failed;             // Writing or syncing the log failed
+    uint64_t rotated;       // LSN of the last entry moved to wal.old
+    int old_log;            // wal.old is still needed: its checkpoint has not finished
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // Entries are pending
+    pthread_cond_t advanced;    // done moved on, or the writer finished a batch
+    pthread_mutex_t checkpoint; // One checkpoint at a time
+} WriteAheadLog;
+
+// Student IDs of a roster. A full array is replaced by a larger one and kept
+// on the retired list, since a reader may still be copying it.
+typedef struct RosterIds {
+    int capacity;
+    struct RosterIds *retired;
+    int ids[];
+} RosterIds;
+
+// Students enrolled in a course, sorted by ID, and the students waiting for a
+// seat, oldest first. Changed under the course's record lock; roster_copy()
+// and waitlist_position() read them without the lock through seq.
+typedef struct {
+    RosterIds *array;
+    int count;
+    RosterIds *waiting;     // Waitlist, waiting_count IDs from waiting_head
+    int waiting_head;
+    int waiting_count;
+    atomic_uint seq;
+} CourseRoster;
+
+// Waitlists of one student and the courses they got a seat in from one since
+// they last looked. Guarded by the student's record lock; kept in memory only.
+typedef struct {
+    int waiting[MAX_WAITLISTS];     // Course IDs, in the order joined
+    int waiting_count;
+    int promoted[MAX_WAITLISTS];    // Course IDs, until view_waitlists reports them
+    int promoted_count;
+} StudentWaits;
+
+// Slot of a name index. A course name maps to its course ID and its enrolled
+// students, a username to the user's ID.
+typedef struct {
+    char name[50];
+    uint32_t hash;
+    int id;                 // -1 marks a free slot
+    CourseRoster *roster;   // Courses only; allocated when the name is interned
+} IndexEntry;
+
+// Hash table from a name to record IDs (open addressing, linear probing)
+typedef struct {
+    IndexEntry *entries;
+    int capacity;           // Power of two
+    int count;
+} NameIndex;
+
+// One stripe of a table's record locks, padded to its own cache line
+typedef struct {
+    pthread_mutex_t mutex;
+} __attribute__((aligned(64))) RecordLock;
+
+#define RECORD_LOCKS_INITIALIZER { [0 ... RECORD_STRIPES - 1] = { PTHREAD_MUTEX_INITIALIZER } }
+
+// Lock the stripe guarding record id of a table. Macros, so the lock
+// profiler sees the caller.
+#define record_lock(locks, id) mutex_lock(&(locks)[(unsigned)(id) % RECORD_STRIPES].mutex)
+#define record_unlock(locks, id) mutex_unlock(&(locks)[(unsigned)(id) % RECORD_STRIPES].mutex)
+
+// An enrollment waiting in its course's combining queue
+typedef struct CombineRequest {
+    int student_id;
+    int seats_left;
+    Status status;
+    uint64_t lsn;           // Log entry of the enrollment
+    uint64_t promoted;      // Last waitlist promotion after a failed enrollment
+    atomic_int done;        // Set by the combiner once status is filled in
+    struct CombineRequest *next;
+} CombineRequest;
+
+// Live seat count of a course, changed with compare-and-swap. Adding or
+// removing the course starts a new generation, which voids seats reserved
+// from the old one. The seat writer copies the count to the course record.
+typedef struct {
+    _Atomic uint64_t seats;     // Generation << 32 | free seats
+    atomic_int dirty;           // Course record is behind the count
+    _Atomic(CombineRequest *) queue;    // Waiting enrollments, newest first
+} __attribute__((aligned(64))) SeatCounter;
+
+// Global mutexes whose waits are counted in the metrics
+typedef enum {
+    LOCK_COURSE,
+    LOCK_STUDENT,
+    LOCK_FACULTY,
+    LOCK_COUNT
+} GlobalLock;
+
+// What a trace span times
+typedef enum {
+    TRACE_REQUEST,          // One request, from reading it to queueing its reply
+    TRACE_READ,             // A read from a client socket
+    TRACE_LOCK,             // Waiting for a mutex another thread held
+    TRACE_FILE,             // A data file or log system call, or waiting for the log
+    TRACE_WRITE,            // A write to a client socket
+    TRACE_KINDS
+} TraceKind;
+
+// A timed span in a thread's trace ring. name and detail point to static
+// strings.
+typedef struct {
+    long start_ns;
+    long end_ns;
+    const char *name;       // Operation, mutex or system call
+    const char *detail;     // Function waiting for a mutex, or the file of a system call
+    int session;            // Client socket, -1 outside a request
+    int value;              // Requests: 1 if answered OK; reads and writes: bytes
+    int kind;
+} TraceSpan;
+
+// Metrics recorded by one thread. Only the owning thread writes them, with
+// relaxed loads and stores, so recording takes no lock and no locked
+// instruction; a scrape adds up the blocks of all threads. A block outlives
+// its thread and is taken over by the next thread that starts recording.
+typedef struct ThreadMetrics {
+    atomic_long requests[METRIC_OPS];
+    atomic_long errors[METRIC_OPS];
+    atomic_long duration_ns[METRIC_OPS];
+    atomic_long buckets[METRIC_OPS][METRIC_BUCKETS];
+    atomic_long lock_acquired[LOCK_COUNT];
+    atomic_long lock_contended[LOCK_COUNT];
+    atomic_long lock_wait_ns[LOCK_COUNT];
+    _Atomic(TraceSpan *) trace;     // Ring of the last TRACE_RING_SPANS spans, with --trace
+    atomic_ulong trace_head;        // Spans ever added; the next goes to trace_head % TRACE_RING_SPANS
+    int id;                         // Thread number in trace dumps
+    atomic_int in_use;
+    struct ThreadMetrics *next;
+} ThreadMetrics;
+
+// Lock profiler totals for one function taking one mutex. A slot is
+// claimed under lock_profile_insert and never freed; function is stored
+// last, so a slot with a function is ready to read.
+typedef struct {
+    _Atomic(const char *) function;
+    const char *lock;
+    atomic_long acquired;
+    atomic_long contended;      // Acquisitions that had to wait
+    atomic_long wait_ns;
+    atomic_long hold_ns;
+    atomic_long max_hold_ns;
+} LockProfile;
+
+// A mutex the calling thread holds, and the profile its hold time goes to
+typedef struct {
+    pthread_mutex_t *mutex;
+    LockProfile *profile;
+    long since;
+} HeldLock;
+
+// Global variables
+//
+// Lock order: course_mutex, student_mutex, faculty_mutex, then one course
+// record lock, one student record lock, one faculty record lock. Index and
+// table locks are innermost and never held across another lock. Read-only
+// operations take none of these: records and rosters are read through
+// seqlocks (table_read, roster_copy), so readers never hold up writers.
+pthread_mutex_t student_mutex = PTHREAD_MUTEX_INITIALIZER;  // Adding and renaming students
+pthread_mutex_t faculty_mutex = PTHREAD_MUTEX_INITIALIZER;  // Adding and renaming faculty
+pthread_mutex_t course_mutex = PTHREAD_MUTEX_INITIALIZER;   // Adding courses
+RecordLock course_locks[RECORD_STRIPES] = RECORD_LOCKS_INITIALIZER;  // Seats and roster
+RecordLock student_locks[RECORD_STRIPES] = RECORD_LOCKS_INITIALIZER;
+RecordLock faculty_locks[RECORD_STRIPES] = RECORD_LOCKS_INITIALIZER;
+ServerConfig config = {
+    MODE_THREADS, STORAGE_MEMORY, PERSIST_SYNC, MSYNC_NONE, ENROLL_CAS, WAL_OFF, 0, DEFAULT_CHECKPOINT_SEC, 0,
+    DEFAULT_WORKERS, DEFAULT_QUEUE_DEPTH, DEFAULT_STACK_KB * 1024, DEFAULT_MAX_SESSIONS, 0, 0, 0
+};
+Table student_table, faculty_table, admin_table, course_table;
+NameIndex course_index;     // Interned course names, guarded by course_index_lock
+pthread_rwlock_t course_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+SeatCounter *seat_chunks[TABLE_MAX_CHUNKS]; // By course ID, TABLE_CHUNK_RECORDS per chunk
+atomic_int seat_courses = 0;    // Courses with a seat counter
+_Atomic(StudentWaits **) wait_chunks[TABLE_MAX_CHUNKS]; // By student ID, allocated on first use
+NameIndex student_names, faculty_names; // Username -> ID, guarded by names_lock
+pthread_rwlock_t names_lock = PTHREAD_RWLOCK_INITIALIZER;
+PersistQueue persist = {
+    .lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER, .advanced = PTHREAD_COND_INITIALIZER
+};
+WriteAheadLog wal = {
+    .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER, .advanced = PTHREAD_COND_INITIALIZER,
+    .checkpoint = PTHREAD_MUTEX_INITIALIZER
+};
+Table *wal_tables[] = { &admin_table, &student_table, &faculty_table, &course_table };
+__thread WalTxn *wal_txn;   // Operation in progress on this thread, if logging
+WorkerPool pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER };
+atomic_int active_sessions = 0;
+atomic_int export_running = 0;  // One export at a time owns the table snapshots
+atomic_long sessions_opened = 0, sessions_closed = 0;
+_Atomic(ThreadMetrics *) metrics_blocks;    // Every thread's metrics, newest first
+pthread_key_t metrics_key;                  // Releases a thread's block when it exits
+__thread ThreadMetrics *thread_metrics;
+atomic_int metrics_threads;                 // Blocks allocated so far
+__thread int trace_session = -1;            // Client socket of the request this thread is running
+const char *trace_kinds[TRACE_KINDS] = { "request", "socket read", "lock wait", "file I/O", "socket write" };
+const char *metric_op_names[METRIC_OPS] = {
+    [OP_LOGIN] = "login", [OP_LOGOUT] = "logout",
+    [OP_ADD_STUDENT] = "add_student", [OP_ADD_FACULTY] = "add_faculty", [OP_TOGGLE_STUDENT] = "toggle_student",
+    [OP_UPDATE_DETAILS] = "update_details", [OP_IMPORT_USERS] = "import_users",
+    [OP_EXPORT_ENROLLMENTS] = "export_enrollments", [OP_DUMP_TRACE] = "dump_trace",
+    [OP_LIST_COURSES] = "list_courses", [OP_ENROLL] = "enroll", [OP_UNENROLL] = "unenroll",
+    [OP_VIEW_ENROLLED] = "view_enrolled", [OP_CHANGE_PASSWORD] = "change_password",
+    [OP_JOIN_WAITLIST] = "join_waitlist", [OP_LEAVE_WAITLIST] = "leave_waitlist",
+    [OP_VIEW_WAITLISTS] = "view_waitlists",
+    [OP_ADD_COURSE] = "add_course", [OP_REMOVE_COURSE] = "remove_course",
+    [OP_VIEW_ENROLLMENTS] = "view_enrollments", [OP_BATCH] = "batch"
+};
+const long metric_bounds_ns[METRIC_BUCKETS] = {
+    10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+    25000000, 50000000, 100000000, 250000000, 500000000, 1000000000
+};
+const char *lock_names[LOCK_COUNT] = { "course", "student", "faculty" };
+LockProfile lock_profiles[LOCK_PROFILE_SLOTS];
+pthread_mutex_t lock_profile_insert = PTHREAD_MUTEX_INITIALIZER;
+__thread HeldLock held_locks[LOCK_PROFILE_DEPTH];
+__thread int held_count;
+
+// Function declarations
+void *handle_client(void *arg);
+void session_start(Session *s);
+void session_feed(Session *s, const char *data, size_t len);
+int session_process(Session *s, int run_storage);
+uint16_t session_text_op(Session *s, const char *msg);
+void session_handle(Session *s, char *msg);
+void binary_handle(Session *s, uint16_t opcode, ProtoReader *req);
+void session_end_export(Session *s);
+void admin_menu(Session *s, int choice);
+void student_menu(Session *s, int choice);
+void faculty_menu(Session *s, int choice);
+int table_open(Table *t, const char *path, size_t record_size);
+int table_grow(Table *t, int id);
+int table_count(Table *t);
+void seq_write_begin(atomic_uint *seq);
+void seq_write_end(atomic_uint *seq);
+unsigned seq_read_begin(atomic_uint *seq);
+int seq_read_retry(atomic_uint *seq, unsigned start);
+void seq_load(void *dest, const void *shared, size_t size);
+void seq_store(void *shared, const void *src, size_t size);
+void table_store(Table *t, int id, const void *record);
+Status table_sync(Table *t, int id, int count);
+Status table_read(Table *t, int id, void *record);
+Status table_write(Table *t, int id, const void *record);
+Status table_put(Table *t, int id, const void *record);
+Status table_restore(Table *t, int id, const void *record);
+Status table_append(Table *t, const void *record);
+Status table_append_many(Table *t, const void *records, int count);
+void table_write_back(Table *t);
+void snapshot_keep(Table *t, int id);
+Status snapshot_read(Table *t, int id, void *record);
+void snapshot_free_block(TableSnapshot *snap, int block);
+void snapshot_advance(Table *t, int cursor);
+int snapshot_begin();
+void snapshot_end();
+void persist_enqueue(Table *t, int id);
+void *persist_run(void *arg);
+void persist_drain();
+void storage_flush();
+uint32_t wal_checksum(uint32_t hash, const void *data, size_t len);
+void wal_begin(WalTxn *txn);
+int wal_find(Table *t, int id);
+Status wal_stash(Table *t, int id, const void *record);
+Status wal_add(Table *t, int id, const void *record);
+uint64_t wal_commit();
+uint64_t wal_appended();
+void wal_sync(uint64_t lsn);
+Status wal_wait(uint64_t lsn);
+Status wal_durable(Status status, uint64_t lsn);
+void *wal_run(void *arg);
+int wal_replay(const char *path, const char *data, size_t size, uint64_t *last);
+int wal_replay_file(const char *path, uint64_t *last);
+int wal_open();
+int sync_directory();
+int wal_rotate();
+void wal_checkpoint();
+void *checkpoint_run(void *arg);
+IndexEntry *index_find(NameIndex *idx, const char *name);
+int index_insert(NameIndex *idx, const char *name, int id);
+int index_reserve(NameIndex *idx, int count);
+void index_remove(NameIndex *idx, const char *name);
+int roster_reserve(CourseRoster *r, int capacity);
+int roster_add(CourseRoster *r, int student_id);
+void roster_remove(CourseRoster *r, int student_id);
+int roster_copy(CourseRoster *r, int **ids, int *capacity);
+int waitlist_add(CourseRoster *r, int student_id);
+int waitlist_pop(CourseRoster *r);
+int waitlist_remove(CourseRoster *r, int student_id);
+int waitlist_length(CourseRoster *r);
+int waitlist_position(CourseRoster *r, int student_id);
+StudentWaits *student_waits(int student_id, int create);
+void student_waits_drop(StudentWaits *w, int course_id);
+void waitlist_promote(int course_id, CourseRoster *roster, int held, uint64_t *lsn);
+void waitlist_clear(int course_id, CourseRoster *roster);
+int course_lookup(const char *name, CourseRoster **roster);
+int course_intern(const char *name, int id, int seats);
+SeatCounter *seat_counter(int id);
+int seat_set(int id, int seats);
+int seat_count(int id);
+uint32_t seat_generation(int id);
+int seat_reserve(int id, uint32_t *generation);
+void seat_release(int id, uint32_t generation);
+Status seat_store(int id);
+void seat_flush();
+void *seat_writer_run(void *arg);
+int course_index_build();
+int user_lookup(NameIndex *idx, const char *username);
+int user_rename(NameIndex *idx, const char *old_name, const char *new_name, int id);
+int user_add_rows(NameIndex *idx, const ImportRow *rows, int count);
+int user_index_build();
+void *user_index_run(void *arg);
+int record_trylock(RecordLock *locks, int id);
+RecordLock *role_locks(const char *role);
+int authenticate_user(char *username, char *password, char *role);
+Status add_student(const char *username, const char *password, int *student_id);
+Status add_faculty(const char *username, const char *password, int *faculty_id);
+Status import_users(const char *role, ImportRow *rows, int count, int *first_id, int *added);
+Status toggle_student_status(int student_id, int *active);
+Status update_details(char *role, int id, const char *username, const char *password);
+Status read_student(int student_id, Student *student);
+Status read_faculty(int faculty_id, Faculty *faculty);
+Status list_available_courses(CourseInfo **courses, int *count);
+Status list_offered_courses(int faculty_id, CourseInfo **courses, int *count);
+Status enroll_course(int student_id, const char *course_name, int *seats_left);
+Status unenroll_course(int student_id, const char *course_name);
+Status view_enrolled_courses(int student_id, CourseInfo **courses, int *count);
+Status join_waitlist(int student_id, const char *course_name, int *position);
+Status leave_waitlist(int student_id, const char *course_name);
+Status view_waitlists(int student_id, WaitlistInfo **waits, int *count);
+Status change_password(char *role, int id, const char *old_password, const char *new_password);
+Status add_course(int faculty_id, const char *course_name, int seats);
+Status remove_course(int faculty_id, const char *course_name);
+Status view_enrollments(int faculty_id, CourseInfo **courses, int *course_count, RosterEntry **roster, int *count);
+Status export_enrollments_begin(EnrollmentExport *e);
+Status export_enrollments_next(EnrollmentExport *e, EnrollmentRow *rows, int *count);
+void export_enrollments_end(EnrollmentExport *e);
+int check_course_exists(const char *course_name);
+Status add_student_locked(const char *username, const char *password, int *student_id);
+Status add_faculty_locked(const char *username, const char *password, int *faculty_id);
+Status import_users_locked(const char *role, ImportRow *rows, int count, int *first_id, int *added);
+Status toggle_student_status_locked(int student_id, int *active);
+Status update_details_locked(char *role, int id, const char *username, const char *password);
+Status enroll_check(const Student *student, int course_id);
+Status enroll_course_locked(int student_id, int course_id, CourseRoster *roster, uint32_t generation);
+Status enroll_combined(int student_id, int course_id, CourseRoster *roster, int *seats_left);
+void combine_run(int course_id, CourseRoster *roster);
+Status unenroll_course_locked(int student_id, int course_id, CourseRoster *roster);
+Status join_waitlist_locked(int student_id, int course_id, CourseRoster *roster, int *position, uint64_t *lsn);
+Status leave_waitlist_locked(int student_id, int course_id, CourseRoster *roster);
+Status change_password_locked(char *role, int id, const char *old_password, const char *new_password);
+Status add_course_locked(int faculty_id, const char *name, int course_id, int seats);
+Status remove_course_locked(int faculty_id, int course_id);
+Status remove_course_students(int course_id, CourseRoster *roster, uint64_t *lsn);
+void initialize_files();
+long now_ns();
+void metrics_release(void *block);
+ThreadMetrics *metrics_thread();
+long metrics_now();
+void metrics_request(uint16_t opcode, long start, int ok);
+void profile_lock(pthread_mutex_t *mutex, const char *function, const char *expression);
+void profile_unlock(pthread_mutex_t *mutex);
+void profile_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+void lock_profile_report(FILE *out);
+long trace_now();
+void trace_span(TraceKind kind, const char *name, const char *detail, int session, long start, int value);
+int trace_dump(long seconds, char *path, size_t size);
+void start_metrics();
+void start_signals();
+int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg);
+int create_listener();
+void run_reactors(int server_fd);
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--mode threads|epoll|reuseport] [--reactors N] [--workers N]\n"
+            "          [--queue-depth N] [--stack-size KB] [--max-sessions N]\n"
+            "          [--storage file|memory|mmap] [--persist sync|async] [--msync none|async|sync]\n"
+            "          [--enroll cas|combine] [--wal none|op|USEC] [--checkpoint SEC] [--metrics PORT]\n"
+            "          [--lock-profile] [--trace SEC]\n"
+            "  --mode      threads:   one thread per connection (default)\n"
+            "              epoll:     fixed set of event loop threads sharing one listener\n"
+            "              reuseport: one SO_REUSEPORT listener and pinned event loop per core\n"
+            "  --reactors  number of event loop threads (default %d for epoll, one per core for reuseport)\n"
+            "  --workers   storage worker threads in epoll/reuseport mode, 0 runs them on the reactors (default %d)\n"
+            "  --queue-depth  storage requests queued before clients get \"server busy\" (default %d)\n"
+            "  --stack-size   stack size of server threads in KB (default %d)\n"
+            "  --max-sessions concurrent connections in thread mode (default %d)\n"
+            "  --storage   file:   read and write the data files on every access\n"
+            "              memory: load the data files at startup and serve reads from memory (default)\n"
+            "              mmap:   map the data files and access records in place\n"
+            "  --persist   sync:   memory storage writes each change before replying (default)\n"
+            "              async:  a background thread writes changes to the data files\n"
+            "  --msync     none:   mmap storage leaves writeback to the kernel (default)\n"
+            "              async:  start writeback of each change before replying\n"
+            "              sync:   wait until each change is on disk before replying\n"
+            "  --enroll    cas:     reserve seats with compare-and-swap (default)\n"
+            "              combine: queue enrollments per course; one thread applies them in arrival order\n"
+            "  --wal       log each operation to wal.log before storing it; needs memory storage (default off)\n"
+            "              none: leave syncing the log to the kernel\n"
+            "              op:   sync the log once per operation\n"
+            "              USEC: group commit, one sync for the operations arriving within USEC microseconds\n"
+            "  --checkpoint   seconds between checkpoints, which let the log start over; 0 only\n"
+            "                 checkpoints at shutdown (default %d)\n"
+            "  --metrics   serve Prometheus metrics at http://127.0.0.1:PORT/metrics (default off)\n"
+            "  --lock-profile time mutex waits and holds per function; SIGUSR1 prints them to stderr\n"
+            "  --trace     record request spans; SIGUSR2 or an admin DUMP_TRACE writes the last SEC\n"
+            "              seconds to a Chrome trace file (default off)\n",
+            prog, DEFAULT_REACTORS, DEFAULT_WORKERS, DEFAULT_QUEUE_DEPTH, DEFAULT_STACK_KB, DEFAULT_MAX_SESSIONS,
+            DEFAULT_CHECKPOINT_SEC);
+}
+
+// Parse command line options into the global config
+void parse_options(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"mode", required_argument, NULL, 'm'},
+        {"reactors", required_argument, NULL, 'r'},
+        {"workers", required_argument, NULL, 'w'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"stack-size", required_argument, NULL, 's'},
+        {"max-sessions", required_argument, NULL, 'c'},
+        {"storage", required_argument, NULL, 'S'},
+        {"persist", required_argument, NULL, 'p'},
+        {"msync", required_argument, NULL, 'y'},
+        {"enroll", required_argument, NULL, 'e'},
+        {"wal", required_argument, NULL, 'l'},
+        {"checkpoint", required_argument, NULL, 'k'},
+        {"metrics", required_argument, NULL, 'M'},
+        {"lock-profile", no_argument, NULL, 'L'},
+        {"trace", required_argument, NULL, 'T'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "m:r:w:q:s:c:S:p:y:e:l:k:M:LT:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "threads") == 0) {
+                    config.mode = MODE_THREADS;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    config.mode = MODE_EPOLL;
+                } else if (strcmp(optarg, "reuseport") == 0) {
+                    config.mode = MODE_REUSEPORT;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'r':
+                config.reactors = atoi(optarg);
+                if (config.reactors <= 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                config.workers = atoi(optarg);
+                if (config.workers < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'q':
+                config.queue_depth = atoi(optarg);
+                if (config.queue_depth <= 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                config.stack_size = (size_t)atol(optarg) * 1024;
+                if (config.stack_size < (size_t)PTHREAD_STACK_MIN) {
+                    config.stack_size = PTHREAD_STACK_MIN;
+                }
+                break;
+            case 'c':
+                config.max_sessions = atoi(optarg);
+                if (config.max_sessions <= 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                if (strcmp(optarg, "file") == 0) {
+                    config.storage = STORAGE_FILE;
+                } else if (strcmp(optarg, "memory") == 0) {
+                    config.storage = STORAGE_MEMORY;
+                } else if (strcmp(optarg, "mmap") == 0) {
+                    config.storage = STORAGE_MMAP;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'p':
+                if (strcmp(optarg, "sync") == 0) {
+                    config.persist = PERSIST_SYNC;
+                } else if (strcmp(optarg, "async") == 0) {
+                    config.persist = PERSIST_ASYNC;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'y':
+                if (strcmp(optarg, "none") == 0) {
+                    config.msync = MSYNC_NONE;
+                } else if (strcmp(optarg, "async") == 0) {
+                    config.msync = MSYNC_ASYNC;
+                } else if (strcmp(optarg, "sync") == 0) {
+                    config.msync = MSYNC_SYNC;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'e':
+                if (strcmp(optarg, "cas") == 0) {
+                    config.enroll = ENROLL_CAS;
+                } else if (strcmp(optarg, "combine") == 0) {
+                    config.enroll = ENROLL_COMBINE;
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                if (strcmp(optarg, "none") == 0) {
+                    config.wal = WAL_NONE;
+                } else if (strcmp(optarg, "op") == 0) {
+                    config.wal = WAL_OP;
+                } else if (optarg[0] >= '0' && optarg[0] <= '9') {
+                    config.wal = WAL_GROUP;
+                    config.wal_window = atoi(optarg);
+                } else {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                config.checkpoint = atoi(optarg);
+                if (config.checkpoint < 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'M':
+                config.metrics_port = atoi(optarg);
+                if (config.metrics_port <= 0 || config.metrics_port > 65535 || config.metrics_port == PORT) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'L':
+                config.lock_profile = 1;
+                break;
+            case 'T':
+                config.trace = atoi(optarg);
+                if (config.trace <= 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+}
+
+#ifndef ACADEMIA_NO_MAIN
+// Main function
+int main(int argc, char *argv[]) {
+    int server_fd, client_socket;
+    struct sockaddr_in address;
+    int addrlen = sizeof(address);
+    pthread_t thread_id;
+    pthread_attr_t attr;
+
+    parse_options(argc, argv);
+
+    // SIGINT and SIGTERM are handled by the signal thread, which starts
+    // before any other thread
+    signal(SIGPIPE, SIG_IGN);
+    start_signals();
+
+    // Thread blocks for metrics and traces pass to a new thread when theirs exits
+    pthread_key_create(&metrics_key, metrics_release);
+
+    // Initialize files if they don't exist and load the record tables
+    initialize_files();
+    start_metrics();
+
+    server_fd = create_listener();
+
+    if (config.mode != MODE_THREADS) {
+        run_reactors(server_fd);
+        close(server_fd);
+        return 0;
+    }
+
+    printf("Server started on port %d\n", PORT);
+
+    // Client threads are created detached with the configured stack size
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, config.stack_size);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    // Accept connections and create threads for each client
+    while (1) {
+        if ((client_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
+            perror("Accept failed");
+            continue;
+        }
+
+        // Refuse the connection instead of growing the thread count without bound
+        if (atomic_load(&active_sessions) >= config.max_sessions) {
+            char reply[64];
+            sprintf(reply, "Server busy, retry in %d ms\n", SESSION_RETRY_MS);
+            write(client_socket, reply, strlen(reply));
+            close(client_socket);
+            continue;
+        }
+
+        printf("New client connected\n");
+
+        // Create a new thread for the client
+        atomic_fetch_add(&active_sessions, 1);
+        if (pthread_create(&thread_id, &attr, handle_client, (void *)(intptr_t)client_socket) != 0) {
+            perror("Thread creation failed");
+            atomic_fetch_sub(&active_sessions, 1);
+            close(client_socket);
+        }
+    }
+
+    // Clean up
+    close(server_fd);
+    pthread_mutex_destroy(&student_mutex);
+    pthread_mutex_destroy(&faculty_mutex);
+    pthread_mutex_destroy(&course_mutex);
+
+    return 0;
+}
+#endif
+
+// Create, bind and listen on the server socket
+int create_listener() {
+    int server_fd;
+    struct sockaddr_in address;
+    int opt = 1;
+
+    // Create socket
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Set socket options
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("Setsockopt failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Prepare the sockaddr_in structure
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(PORT);
+
+    // Bind the socket
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Listen for connections
+    if (listen(server_fd, LISTEN_BACKLOG) < 0) {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    return server_fd;
+}
+
+// Initialize files if they don't exist
+void initialize_files() {
+    Admin admin = {"admin", "admin123"};
+    long start = now_ns();
+
+    // With the log, changes reach the data files through the background
+    // writer, which needs every record in memory
+    if (config.wal != WAL_OFF) {
+        if (config.storage != STORAGE_MEMORY) {
+            fprintf(stderr, "--wal needs --storage memory\n");
+            exit(EXIT_FAILURE);
+        }
+        config.persist = PERSIST_ASYNC;
+    }
+
+    // Open the record tables, creating missing files; memory storage loads
+    // every record here, mmap storage maps the files
+    if (table_open(&admin_table, "admin.dat", sizeof(Admin)) < 0 ||
+        table_open(&student_table, "students.dat", sizeof(Student)) < 0 ||
+        table_open(&faculty_table, "faculty.dat", sizeof(Faculty)) < 0 ||
+        table_open(&course_table, "courses.dat", sizeof(Course)) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Redo the operations logged since the last checkpoint before anything
+    // reads the records
+    if (config.wal != WAL_OFF && wal_open() < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Create the admin account on first start
+    if (table_count(&admin_table) == 0) {
+        if (table_append(&admin_table, &admin) != STATUS_OK) {
+            exit(EXIT_FAILURE);
+        }
+        printf("Admin file created and initialized\n");
+    }
+
+    // Course and username lookups go through indexes rebuilt from the
+    // records; the username indexes are built on a second thread meanwhile
+    pthread_t names;
+    int names_result = -1;
+    if (start_thread(&names, user_index_run, &names_result) != 0) {
+        perror("Thread creation failed");
+        exit(EXIT_FAILURE);
+    }
+    int courses_result = course_index_build();
+    pthread_join(names, NULL);
+    if (courses_result < 0 || names_result < 0) {
+        fprintf(stderr, "Error building indexes\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Loaded %d students, %d faculty and %d courses in %.0f ms\n", table_count(&student_table),
+           table_count(&faculty_table), table_count(&course_table), (now_ns() - start) / 1e6);
+
+    if (config.storage == STORAGE_MEMORY && config.persist == PERSIST_ASYNC) {
+        pthread_t thread;
+        if (start_thread(&thread, persist_run, NULL) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+
+    if (config.wal != WAL_OFF && config.checkpoint > 0) {
+        pthread_t checkpointer;
+        if (start_thread(&checkpointer, checkpoint_run, NULL) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(checkpointer);
+    }
+
+    // Enrollments change the seat counters; a writer stores them in the background
+    pthread_t seat_writer;
+    if (start_thread(&seat_writer, seat_writer_run, NULL) != 0) {
+        perror("Thread creation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(seat_writer);
+}
+
+// Append raw bytes to a buffer, growing it as needed
+void buffer_append(Buffer *b, const void *data, size_t len) {
+    if (b->len + len + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len + 1) {
+            cap *= 2;
+        }
+        char *grown = realloc(b->data, cap);
+        if (grown == NULL) {
+            perror("Buffer allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+}
+
+void buffer_puts(Buffer *b, const char *str) {
+    buffer_append(b, str, strlen(str));
+}
+
+void buffer_printf(Buffer *b, const char *fmt, ...) {
+    char line[BUFFER_SIZE];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        buffer_append(b, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
+
+// Drop the first len bytes of a buffer
+void buffer_consume(Buffer *b, size_t len) {
+    if (len >= b->len) {
+        b->len = 0;
+    } else {
+        memmove(b->data, b->data + len, b->len - len);
+        b->len -= len;
+    }
+    if (b->data) {
+        b->data[b->len] = '\0';
+    }
+}
+
+void buffer_free(Buffer *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+// Copy a client message into a fixed-size record field
+void copy_field(char *dest, const char *src) {
+    strncpy(dest, src, 49);
+    dest[49] = '\0';
+}
+
+// Write every byte of a buffer to a blocking socket or file
+int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Handle client connections (thread-per-connection mode)
+void *handle_client(void *arg) {
+    Session session = {0};
+    char buffer[BUFFER_SIZE];
+
+    session.fd = (int)(intptr_t)arg;
+    session_start(&session);
+
+    while (session.state != STATE_CLOSED) {
+        long start = trace_now();
+        if (write_all(session.fd, session.out.data, session.out.len) < 0) {
+            break;
+        }
+        trace_span(TRACE_WRITE, "write", NULL, session.fd, start, session.out.len);
+        buffer_consume(&session.out, session.out.len);
+
+        // Run pipelined requests that waited for the backlog to be written
+        session_process(&session, 1);
+        if (session.out.len > 0) {
+            continue;
+        }
+
+        // The span includes the wait for the client's next request
+        start = trace_now();
+        ssize_t n = read(session.fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        trace_span(TRACE_READ, "read", NULL, session.fd, start, n);
+        session_feed(&session, buffer, n);
+    }
+
+    // Deliver the final reply (e.g. "Goodbye!") before closing
+    if (session.out.len > 0) {
+        write_all(session.fd, session.out.data, session.out.len);
+    }
+
+    // Close the connection
+    close(session.fd);
+    session_end_export(&session);
+    buffer_free(&session.in);
+    buffer_free(&session.out);
+    atomic_fetch_add(&sessions_closed, 1);
+    atomic_fetch_sub(&active_sessions, 1);
+    return NULL;
+}
+
+// Queue a reply for the client
+void session_write(Session *s, const char *msg) {
+    buffer_puts(&s->out, msg);
+}
+
+// Send the welcome banner and wait for the role choice
+void session_start(Session *s) {
+    atomic_fetch_add(&sessions_opened, 1);
+    s->state = STATE_ROLE;
+    s->user_id = -1;
+    session_write(s, "Welcome to Academia Portal\n1. Admin\n2. Faculty\n3. Student\nEnter your choice: ");
+}
+
+// Split received bytes into messages and run each through the state machine.
+// Messages are terminated by '\0' (client) or '\n' (line-based tools), so
+// a read that carries several messages, or half of one, is handled correctly.
+void session_feed(Session *s, const char *data, size_t len) {
+    buffer_append(&s->in, data, len);
+    session_process(s, 1);
+}
+
+// Whether handling msg in the current state calls into storage (and may block
+// on file I/O or the data mutexes)
+int session_needs_storage(Session *s, const char *msg) {
+    switch (s->state) {
+        case STATE_MENU:
+            if (strcmp(s->role, "student") == 0) {
+                return (atoi(msg) >= 1 && atoi(msg) <= 3) || atoi(msg) == 7;
+            }
+            if (strcmp(s->role, "faculty") == 0) {
+                return atoi(msg) == 2 || atoi(msg) == 3;
+            }
+            return 0;
+        case STATE_PASSWORD:
+        case STATE_ADD_STUDENT_PASSWORD:
+        case STATE_ADD_FACULTY_PASSWORD:
+        case STATE_TOGGLE_ID:
+        case STATE_UPDATE_ID:
+        case STATE_UPDATE_PASSWORD:
+        case STATE_ENROLL_COURSE:
+        case STATE_UNENROLL_COURSE:
+        case STATE_JOIN_WAITLIST:
+        case STATE_LEAVE_WAITLIST:
+        case STATE_CONFIRM_PASSWORD:
+        case STATE_ADD_COURSE_NAME:
+        case STATE_ADD_COURSE_SEATS:
+        case STATE_REMOVE_COURSE_NAME:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Run every complete buffered message through the state machine, in order.
+// With run_storage unset, stops before the first message that needs storage
+// and returns 1; that message stays buffered for a worker thread. Also stops
+// once MAX_PENDING_OUTPUT bytes of replies are waiting to be sent.
+int session_process(Session *s, int run_storage) {
+    while (s->state != STATE_CLOSED) {
+        // Pipelined requests wait while a slow reader has replies backed up
+        if (s->out.len > MAX_PENDING_OUTPUT) {
+            break;
+        }
+
+        // A client that opens with the protocol magic instead of a role
+        // choice is switched to binary frames
+        if (s->state == STATE_ROLE && s->in.len > 0 && s->in.data[0] == PROTO_MAGIC[0]) {
+            if (s->in.len < PROTO_MAGIC_LEN) {
+                break;
+            }
+            if (memcmp(s->in.data, PROTO_MAGIC, PROTO_MAGIC_LEN) != 0) {
+                s->state = STATE_CLOSED;
+                break;
+            }
+            buffer_consume(&s->in, PROTO_MAGIC_LEN);
+            buffer_append(&s->out, PROTO_MAGIC, PROTO_MAGIC_LEN);
+            s->binary = 1;
+            s->state = STATE_MENU;
+            continue;
+        }
+
+        if (s->binary) {
+            uint16_t opcode, status;
+            uint32_t len;
+            if (s->in.len < PROTO_HEADER_SIZE) {
+                break;
+            }
+            proto_parse_header((uint8_t *)s->in.data, &opcode, &status, &len);
+            if (len > PROTO_MAX_REQUEST - PROTO_HEADER_SIZE) {
+                s->state = STATE_CLOSED;
+                break;
+            }
+            if (s->in.len < PROTO_HEADER_SIZE + len) {
+                break;
+            }
+            if (!run_storage && opcode != OP_LOGOUT) {
+                return 1;
+            }
+
+            ProtoReader req = { (uint8_t *)s->in.data + PROTO_HEADER_SIZE, len, 0 };
+            binary_handle(s, opcode, &req);
+            // An export stays queued until its last chunk is out
+            if (s->export == NULL) {
+                buffer_consume(&s->in, PROTO_HEADER_SIZE + len);
+            }
+            continue;
+        }
+
+        size_t end = 0;
+        while (end < s->in.len && s->in.data[end] != '\0' && s->in.data[end] != '\n') {
+            end++;
+        }
+        if (end == s->in.len) {
+            if (s->in.len > MAX_PENDING_INPUT) {
+                s->state = STATE_CLOSED;
+            }
+            break;
+        }
+
+        char msg[BUFFER_SIZE];
+        size_t msg_len = end < sizeof(msg) - 1 ? end : sizeof(msg) - 1;
+        memcpy(msg, s->in.data, msg_len);
+        msg[msg_len] = '\0';
+        if (msg_len > 0 && msg[msg_len - 1] == '\r') {
+            msg[msg_len - 1] = '\0';
+        }
+
+        if (!run_storage && session_needs_storage(s, msg)) {
+            return 1;
+        }
+        buffer_consume(&s->in, end + 1);
+
+        session_handle(s, msg);
+    }
+    return 0;
+}
+
+// Drop the message at the head of the input buffer
+void session_skip_message(Session *s) {
+    size_t end = 0;
+    while (end < s->in.len && s->in.data[end] != '\0' && s->in.data[end] != '\n') {
+        end++;
+    }
+    buffer_consume(&s->in, end + 1);
+}
+
+// Queue a finished response frame for the client
+void binary_send(Session *s, ProtoWriter *w) {
+    buffer_append(&s->out, w->data, w->len);
+    free(w->data);
+}
+
+// Drop the request at the head of the input buffer and tell the client to
+// send it again after retry_ms
+void session_reject_busy(Session *s, int retry_ms) {
+    if (s->binary) {
+        uint16_t opcode, status;
+        uint32_t len;
+        ProtoWriter resp = {0};
+
+        // An export between chunks ends with this frame instead
+        session_end_export(s);
+        proto_parse_header((uint8_t *)s->in.data, &opcode, &status, &len);
+        buffer_consume(&s->in, PROTO_HEADER_SIZE + len);
+        size_t frame = proto_begin_frame(&resp, opcode);
+        proto_put_u32(&resp, retry_ms);
+        proto_end_frame(&resp, frame, PROTO_BUSY);
+        binary_send(s, &resp);
+        return;
+    }
+
+    char reply[64];
+    session_skip_message(s);
+    sprintf(reply, "Server busy, retry in %d ms\n", retry_ms);
+    session_write(s, reply);
+}
+
+// Show the menu for the logged in role
+void show_menu(Session *s) {
+    if (strcmp(s->role, "admin") == 0) {
+        session_write(s, "\n===== ADMIN MENU =====\n1. Add Student\n2. Add Faculty\n3. Activate/Deactivate Student\n4. Update Student/Faculty details\n5. Exit\nEnter your choice: ");
+    } else if (strcmp(s->role, "faculty") == 0) {
+        session_write(s, "\n===== FACULTY MENU =====\n1. Add new Course\n2. Remove offered Course\n3. View enrollments in Courses\n4. Password Change\n5. Exit\nEnter your choice: ");
+    } else {
+        session_write(s, "\n===== STUDENT MENU =====\n1. Enroll to new Courses\n2. Unenroll from already enrolled Courses\n3. View enrolled Courses\n4. Password Change\n5. Exit\n6. Join a Course Waitlist\n7. Leave a Course Waitlist\nEnter your choice: ");
+    }
+    s->state = STATE_MENU;
+}
+
+// Finish a sub-prompt sequence and return to the role menu
+void finish_operation(Session *s, const char *reply) {
+    if (reply != NULL) {
+        session_write(s, reply);
+    }
+    show_menu(s);
+}
+
+// Complete the login sequence once role, username and password are known
+void session_login(Session *s, const char *username, const char *password) {
+    char user[50], pass[50];
+
+    copy_field(user, username);
+    copy_field(pass, password);
+
+    // Set role based on choice
+    switch (s->choice) {
+        case 1:
+            strcpy(s->role, "admin");
+            break;
+        case 2:
+            strcpy(s->role, "faculty");
+            break;
+        case 3:
+            strcpy(s->role, "student");
+            break;
+        default:
+            session_write(s, "Invalid choice\n");
+            s->state = STATE_CLOSED;
+            return;
+    }
+
+    // Authenticate user
+    s->user_id = authenticate_user(user, pass, s->role);
+    if (s->user_id < 0) {
+        session_write(s, "Login failed\n");
+        s->state = STATE_CLOSED;
+        return;
+    }
+
+    session_write(s, "Login successful\n");
+    show_menu(s);
+}
+
+// Operation a text message completes, counted as its binary opcode in the
+// metrics; 0 for prompts that only collect a field or pick a menu entry
+uint16_t session_text_op(Session *s, const char *msg) {
+    switch (s->state) {
+        case STATE_PASSWORD:
+            return OP_LOGIN;
+        case STATE_ADD_STUDENT_PASSWORD:
+            return OP_ADD_STUDENT;
+        case STATE_ADD_FACULTY_PASSWORD:
+            return OP_ADD_FACULTY;
+        case STATE_TOGGLE_ID:
+            return OP_TOGGLE_STUDENT;
+        case STATE_UPDATE_PASSWORD:
+            return OP_UPDATE_DETAILS;
+        case STATE_ENROLL_COURSE:
+            return OP_ENROLL;
+        case STATE_UNENROLL_COURSE:
+            return OP_UNENROLL;
+        case STATE_JOIN_WAITLIST:
+            return OP_JOIN_WAITLIST;
+        case STATE_LEAVE_WAITLIST:
+            return OP_LEAVE_WAITLIST;
+        case STATE_CONFIRM_PASSWORD:
+            return OP_CHANGE_PASSWORD;
+        case STATE_ADD_COURSE_SEATS:
+            return OP_ADD_COURSE;
+        case STATE_REMOVE_COURSE_NAME:
+            return OP_REMOVE_COURSE;
+        case STATE_MENU:
+            // Menu entries that show a list before their prompt
+            if (strcmp(s->role, "student") == 0) {
+                int choice = atoi(msg);
+                return choice == 1 ? OP_LIST_COURSES : choice == 2 || choice == 3 ? OP_VIEW_ENROLLED :
+                       choice == 7 ? OP_VIEW_WAITLISTS : 0;
+            }
+            if (strcmp(s->role, "faculty") == 0 && atoi(msg) == 3) {
+                return OP_VIEW_ENROLLMENTS;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Advance the session by one client message
+void session_handle(Session *s, char *msg) {
+    char reply[BUFFER_SIZE];
+    Status status = STATUS_OK;
+    uint16_t opcode = session_text_op(s, msg);
+    long start = metrics_now();
+    int id;
+
+    trace_session = s->fd;
+    switch (s->state) {
+        case STATE_ROLE:
+            s->choice = atoi(msg);
+            session_write(s, "Enter username: ");
+            s->state = STATE_USERNAME;
+            break;
+        case STATE_USERNAME:
+            copy_field(s->field1, msg);
+            session_write(s, "Enter password: ");
+            s->state = STATE_PASSWORD;
+            break;
+        case STATE_PASSWORD:
+            session_login(s, s->field1, msg);
+            status = s->user_id < 0 ? STATUS_NOT_FOUND : STATUS_OK;
+            break;
+        case STATE_MENU:
+            if (strcmp(s->role, "admin") == 0) {
+                admin_menu(s, atoi(msg));
+            } else if (strcmp(s->role, "faculty") == 0) {
+                faculty_menu(s, atoi(msg));
+            } else {
+                student_menu(s, atoi(msg));
+            }
+            break;
+
+        // Admin sub-prompts
+        case STATE_ADD_STUDENT_USERNAME:
+            copy_field(s->field1, msg);
+            session_write(s, "Enter student password: ");
+            s->state = STATE_ADD_STUDENT_PASSWORD;
+            break;
+        case STATE_ADD_STUDENT_PASSWORD:
+            status = add_student(s->field1, msg, &id);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_EXISTS ? "Username already exists\n" : "Failed to add student\n");
+                break;
+            }
+            sprintf(reply, "Student added successfully with ID: %d\n", id);
+            finish_operation(s, reply);
+            break;
+        case STATE_ADD_FACULTY_USERNAME:
+            copy_field(s->field1, msg);
+            session_write(s, "Enter faculty password: ");
+            s->state = STATE_ADD_FACULTY_PASSWORD;
+            break;
+        case STATE_ADD_FACULTY_PASSWORD:
+            status = add_faculty(s->field1, msg, &id);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_EXISTS ? "Username already exists\n" : "Failed to add faculty\n");
+                break;
+            }
+            sprintf(reply, "Faculty added successfully with ID: %d\n", id);
+            finish_operation(s, reply);
+            break;
+        case STATE_TOGGLE_ID:
+            status = toggle_student_status(atoi(msg), &id);
+            if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Student not found\n");
+            } else if (status != STATUS_OK) {
+                finish_operation(s, "Failed to toggle student status\n");
+            } else {
+                sprintf(reply, "Student %s successfully\n", id ? "activated" : "deactivated");
+                finish_operation(s, reply);
+            }
+            break;
+        case STATE_UPDATE_CHOICE:
+            s->choice = atoi(msg);
+            session_write(s, "Enter ID: ");
+            s->state = STATE_UPDATE_ID;
+            break;
+        case STATE_UPDATE_ID: {
+            s->target_id = atoi(msg);
+            if (s->choice == 1) {
+                Student student;
+                status = read_student(s->target_id, &student);
+                if (status != STATUS_OK) {
+                    finish_operation(s, status == STATUS_NOT_FOUND ? "Student not found\n" : "Failed to update student\n");
+                    break;
+                }
+            } else if (s->choice == 2) {
+                Faculty faculty;
+                status = read_faculty(s->target_id, &faculty);
+                if (status != STATUS_OK) {
+                    finish_operation(s, status == STATUS_NOT_FOUND ? "Faculty not found\n" : "Failed to update faculty\n");
+                    break;
+                }
+            } else {
+                finish_operation(s, "Invalid choice\n");
+                break;
+            }
+            session_write(s, "Enter new username (or . to keep current): ");
+            s->state = STATE_UPDATE_USERNAME;
+            break;
+        }
+        case STATE_UPDATE_USERNAME:
+            copy_field(s->field1, msg);
+            session_write(s, "Enter new password (or . to keep current): ");
+            s->state = STATE_UPDATE_PASSWORD;
+            break;
+        case STATE_UPDATE_PASSWORD: {
+            char *role = s->choice == 1 ? "student" : "faculty";
+            status = update_details(role, s->target_id,
+                                    strcmp(s->field1, ".") != 0 ? s->field1 : NULL,
+                                    strcmp(msg, ".") != 0 ? msg : NULL);
+            if (status == STATUS_OK) {
+                finish_operation(s, s->choice == 1 ? "Student details updated successfully\n" : "Faculty details updated successfully\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, s->choice == 1 ? "Student not found\n" : "Faculty not found\n");
+            } else if (status == STATUS_EXISTS) {
+                finish_operation(s, "Username already exists\n");
+            } else {
+                finish_operation(s, s->choice == 1 ? "Failed to update student\n" : "Failed to update faculty\n");
+            }
+            break;
+        }
+
+        // Student sub-prompts
+        case STATE_ENROLL_COURSE:
+            status = enroll_course(s->user_id, msg, NULL);
+            if (status == STATUS_OK) {
+                finish_operation(s, "Successfully enrolled in course\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Student not found\n");
+            } else if (status == STATUS_EXISTS) {
+                finish_operation(s, "Already enrolled in this course\n");
+            } else if (status == STATUS_UNAVAILABLE) {
+                finish_operation(s, "Course not found or no seats available\n");
+            } else if (status == STATUS_LIMIT) {
+                finish_operation(s, "Maximum courses limit reached\n");
+            } else {
+                finish_operation(s, "Failed to enroll in course\n");
+            }
+            break;
+        case STATE_UNENROLL_COURSE:
+            status = unenroll_course(s->user_id, msg);
+            if (status == STATUS_OK) {
+                finish_operation(s, "Successfully unenrolled from course\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Student not found\n");
+            } else if (status == STATUS_NOT_ENROLLED) {
+                finish_operation(s, "Course not found in your enrolled courses\n");
+            } else if (status == STATUS_UNAVAILABLE) {
+                finish_operation(s, "Warning: Failed to update course seats\n");
+            } else {
+                finish_operation(s, "Failed to unenroll from course\n");
+            }
+            break;
+        case STATE_JOIN_WAITLIST:
+            status = join_waitlist(s->user_id, msg, &id);
+            if (status == STATUS_OK && id == 0) {
+                finish_operation(s, "A seat was free: successfully enrolled in course\n");
+            } else if (status == STATUS_OK) {
+                sprintf(reply, "You are number %d on the waitlist\n", id);
+                finish_operation(s, reply);
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Student not found\n");
+            } else if (status == STATUS_EXISTS) {
+                finish_operation(s, "Already enrolled in this course\n");
+            } else if (status == STATUS_UNAVAILABLE) {
+                finish_operation(s, "Course not found\n");
+            } else if (status == STATUS_LIMIT) {
+                finish_operation(s, "Maximum courses or waitlists limit reached\n");
+            } else {
+                finish_operation(s, "Failed to join the waitlist\n");
+            }
+            break;
+        case STATE_LEAVE_WAITLIST:
+            status = leave_waitlist(s->user_id, msg);
+            finish_operation(s, status == STATUS_OK ? "Left the waitlist\n" : "Not on the waitlist of this course\n");
+            break;
+
+        // Password change (student and faculty)
+        case STATE_OLD_PASSWORD:
+            copy_field(s->field1, msg);
+            session_write(s, "Enter new password: ");
+            s->state = STATE_NEW_PASSWORD;
+            break;
+        case STATE_NEW_PASSWORD:
+            copy_field(s->field2, msg);
+            session_write(s, "Confirm new password: ");
+            s->state = STATE_CONFIRM_PASSWORD;
+            break;
+        case STATE_CONFIRM_PASSWORD: {
+            char confirm[50];
+            copy_field(confirm, msg);
+            // Check if new passwords match
+            if (strcmp(s->field2, confirm) != 0) {
+                status = STATUS_INVALID;
+                finish_operation(s, "New passwords do not match\n");
+                break;
+            }
+            status = change_password(s->role, s->user_id, s->field1, s->field2);
+            if (status == STATUS_OK) {
+                finish_operation(s, "Password changed successfully\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, strcmp(s->role, "student") == 0 ? "Student not found\n" : "Faculty not found\n");
+            } else if (status == STATUS_WRONG_PASSWORD) {
+                finish_operation(s, "Incorrect old password\n");
+            } else {
+                finish_operation(s, "Failed to change password\n");
+            }
+            break;
+        }
+
+        // Faculty sub-prompts
+        case STATE_ADD_COURSE_NAME:
+            copy_field(s->field1, msg);
+            // Check if course already exists
+            if (check_course_exists(s->field1)) {
+                finish_operation(s, "Course already exists\n");
+                break;
+            }
+            session_write(s, "Enter number of seats: ");
+            s->state = STATE_ADD_COURSE_SEATS;
+            break;
+        case STATE_ADD_COURSE_SEATS: {
+            int seats = atoi(msg);
+            if (seats <= 0 || seats > MAX_SEATS) {
+                status = STATUS_INVALID;
+                finish_operation(s, "Invalid number of seats\n");
+                break;
+            }
+            status = add_course(s->user_id, s->field1, seats);
+            if (status == STATUS_OK) {
+                finish_operation(s, "Course added successfully\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Faculty not found\n");
+            } else if (status == STATUS_EXISTS) {
+                finish_operation(s, "Course already exists\n");
+            } else if (status == STATUS_LIMIT) {
+                finish_operation(s, "Maximum courses limit reached\n");
+            } else {
+                finish_operation(s, "Failed to add course\n");
+            }
+            break;
+        }
+        case STATE_REMOVE_COURSE_NAME:
+            status = remove_course(s->user_id, msg);
+            if (status == STATUS_OK) {
+                finish_operation(s, "Course removed successfully\n");
+            } else if (status == STATUS_NOT_FOUND) {
+                finish_operation(s, "Faculty not found\n");
+            } else if (status == STATUS_NOT_ENROLLED) {
+                finish_operation(s, "Course not found in your offered courses\n");
+            } else if (status == STATUS_UNAVAILABLE) {
+                finish_operation(s, "Course removed, but warning: failed to update student enrollments\n");
+            } else {
+                finish_operation(s, "Failed to remove course\n");
+            }
+            break;
+
+        case STATE_CLOSED:
+            break;
+    }
+    if (opcode != 0) {
+        metrics_request(opcode, start, status == STATUS_OK);
+    }
+    trace_session = -1;
+}
+
+// Admin menu
+void admin_menu(Session *s, int choice) {
+    switch (choice) {
+        case 1:
+            session_write(s, "Enter student username: ");
+            s->state = STATE_ADD_STUDENT_USERNAME;
+            break;
+        case 2:
+            session_write(s, "Enter faculty username: ");
+            s->state = STATE_ADD_FACULTY_USERNAME;
+            break;
+        case 3:
+            session_write(s, "Enter student ID: ");
+            s->state = STATE_TOGGLE_ID;
+            break;
+        case 4:
+            session_write(s, "Update: 1. Student 2. Faculty\nEnter choice: ");
+            s->state = STATE_UPDATE_CHOICE;
+            break;
+        case 5:
+            session_write(s, "Goodbye!\n");
+            s->state = STATE_CLOSED;
+            break;
+        default:
+            finish_operation(s, "Invalid choice\n");
+    }
+}
+
+// Student menu
+void student_menu(Session *s, int choice) {
+    CourseInfo *courses;
+    WaitlistInfo *waits;
+    Status status;
+    int count;
+
+    switch (choice) {
+        case 1:
+            // Show available courses, then ask for the course to enroll
+            if (list_available_courses(&courses, &count) != STATUS_OK) {
+                finish_operation(s, "Failed to get available courses\n");
+                break;
+            }
+            session_write(s, "Available Courses:\n");
+            for (int i = 0; i < count; i++) {
+                buffer_printf(&s->out, "- %s (Available seats: %d)\n", courses[i].name, courses[i].seats);
+            }
+            free(courses);
+            session_write(s, "Enter course name to enroll: ");
+            s->state = STATE_ENROLL_COURSE;
+            break;
+        case 2:
+            // Show enrolled courses, then ask for the course to unenroll
+            status = view_enrolled_courses(s->user_id, &courses, &count);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_NOT_FOUND ? "Student not found\n" : "Failed to get enrolled courses\n");
+                break;
+            }
+            session_write(s, "Your enrolled courses:\n");
+            if (count == 0) {
+                free(courses);
+                finish_operation(s, "No courses enrolled\n");
+                break;
+            }
+            for (int i = 0; i < count; i++) {
+                buffer_printf(&s->out, "- %s\n", courses[i].name);
+            }
+            free(courses);
+            session_write(s, "Enter course name to unenroll: ");
+            s->state = STATE_UNENROLL_COURSE;
+            break;
+        case 3:
+            status = view_enrolled_courses(s->user_id, &courses, &count);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_NOT_FOUND ? "Student not found\n" : "Failed to view enrolled courses\n");
+                break;
+            }
+            session_write(s, "\n=== Your Enrolled Courses ===\n");
+            if (count == 0) {
+                session_write(s, "You are not enrolled in any courses.\n");
+            } else {
+                buffer_printf(&s->out, "Total courses enrolled: %d\n\n", count);
+                for (int i = 0; i < count; i++) {
+                    buffer_printf(&s->out, "%d. %s\n", i + 1, courses[i].name);
+                }
+            }
+            free(courses);
+
+            // Waitlist notices are shown once, here
+            if (view_waitlists(s->user_id, &waits, &count) == STATUS_OK) {
+                for (int i = 0; i < count; i++) {
+                    if (waits[i].position > 0) {
+                        buffer_printf(&s->out, "Waitlisted: %s (number %d)\n", waits[i].name, waits[i].position);
+                    } else {
+                        buffer_printf(&s->out, "Enrolled from the waitlist: %s\n", waits[i].name);
+                    }
+                }
+                free(waits);
+            }
+            finish_operation(s, NULL);
+            break;
+        case 4:
+            session_write(s, "Enter old password: ");
+            s->state = STATE_OLD_PASSWORD;
+            break;
+        case 5:
+            session_write(s, "Goodbye!\n");
+            s->state = STATE_CLOSED;
+            break;
+        case 6:
+            session_write(s, "Enter course name to wait for: ");
+            s->state = STATE_JOIN_WAITLIST;
+            break;
+        case 7:
+            // Show the waitlists, then ask which one to leave
+            status = view_waitlists(s->user_id, &waits, &count);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_NOT_FOUND ? "Student not found\n" : "Failed to get waitlists\n");
+                break;
+            }
+            session_write(s, "Your waitlists:\n");
+            for (int i = 0; i < count; i++) {
+                if (waits[i].position > 0) {
+                    buffer_printf(&s->out, "- %s (number %d)\n", waits[i].name, waits[i].position);
+                } else {
+                    buffer_printf(&s->out, "Enrolled from the waitlist: %s\n", waits[i].name);
+                }
+            }
+            free(waits);
+            session_write(s, "Enter course name to leave the waitlist: ");
+            s->state = STATE_LEAVE_WAITLIST;
+            break;
+        default:
+            finish_operation(s, "Invalid choice\n");
+    }
+}
+
+// Faculty menu
+void faculty_menu(Session *s, int choice) {
+    CourseInfo *courses;
+    RosterEntry *roster;
+    Status status;
+    int count, course_count;
+
+    switch (choice) {
+        case 1:
+            session_write(s, "Enter course name: ");
+            s->state = STATE_ADD_COURSE_NAME;
+            break;
+        case 2:
+            // Show offered courses, then ask for the course to remove
+            status = list_offered_courses(s->user_id, &courses, &course_count);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_NOT_FOUND ? "Faculty not found\n" : "Failed to get offered courses\n");
+                break;
+            }
+            session_write(s, "Your offered courses:\n");
+            if (course_count == 0) {
+                free(courses);
+                finish_operation(s, "No courses offered\n");
+                break;
+            }
+            for (int i = 0; i < course_count; i++) {
+                buffer_printf(&s->out, "- %s (Seats: %d)\n", courses[i].name, courses[i].seats);
+            }
+            free(courses);
+            session_write(s, "Enter course name to remove: ");
+            s->state = STATE_REMOVE_COURSE_NAME;
+            break;
+        case 3: {
+            status = view_enrollments(s->user_id, &courses, &course_count, &roster, &count);
+            if (status != STATUS_OK) {
+                finish_operation(s, status == STATUS_NOT_FOUND ? "Faculty not found\n" : "Failed to view enrollments\n");
+                break;
+            }
+
+            session_write(s, "\n=== Course Enrollments ===\n");
+            if (course_count == 0) {
+                session_write(s, "You have not offered any courses.\n");
+            }
+
+            // For each course, show enrolled students
+            int next = 0;
+            for (int i = 0; i < course_count; i++) {
+                int enrolled_count = courses[i].capacity - courses[i].seats; // Calculate enrolled students
+                buffer_printf(&s->out, "\nCourse: %s\nEnrolled Students: %d/%d\n", courses[i].name, enrolled_count, courses[i].capacity);
+
+                if (enrolled_count > 0) {
+                    session_write(s, "Students enrolled:\n");
+                    for (; next < count && roster[next].course == i; next++) {
+                        buffer_printf(&s->out, "  - %s (ID: %d)\n", roster[next].username, roster[next].id);
+                    }
+                } else {
+                    session_write(s, "No students enrolled yet.\n");
+                }
+                session_write(s, "------------------------\n");
+            }
+            free(courses);
+            free(roster);
+            finish_operation(s, NULL);
+            break;
+        }
+        case 4:
+            session_write(s, "Enter old password: ");
+            s->state = STATE_OLD_PASSWORD;
+            break;
+        case 5:
+            session_write(s, "Goodbye!\n");
+            s->state = STATE_CLOSED;
+            break;
+        default:
+            finish_operation(s, "Invalid choice\n");
+    }
+}
+
+// Role a binary request needs: NULL for none, "" for any logged in user
+const char *binary_op_role(uint16_t opcode) {
+    switch (opcode) {
+        case OP_CHANGE_PASSWORD:
+            return "";
+        case OP_ADD_STUDENT:
+        case OP_ADD_FACULTY:
+        case OP_TOGGLE_STUDENT:
+        case OP_UPDATE_DETAILS:
+        case OP_IMPORT_USERS:
+        case OP_EXPORT_ENROLLMENTS:
+        case OP_DUMP_TRACE:
+            return "admin";
+        case OP_LIST_COURSES:
+        case OP_ENROLL:
+        case OP_UNENROLL:
+        case OP_VIEW_ENROLLED:
+        case OP_JOIN_WAITLIST:
+        case OP_LEAVE_WAITLIST:
+        case OP_VIEW_WAITLISTS:
+            return "student";
+        case OP_ADD_COURSE:
+        case OP_REMOVE_COURSE:
+        case OP_VIEW_ENROLLMENTS:
+            return "faculty";
+        default:
+            return NULL;
+    }
+}
+
+// Copy an imported username or password, which must fit its field
+Status import_field(char *dest, const uint8_t *src, size_t len) {
+    if (len == 0 || len >= 50) {
+        return STATUS_INVALID;
+    }
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+    return STATUS_OK;
+}
+
+// Split the rest of the payload into CSV rows, one per line. Returns the
+// number of rows, or -1 if there are more than PROTO_IMPORT_MAX_ROWS.
+int import_parse_csv(ProtoReader *req, ImportRow *rows) {
+    const uint8_t *p = req->p, *end = req->p + req->left;
+    int count = 0;
+
+    while (p < end) {
+        const uint8_t *eol = memchr(p, '\n', end - p);
+        const uint8_t *line_end = eol != NULL ? eol : end;
+        if (line_end > p && line_end[-1] == '\r') {
+            line_end--;
+        }
+        if (count == PROTO_IMPORT_MAX_ROWS) {
+            return -1;
+        }
+
+        ImportRow *row = &rows[count++];
+        const uint8_t *comma = memchr(p, ',', line_end - p);
+        row->status = comma != NULL ? import_field(row->username, p, comma - p) : STATUS_INVALID;
+        if (row->status == STATUS_OK) {
+            row->status = import_field(row->password, comma + 1, line_end - comma - 1);
+        }
+        p = eol != NULL ? eol + 1 : end;
+    }
+    req->p = end;
+    req->left = 0;
+    return count;
+}
+
+// Read u32 n, n x (str username, str password). Returns the number of rows,
+// or -1 if the payload is malformed (req->error) or has too many rows.
+int import_parse_records(ProtoReader *req, ImportRow *rows) {
+    uint32_t count = proto_get_u32(req);
+
+    if (req->error || count > PROTO_IMPORT_MAX_ROWS) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ImportRow *row = &rows[i];
+        row->status = STATUS_OK;
+        for (int field = 0; field < 2; field++) {
+            uint16_t len = proto_get_u16(req);
+            if (req->error || req->left < len) {
+                req->error = 1;
+                return -1;
+            }
+            if (row->status == STATUS_OK) {
+                row->status = import_field(field == 0 ? row->username : row->password, req->p, len);
+            }
+            req->p += len;
+            req->left -= len;
+        }
+    }
+    if (req->left != 0) {
+        req->error = 1;
+        return -1;
+    }
+    return count;
+}
+
+// Run an IMPORT_USERS request. Rows that cannot be added are listed in the
+// response; the request as a whole fails only if the payload is malformed or
+// the data files cannot be written, in which case no row is added.
+int binary_import(ProtoReader *req, ProtoWriter *resp) {
+    int role = proto_get_u8(req);
+    int format = proto_get_u8(req);
+    uint32_t first_row = proto_get_u32(req);
+    int count = -1, first_id, added, status;
+
+    if (req->error || (role != PROTO_ROLE_FACULTY && role != PROTO_ROLE_STUDENT) ||
+        (format != PROTO_IMPORT_CSV && format != PROTO_IMPORT_RECORDS)) {
+        return PROTO_BAD_REQUEST;
+    }
+    ImportRow *rows = malloc(PROTO_IMPORT_MAX_ROWS * sizeof(ImportRow));
+    if (rows == NULL) {
+        return PROTO_ERROR;
+    }
+
+    if (format == PROTO_IMPORT_CSV) {
+        count = import_parse_csv(req, rows);
+    } else {
+        count = import_parse_records(req, rows);
+    }
+    if (count < 0) {
+        status = req->error ? PROTO_BAD_REQUEST : PROTO_LIMIT;
+    } else {
+        status = import_users(role == PROTO_ROLE_STUDENT ? "student" : "faculty", rows, count, &first_id, &added);
+    }
+
+    if (status == PROTO_OK) {
+        proto_put_u32(resp, first_id);
+        proto_put_u32(resp, added);
+        proto_put_u32(resp, count - added);
+        for (int i = 0; i < count; i++) {
+            if (rows[i].status != STATUS_OK) {
+                proto_put_u32(resp, first_row + i);
+                proto_put_u8(resp, rows[i].status);
+            }
+        }
+    }
+    free(rows);
+    return status;
+}
+
+// Append one export row in the session's export format
+void export_put_row(ProtoWriter *w, int format, const EnrollmentRow *row) {
+    if (format == PROTO_EXPORT_RECORDS) {
+        proto_put_u32(w, row->student_id);
+        proto_put_str(w, row->student);
+        proto_put_u32(w, row->course_id);
+        proto_put_str(w, row->course);
+        proto_put_u32(w, row->faculty_id);
+        proto_put_str(w, row->faculty);
+        return;
+    }
+    char line[256];
+    int len = snprintf(line, sizeof(line), "%d,%s,%d,%s,%d,%s\n", row->student_id, row->student,
+                       row->course_id, row->course, row->faculty_id, row->faculty);
+    proto_reserve(w, len);
+    memcpy(w->data + w->len, line, len);
+    w->len += len;
+}
+
+// Run one step of an EXPORT_ENROLLMENTS request: start the export on the
+// first call, then append the next chunk of rows. session_process() runs the
+// request again, once earlier chunks are sent, until the last chunk clears
+// s->export; the session's output never holds much more than one chunk.
+int binary_export(Session *s, ProtoReader *req, ProtoWriter *resp) {
+    EnrollmentRow rows[MAX_COURSES];
+    int status = PROTO_OK;
+    int count;
+
+    if (s->export == NULL) {
+        int format = proto_get_u8(req);
+        if (req->error || (format != PROTO_EXPORT_CSV && format != PROTO_EXPORT_RECORDS)) {
+            return PROTO_BAD_REQUEST;
+        }
+        EnrollmentExport *e = calloc(1, sizeof(EnrollmentExport));
+        if (e == NULL) {
+            return PROTO_ERROR;
+        }
+        status = export_enrollments_begin(e);
+        if (status != PROTO_OK) {
+            free(e);
+            return status;
+        }
+        e->format = format;
+        s->export = e;
+    }
+
+    EnrollmentExport *e = s->export;
+    size_t start = resp->len;
+    uint32_t total = 0;
+    proto_put_u8(resp, 1);
+    proto_put_u32(resp, 0);
+    if (e->next == 0 && e->format == PROTO_EXPORT_CSV) {
+        const char *header = "student_id,student,course_id,course,faculty_id,faculty\n";
+        proto_reserve(resp, strlen(header));
+        memcpy(resp->data + resp->len, header, strlen(header));
+        resp->len += strlen(header);
+    }
+    while (e->next < e->count && resp->len - start < EXPORT_CHUNK_BYTES && status == PROTO_OK) {
+        status = export_enrollments_next(e, rows, &count);
+        for (int i = 0; i < count && status == PROTO_OK; i++) {
+            export_put_row(resp, e->format, &rows[i]);
+        }
+        total += count;
+    }
+
+    uint32_t n = htonl(total);
+    memcpy(resp->data + start + 1, &n, 4);
+    if (e->next == e->count || status != PROTO_OK) {
+        resp->data[start] = 0;
+        export_enrollments_end(e);
+        free(e);
+        s->export = NULL;
+    }
+    return status;
+}
+
+// End an export the client went away from
+void session_end_export(Session *s) {
+    if (s->export != NULL) {
+        export_enrollments_end(s->export);
+        free(s->export);
+        s->export = NULL;
+    }
+}
+
+// Run one binary request and append the response frame to resp. Every operation is a single request/response pair;
+// the fields the text menus collect one prompt at a time arrive together in
+// the request payload.
+void binary_execute(Session *s, uint16_t opcode, ProtoReader *req, ProtoWriter *resp) {
+    size_t frame = proto_begin_frame(resp, opcode);
+    const char *need = binary_op_role(opcode);
+    char field1[50], field2[50];
+    int status = PROTO_OK;
+    int id, value = 0;
+    long start = metrics_now();
+
+    if (need != NULL && (s->user_id < 0 || (need[0] != '\0' && strcmp(s->role, need) != 0))) {
+        proto_end_frame(resp, frame, PROTO_DENIED);
+        metrics_request(opcode, start, 0);
+        return;
+    }
+
+    switch (opcode) {
+        case OP_LOGIN:
+            value = proto_get_u8(req);
+            proto_get_str(req, field1, sizeof(field1));
+            proto_get_str(req, field2, sizeof(field2));
+            if (req->error || value < PROTO_ROLE_ADMIN || value > PROTO_ROLE_STUDENT) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            strcpy(s->role, value == PROTO_ROLE_ADMIN ? "admin" : value == PROTO_ROLE_FACULTY ? "faculty" : "student");
+            s->user_id = authenticate_user(field1, field2, s->role);
+            if (s->user_id < 0) {
+                s->role[0] = '\0';
+                status = PROTO_DENIED;
+                break;
+            }
+            proto_put_u32(resp, s->user_id);
+            break;
+        case OP_LOGOUT:
+            s->state = STATE_CLOSED;
+            break;
+
+        // Admin operations
+        case OP_ADD_STUDENT:
+        case OP_ADD_FACULTY:
+            proto_get_str(req, field1, sizeof(field1));
+            proto_get_str(req, field2, sizeof(field2));
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            if (opcode == OP_ADD_STUDENT) {
+                status = add_student(field1, field2, &id);
+            } else {
+                status = add_faculty(field1, field2, &id);
+            }
+            if (status == PROTO_OK) {
+                proto_put_u32(resp, id);
+            }
+            break;
+        case OP_TOGGLE_STUDENT:
+            id = proto_get_u32(req);
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            status = toggle_student_status(id, &value);
+            proto_put_u8(resp, value);
+            break;
+        case OP_UPDATE_DETAILS:
+            value = proto_get_u8(req);
+            id = proto_get_u32(req);
+            proto_get_str(req, field1, sizeof(field1));
+            proto_get_str(req, field2, sizeof(field2));
+            if (req->error || (value != PROTO_ROLE_FACULTY && value != PROTO_ROLE_STUDENT)) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            status = update_details(value == PROTO_ROLE_STUDENT ? "student" : "faculty", id,
+                                    field1[0] != '\0' ? field1 : NULL,
+                                    field2[0] != '\0' ? field2 : NULL);
+            break;
+        case OP_IMPORT_USERS:
+            status = binary_import(req, resp);
+            break;
+        case OP_EXPORT_ENROLLMENTS:
+            status = binary_export(s, req, resp);
+            break;
+        case OP_DUMP_TRACE: {
+            uint32_t seconds = proto_get_u32(req);
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+            } else if (config.trace == 0) {
+                status = PROTO_UNAVAILABLE;
+            } else if (trace_dump(seconds > 0 ? (long)seconds : config.trace, field1, sizeof(field1)) < 0) {
+                status = PROTO_ERROR;
+            } else {
+                proto_put_str(resp, field1);
+            }
+            break;
+        }
+
+        // Student operations
+        case OP_LIST_COURSES: {
+            CourseInfo *courses;
+            status = list_available_courses(&courses, &value);
+            if (status != STATUS_OK) {
+                break;
+            }
+            proto_put_u32(resp, value);
+            for (int i = 0; i < value; i++) {
+                proto_put_str(resp, courses[i].name);
+                proto_put_u32(resp, courses[i].seats);
+            }
+            free(courses);
+            break;
+        }
+        case OP_ENROLL:
+        case OP_UNENROLL:
+            proto_get_str(req, field1, sizeof(field1));
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            if (opcode == OP_ENROLL) {
+                status = enroll_course(s->user_id, field1, &value);
+                proto_put_u32(resp, value);
+            } else {
+                status = unenroll_course(s->user_id, field1);
+            }
+            break;
+        case OP_VIEW_ENROLLED: {
+            CourseInfo *courses;
+            status = view_enrolled_courses(s->user_id, &courses, &value);
+            if (status != STATUS_OK) {
+                break;
+            }
+            proto_put_u32(resp, value);
+            for (int i = 0; i < value; i++) {
+                proto_put_str(resp, courses[i].name);
+            }
+            free(courses);
+            break;
+        }
+        case OP_JOIN_WAITLIST:
+        case OP_LEAVE_WAITLIST:
+            proto_get_str(req, field1, sizeof(field1));
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            if (opcode == OP_JOIN_WAITLIST) {
+                status = join_waitlist(s->user_id, field1, &value);
+                proto_put_u32(resp, value);
+            } else {
+                status = leave_waitlist(s->user_id, field1);
+            }
+            break;
+        case OP_VIEW_WAITLISTS: {
+            WaitlistInfo *waits;
+            status = view_waitlists(s->user_id, &waits, &value);
+            if (status != STATUS_OK) {
+                break;
+            }
+            proto_put_u32(resp, value);
+            for (int i = 0; i < value; i++) {
+                proto_put_str(resp, waits[i].name);
+                proto_put_u32(resp, waits[i].position);
+            }
+            free(waits);
+            break;
+        }
+        case OP_CHANGE_PASSWORD:
+            proto_get_str(req, field1, sizeof(field1));
+            proto_get_str(req, field2, sizeof(field2));
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            if (strcmp(s->role, "admin") == 0) {
+                status = PROTO_DENIED;
+                break;
+            }
+            status = change_password(s->role, s->user_id, field1, field2);
+            break;
+
+        // Faculty operations
+        case OP_ADD_COURSE:
+            proto_get_str(req, field1, sizeof(field1));
+            value = proto_get_u32(req);
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+            } else if (value <= 0 || value > MAX_SEATS) {
+                status = PROTO_INVALID;
+            } else if (check_course_exists(field1)) {
+                status = PROTO_EXISTS;
+            } else {
+                status = add_course(s->user_id, field1, value);
+            }
+            break;
+        case OP_REMOVE_COURSE:
+            proto_get_str(req, field1, sizeof(field1));
+            if (req->error) {
+                status = PROTO_BAD_REQUEST;
+                break;
+            }
+            status = remove_course(s->user_id, field1);
+            break;
+        case OP_VIEW_ENROLLMENTS: {
+            CourseInfo *courses;
+            RosterEntry *roster;
+            int course_count;
+            status = view_enrollments(s->user_id, &courses, &course_count, &roster, &value);
+            if (status != STATUS_OK) {
+                break;
+            }
+            int next = 0;
+            proto_put_u32(resp, course_count);
+            for (int i = 0; i < course_count; i++) {
+                int first = next;
+                while (next < value && roster[next].course == i) {
+                    next++;
+                }
+                proto_put_str(resp, courses[i].name);
+                proto_put_u32(resp, courses[i].capacity - courses[i].seats);
+                proto_put_u32(resp, courses[i].capacity);
+                proto_put_u32(resp, next - first);
+                for (int j = first; j < next; j++) {
+                    proto_put_u32(resp, roster[j].id);
+                    proto_put_str(resp, roster[j].username);
+                }
+            }
+            free(courses);
+            free(roster);
+            break;
+        }
+
+        default:
+            status = PROTO_BAD_REQUEST;
+    }
+
+    // Failed operations carry no payload
+    if (status != PROTO_OK) {
+        resp->len = frame + PROTO_HEADER_SIZE;
+    }
+    proto_end_frame(resp, frame, status);
+    metrics_request(opcode, start, status == PROTO_OK);
+}
+
+// Run the sub-requests of a BATCH in order, each taking its own record locks.
+// A failing sub-request does not stop the rest.
+void binary_batch(Session *s, ProtoReader *req, ProtoWriter *resp) {
+    size_t frame = proto_begin_frame(resp, OP_BATCH);
+    uint32_t count = proto_get_u32(req);
+    ProtoReader scan = *req;
+    uint16_t opcode, status;
+    uint32_t len;
+
+    // Check the framing of every sub-request before running any of them
+    for (uint32_t i = 0; i < count && !scan.error; i++) {
+        if (scan.left < PROTO_HEADER_SIZE) {
+            scan.error = 1;
+            break;
+        }
+        proto_parse_header(scan.p, &opcode, &status, &len);
+        if (len > scan.left - PROTO_HEADER_SIZE) {
+            scan.error = 1;
+            break;
+        }
+        scan.p += PROTO_HEADER_SIZE + len;
+        scan.left -= PROTO_HEADER_SIZE + len;
+    }
+    if (req->error || scan.error || scan.left != 0) {
+        proto_end_frame(resp, frame, PROTO_BAD_REQUEST);
+        return;
+    }
+
+    proto_put_u32(resp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        proto_parse_header(req->p, &opcode, &status, &len);
+        ProtoReader sub = { req->p + PROTO_HEADER_SIZE, len, 0 };
+        req->p += PROTO_HEADER_SIZE + len;
+        req->left -= PROTO_HEADER_SIZE + len;
+
+        // Session-level requests and exports cannot be batched
+        if (opcode == OP_LOGIN || opcode == OP_LOGOUT || opcode == OP_BATCH || opcode == OP_EXPORT_ENROLLMENTS) {
+            size_t bad = proto_begin_frame(resp, opcode);
+            proto_end_frame(resp, bad, PROTO_BAD_REQUEST);
+            continue;
+        }
+        binary_execute(s, opcode, &sub, resp);
+    }
+    proto_end_frame(resp, frame, PROTO_OK);
+}
+
+// Run one binary request and queue its response
+void binary_handle(Session *s, uint16_t opcode, ProtoReader *req) {
+    ProtoWriter resp = {0};
+
+    trace_session = s->fd;
+    if (opcode == OP_BATCH) {
+        long start = metrics_now();
+        uint16_t batch_opcode, status;
+        uint32_t len;
+        binary_batch(s, req, &resp);
+        proto_parse_header(resp.data, &batch_opcode, &status, &len);
+        metrics_request(OP_BATCH, start, status == PROTO_OK);
+    } else {
+        binary_execute(s, opcode, req, &resp);
+    }
+    binary_send(s, &resp);
+    trace_session = -1;
+}
+
+// Current time in nanoseconds
+long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Estimated time until a full queue has room again
+int pool_retry_ms() {
+    mutex_lock(&pool.lock);
+    long ms = (long)pool.count * pool.avg_job_ns / (pool.threads > 0 ? pool.threads : 1) / 1000000L;
+    mutex_unlock(&pool.lock);
+    return ms < 1 ? 1 : (int)ms;
+}
+
+// Queue a session for a storage worker. Returns -1 when the queue is full.
+int pool_submit(Session *s) {
+    mutex_lock(&pool.lock);
+    if (pool.count == pool.capacity) {
+        mutex_unlock(&pool.lock);
+        return -1;
+    }
+    pool.jobs[(pool.head + pool.count) % pool.capacity] = s;
+    pool.count++;
+    pthread_cond_signal(&pool.not_empty);
+    mutex_unlock(&pool.lock);
+    return 0;
+}
+
+// Hand a session back to its reactor
+void reactor_complete(Reactor *r, Session *s) {
+    uint64_t one = 1;
+
+    mutex_lock(&r->done_lock);
+    s->next = r->done;
+    r->done = s;
+    mutex_unlock(&r->done_lock);
+    write(r->wake_fd, &one, sizeof(one));
+}
+
+// Worker thread: run the buffered messages of one session at a time
+void *worker_run(void *arg) {
+    (void)arg;
+    while (1) {
+        mutex_lock(&pool.lock);
+        while (pool.count == 0) {
+            mutex_wait(&pool.not_empty, &pool.lock);
+        }
+        Session *s = pool.jobs[pool.head];
+        pool.head = (pool.head + 1) % pool.capacity;
+        pool.count--;
+        mutex_unlock(&pool.lock);
+
+        long start = now_ns();
+        session_process(s, 1);
+        long elapsed = now_ns() - start;
+
+        mutex_lock(&pool.lock);
+        pool.avg_job_ns += (elapsed - pool.avg_job_ns) / 8;
+        mutex_unlock(&pool.lock);
+
+        reactor_complete(s->reactor, s);
+    }
+    return NULL;
+}
+
+// Create a thread with the configured stack size
+int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg) {
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, config.stack_size);
+    int rc = pthread_create(thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+void start_worker_pool() {
+    pool.capacity = config.queue_depth;
+    pool.jobs = calloc(pool.capacity, sizeof(Session *));
+    pool.threads = config.workers;
+
+    for (int i = 0; i < config.workers; i++) {
+        pthread_t thread;
+        if (start_thread(&thread, worker_run, NULL) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+}
+
+// Register or update the epoll interest set of a session. A closing session,
+// or one with too many replies backed up, only waits for output to drain.
+void reactor_watch(Reactor *r, Session *s, int op) {
+    struct epoll_event ev;
+
+    if (s->state == STATE_CLOSED || s->eof || s->out.len > MAX_PENDING_OUTPUT) {
+        ev.events = EPOLLOUT;
+    } else {
+        ev.events = EPOLLIN | EPOLLRDHUP | (s->out.len > 0 ? EPOLLOUT : 0);
+    }
+    if (op == EPOLL_CTL_MOD && ev.events == s->events) {
+        return;
+    }
+    s->events = ev.events;
+    ev.data.ptr = s;
+    if (epoll_ctl(r->epoll_fd, op, s->fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+    }
+}
+
+void reactor_close(Reactor *r, Session *s) {
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    session_end_export(s);
+    buffer_free(&s->in);
+    buffer_free(&s->out);
+    free(s);
+    atomic_fetch_add(&sessions_closed, 1);
+}
+
+// Write as much pending output as the socket accepts. Returns -1 if the
+// session should be closed.
+int reactor_flush(Reactor *r, Session *s) {
+    while (s->out.len > 0) {
+        long start = trace_now();
+        ssize_t n = write(s->fd, s->out.data, s->out.len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        trace_span(TRACE_WRITE, "write", NULL, s->fd, start, n);
+        buffer_consume(&s->out, n);
+    }
+
+    // A closing session is released once its last reply is on the wire
+    if (s->state == STATE_CLOSED && s->out.len == 0) {
+        return -1;
+    }
+    reactor_watch(r, s, EPOLL_CTL_MOD);
+    return 0;
+}
+
+// Accept every pending connection on the listener
+void reactor_accept(Reactor *r) {
+    while (1) {
+        int fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        Session *s = calloc(1, sizeof(Session));
+        if (s == NULL) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        s->reactor = r;
+        session_start(s);
+        reactor_watch(r, s, EPOLL_CTL_ADD);
+        if (reactor_flush(r, s) < 0) {
+            reactor_close(r, s);
+        }
+    }
+}
+
+// Run buffered messages on the reactor until one needs storage, then pass the
+// session to a worker. While a worker owns the session the reactor stops
+// watching its socket. Returns -1 if the session should be closed.
+int reactor_dispatch(Reactor *r, Session *s) {
+    int held;
+
+    do {
+        while (session_process(s, config.workers == 0)) {
+            // Flush earlier replies now; the worker appends after them
+            if (reactor_flush(r, s) < 0) {
+                return -1;
+            }
+            epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+            s->events = 0;
+            s->busy = 1;
+            if (pool_submit(s) == 0) {
+                return 0;
+            }
+
+            // Queue full: reject this message and keep the session in its state,
+            // so the client can simply send it again
+            s->busy = 0;
+            reactor_watch(r, s, EPOLL_CTL_ADD);
+            session_reject_busy(s, pool_retry_ms());
+        }
+
+        // Close after the last request once nothing is held back by output
+        if (s->eof && s->out.len <= MAX_PENDING_OUTPUT) {
+            s->state = STATE_CLOSED;
+        }
+        held = s->out.len > MAX_PENDING_OUTPUT;
+        if (reactor_flush(r, s) < 0) {
+            return -1;
+        }
+        // Requests held back by the backlog run once it drains; no further
+        // input or EPOLLOUT event would wake them up
+    } while (held && s->out.len <= MAX_PENDING_OUTPUT);
+    return 0;
+}
+
+// Read everything available and drive the session state machine
+void reactor_read(Reactor *r, Session *s) {
+    char buffer[BUFFER_SIZE * 4];
+
+    while (!s->eof && s->in.len <= MAX_PENDING_INPUT) {
+        long start = trace_now();
+        ssize_t n = read(s->fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            trace_span(TRACE_READ, "read", NULL, s->fd, start, n);
+            buffer_append(&s->in, buffer, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        // Peer closed the connection or the read failed; requests it already
+        // sent are still answered before the session is closed
+        s->eof = 1;
+    }
+
+    if (reactor_dispatch(r, s) < 0) {
+        reactor_close(r, s);
+    }
+}
+
+// Resume sessions whose storage work finished on a worker thread
+void reactor_resume(Reactor *r) {
+    uint64_t count;
+
+    read(r->wake_fd, &count, sizeof(count));
+
+    mutex_lock(&r->done_lock);
+    Session *s = r->done;
+    r->done = NULL;
+    mutex_unlock(&r->done_lock);
+
+    while (s != NULL) {
+        Session *next = s->next;
+        s->busy = 0;
+        reactor_watch(r, s, EPOLL_CTL_ADD);
+        if (reactor_dispatch(r, s) < 0) {
+            reactor_close(r, s);
+        }
+        s = next;
+    }
+}
+
+// Event loop of one reactor thread
+void *reactor_run(void *arg) {
+    Reactor *r = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(r->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            Session *s = ptr;
+
+            if (ptr == NULL) {
+                reactor_accept(r);
+            } else if (ptr == r) {
+                reactor_resume(r);
+            } else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                reactor_read(r, s);
+            } else if (events[i].events & EPOLLOUT) {
+                // Writing may make room for requests paused behind the backlog
+                if (reactor_dispatch(r, s) < 0) {
+                    reactor_close(r, s);
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Raise the descriptor limit so idle sessions are bounded by memory, not
+// by the default 1024 open files
+void raise_fd_limit() {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// List the CPUs this process may run on
+int allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    int count = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+        return 0;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[count++] = cpu;
+        }
+    }
+    return count;
+}
+
+// Serve all connections from a fixed set of epoll threads. In epoll mode they
+// share one listener; in reuseport mode each reactor owns a listener on the
+// same port and is pinned to its own core, so the kernel spreads accepts
+// across cores.
+void run_reactors(int server_fd) {
+    int cpus[CPU_SETSIZE];
+    int cpu_count = allowed_cpus(cpus, CPU_SETSIZE);
+
+    if (config.reactors == 0) {
+        config.reactors = config.mode == MODE_REUSEPORT && cpu_count > 0 ? cpu_count : DEFAULT_REACTORS;
+    }
+
+    Reactor *reactors = calloc(config.reactors, sizeof(Reactor));
+
+    raise_fd_limit();
+    start_worker_pool();
+
+    for (int i = 0; i < config.reactors; i++) {
+        Reactor *r = &reactors[i];
+        struct epoll_event ev;
+
+        r->cpu = -1;
+        if (config.mode == MODE_REUSEPORT) {
+            r->listen_fd = i == 0 ? server_fd : create_listener();
+            if (cpu_count > 0) {
+                r->cpu = cpus[i % cpu_count];
+#ifdef SO_INCOMING_CPU
+                // Prefer this listener for connections whose packets arrive on its core
+                setsockopt(r->listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &r->cpu, sizeof(r->cpu));
+#endif
+            }
+            ev.events = EPOLLIN;
+        } else {
+            r->listen_fd = server_fd;
+            // EPOLLEXCLUSIVE wakes one reactor per incoming connection
+            ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        }
+        fcntl(r->listen_fd, F_SETFL, fcntl(r->listen_fd, F_GETFL) | O_NONBLOCK);
+
+        if ((r->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            perror("epoll_create failed");
+            exit(EXIT_FAILURE);
+        }
+
+        ev.data.ptr = NULL;
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->listen_fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // Workers signal finished jobs through an eventfd
+        pthread_mutex_init(&r->done_lock, NULL);
+        r->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ev.events = EPOLLIN;
+        ev.data.ptr = r;
+        if (r->wake_fd < 0 || epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->wake_fd, &ev) < 0) {
+            perror("eventfd setup failed");
+            exit(EXIT_FAILURE);
+        }
+
+        if (start_thread(&r->thread, reactor_run, r) != 0) {
+            perror("Thread creation failed");
+            exit(EXIT_FAILURE);
+        }
+
+        if (r->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(r->cpu, &set);
+            if (pthread_setaffinity_np(r->thread, sizeof(set), &set) != 0) {
+                fprintf(stderr, "Warning: could not pin reactor %d to CPU %d\n", i, r->cpu);
+            }
+        }
+    }
+
+    printf("Server started on port %d (%s, %d reactors)\n", PORT,
+           config.mode == MODE_REUSEPORT ? "reuseport" : "epoll", config.reactors);
+
+    for (int i = 0; i < config.reactors; i++) {
+        pthread_join(reactors[i].thread, NULL);
+        if (reactors[i].listen_fd != server_fd) {
+            close(reactors[i].listen_fd);
+        }
+    }
+    free(reactors);
+}
+
+// Give a thread's block to the next thread that records
+void metrics_release(void *block) {
+    atomic_store(&((ThreadMetrics *)block)->in_use, 0);
+}
+
+// The calling thread's metrics block, taking over one left by an exited
+// thread before allocating a new one. NULL if out of memory.
+ThreadMetrics *metrics_thread() {
+    ThreadMetrics *m = thread_metrics;
+
+    if (m != NULL) {
+        return m;
+    }
+    for (m = atomic_load(&metrics_blocks); m != NULL; m = m->next) {
+        int idle = 0;
+        if (atomic_compare_exchange_strong(&m->in_use, &idle, 1)) {
+            break;
+        }
+    }
+    if (m == NULL) {
+        m = calloc(1, sizeof(ThreadMetrics));
+        if (m == NULL) {
+            return NULL;
+        }
+        m->id = atomic_fetch_add(&metrics_threads, 1) + 1;
+        atomic_store(&m->in_use, 1);
+        m->next = atomic_load(&metrics_blocks);
+        while (!atomic_compare_exchange_weak(&metrics_blocks, &m->next, m));
+    }
+    thread_metrics = m;
+    pthread_setspecific(metrics_key, m);
+    return m;
+}
+
+// Add to a counter of the calling thread's block
+void metrics_add(atomic_long *counter, long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// Start time of a request, or 0 without metrics or tracing
+long metrics_now() {
+    return config.metrics_port > 0 || config.trace > 0 ? now_ns() : 0;
+}
+
+// Count and trace a request that started at start (from metrics_now)
+void metrics_request(uint16_t opcode, long start, int ok) {
+    if (start == 0 || opcode >= METRIC_OPS || metric_op_names[opcode] == NULL) {
+        return;
+    }
+    trace_span(TRACE_REQUEST, metric_op_names[opcode], NULL, trace_session, start, ok);
+    if (config.metrics_port == 0) {
+        return;
+    }
+    ThreadMetrics *m = metrics_thread();
+    if (m == NULL) {
+        return;
+    }
+
+    long ns = now_ns() - start;
+    int bucket = 0;
+    while (bucket < METRIC_BUCKETS && ns > metric_bounds_ns[bucket]) {
+        bucket++;
+    }
+    metrics_add(&m->requests[opcode], 1);
+    if (!ok) {
+        metrics_add(&m->errors[opcode], 1);
+    }
+    metrics_add(&m->duration_ns[opcode], ns);
+    if (bucket < METRIC_BUCKETS) {
+        metrics_add(&m->buckets[opcode][bucket], 1);
+    }
+}
+
+// Start time of a traced span, or 0 without --trace
+long trace_now() {
+    return config.trace > 0 ? now_ns() : 0;
+}
+
+// Add a span that started at start (from trace_now or metrics_now) and ends
+// now to the calling thread's ring. Only its thread writes a ring, like a
+// seqlock writer: a dump reads it without a lock and drops the spans that
+// may have been overwritten while it copied them.
+void trace_span(TraceKind kind, const char *name, const char *detail, int session, long start, int value) {
+    if (start == 0 || config.trace == 0) {
+        return;
+    }
+    ThreadMetrics *m = metrics_thread();
+    if (m == NULL) {
+        return;
+    }
+    TraceSpan *ring = atomic_load_explicit(&m->trace, memory_order_relaxed);
+    if (ring == NULL) {
+        ring = calloc(TRACE_RING_SPANS, sizeof(TraceSpan));
+        if (ring == NULL) {
+            return;
+        }
+        atomic_store_explicit(&m->trace, ring, memory_order_release);
+    }
+
+    TraceSpan span = { start, now_ns(), name, detail, session, value, kind };
+    unsigned long head = atomic_load_explicit(&m->trace_head, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    seq_store(&ring[head % TRACE_RING_SPANS], &span, sizeof(span));
+    atomic_store_explicit(&m->trace_head, head + 1, memory_order_release);
+}
+
+// Name of a mutex in the lock profile. Mutexes the server has one of (or one
+// array of) are named by address; any other by the expression that locked it.
+const char *lock_name(pthread_mutex_t *mutex, const char *expression) {
+    if (mutex == &course_mutex) {
+        return "course_mutex";
+    } else if (mutex == &student_mutex) {
+        return "student_mutex";
+    } else if (mutex == &faculty_mutex) {
+        return "faculty_mutex";
+    } else if ((void *)mutex >= (void *)course_locks && (void *)mutex < (void *)(course_locks + RECORD_STRIPES)) {
+        return "course record";
+    } else if ((void *)mutex >= (void *)student_locks && (void *)mutex < (void *)(student_locks + RECORD_STRIPES)) {
+        return "student record";
+    } else if ((void *)mutex >= (void *)faculty_locks && (void *)mutex < (void *)(faculty_locks + RECORD_STRIPES)) {
+        return "faculty record";
+    } else if (mutex == &pool.lock) {
+        return "pool.lock";
+    } else if (mutex == &persist.lock) {
+        return "persist.lock";
+    } else if (mutex == &wal.lock) {
+        return "wal.lock";
+    } else if (mutex == &wal.checkpoint) {
+        return "wal.checkpoint";
+    }
+    return expression[0] == '&' ? expression + 1 : expression;
+}
+
+// Profile of one function taking one mutex, claiming a slot the first time.
+// NULL once every slot is taken.
+LockProfile *lock_profile_find(const char *function, const char *lock) {
+    unsigned hash = 2166136261u;
+    for (const char *c = function; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    for (const char *c = lock; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    unsigned start = hash % LOCK_PROFILE_SLOTS;
+    for (int i = 0; i < LOCK_PROFILE_SLOTS; i++) {
+        LockProfile *p = &lock_profiles[(start + i) % LOCK_PROFILE_SLOTS];
+        const char *f = atomic_load_explicit(&p->function, memory_order_acquire);
+        if (f == NULL) {
+            break;
+        }
+        if (strcmp(f, function) == 0 && strcmp(p->lock, lock) == 0) {
+            return p;
+        }
+    }
+
+    // Not found: search again under the insert lock, which also covers the
+    // slots claimed since
+    LockProfile *found = NULL;
+    pthread_mutex_lock(&lock_profile_insert);
+    for (int i = 0; i < LOCK_PROFILE_SLOTS && found == NULL; i++) {
+        LockProfile *p = &lock_profiles[(start + i) % LOCK_PROFILE_SLOTS];
+        const char *f = atomic_load_explicit(&p->function, memory_order_relaxed);
+        if (f == NULL) {
+            p->lock = lock;
+            atomic_store_explicit(&p->function, function, memory_order_release);
+            found = p;
+        } else if (strcmp(f, function) == 0 && strcmp(p->lock, lock) == 0) {
+            found = p;
+        }
+    }
+    pthread_mutex_unlock(&lock_profile_insert);
+    return found;
+}
+
+// The calling thread's entry for a mutex it holds, or NULL if it is not timed
+HeldLock *lock_profile_held(pthread_mutex_t *mutex) {
+    for (int i = held_count - 1; i >= 0; i--) {
+        if (held_locks[i].mutex == mutex) {
+            return &held_locks[i];
+        }
+    }
+    return NULL;
+}
+
+// Charge the time since held->since to its profile
+void lock_profile_hold(HeldLock *held) {
+    long ns = now_ns() - held->since;
+    long max = atomic_load_explicit(&held->profile->max_hold_ns, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&held->profile->hold_ns, ns, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&held->profile->max_hold_ns, &max, ns,
+                                                              memory_order_relaxed, memory_order_relaxed));
+}
+
+// Lock a mutex for function. Only when a profile, metric or trace wants it is
+// the mutex tried first and the wait timed: --metrics counts the waits for
+// the three global mutexes, --lock-profile the waits and holds of every
+// mutex, and --trace adds a span for every wait.
+void profile_lock(pthread_mutex_t *mutex, const char *function, const char *expression) {
+    int global = mutex == &course_mutex ? LOCK_COURSE : mutex == &student_mutex ? LOCK_STUDENT :
+                 mutex == &faculty_mutex ? LOCK_FACULTY : -1;
+    int contended = 0;
+    long wait = 0;
+
+    if (!config.lock_profile && config.trace == 0 && (config.metrics_port == 0 || global < 0)) {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+    if (pthread_mutex_trylock(mutex) != 0) {
+        long start = now_ns();
+        pthread_mutex_lock(mutex);
+        wait = now_ns() - start;
+        contended = 1;
+        trace_span(TRACE_LOCK, lock_name(mutex, expression), function, trace_session, start, 0);
+    }
+
+    if (config.metrics_port > 0 && global >= 0) {
+        ThreadMetrics *m = metrics_thread();
+        if (m != NULL) {
+            metrics_add(&m->lock_acquired[global], 1);
+            metrics_add(&m->lock_contended[global], contended);
+            metrics_add(&m->lock_wait_ns[global], wait);
+        }
+    }
+
+    if (config.lock_profile) {
+        LockProfile *p = lock_profile_find(function, lock_name(mutex, expression));
+        if (p == NULL) {
+            return;
+        }
+        atomic_fetch_add_explicit(&p->acquired, 1, memory_order_relaxed);
+        if (contended) {
+            atomic_fetch_add_explicit(&p->contended, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&p->wait_ns, wait, memory_order_relaxed);
+        }
+        if (held_count < LOCK_PROFILE_DEPTH) {
+            held_locks[held_count++] = (HeldLock){ mutex, p, now_ns() };
+        }
+    }
+}
+
+void profile_unlock(pthread_mutex_t *mutex) {
+    if (config.lock_profile) {
+        HeldLock *held = lock_profile_held(mutex);
+        if (held != NULL) {
+            lock_profile_hold(held);
+            *held = held_locks[--held_count];
+        }
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+// Wait on a condition variable; the time asleep does not count as holding
+// the mutex
+void profile_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    HeldLock *held = config.lock_profile ? lock_profile_held(mutex) : NULL;
+
+    if (held != NULL) {
+        lock_profile_hold(held);
+    }
+    pthread_cond_wait(cond, mutex);
+    if (held != NULL) {
+        held->since = now_ns();
+    }
+}
+
+// Write the metrics of all threads in the Prometheus text format
+void metrics_render(Buffer *b) {
+    long requests[METRIC_OPS] = {0}, errors[METRIC_OPS] = {0}, duration_ns[METRIC_OPS] = {0};
+    long buckets[METRIC_OPS][METRIC_BUCKETS] = {{0}};
+    long acquired[LOCK_COUNT] = {0}, contended[LOCK_COUNT] = {0}, wait_ns[LOCK_COUNT] = {0};
+
+    for (ThreadMetrics *m = atomic_load(&metrics_blocks); m != NULL; m = m->next) {
+        for (int op = 0; op < METRIC_OPS; op++) {
+            requests[op] += atomic_load_explicit(&m->requests[op], memory_order_relaxed);
+            errors[op] += atomic_load_explicit(&m->errors[op], memory_order_relaxed);
+            duration_ns[op] += atomic_load_explicit(&m->duration_ns[op], memory_order_relaxed);
+            for (int i = 0; i < METRIC_BUCKETS; i++) {
+                buckets[op][i] += atomic_load_explicit(&m->buckets[op][i], memory_order_relaxed);
+            }
+        }
+        for (int lock = 0; lock < LOCK_COUNT; lock++) {
+            acquired[lock] += atomic_load_explicit(&m->lock_acquired[lock], memory_order_relaxed);
+            contended[lock] += atomic_load_explicit(&m->lock_contended[lock], memory_order_relaxed);
+            wait_ns[lock] += atomic_load_explicit(&m->lock_wait_ns[lock], memory_order_relaxed);
+        }
+    }
+
+    buffer_puts(b, "# HELP academia_requests_total Requests handled, by operation.\n"
+                   "# TYPE academia_requests_total counter\n");
+    for (int op = 0; op < METRIC_OPS; op++) {
+        if (metric_op_names[op] != NULL) {
+            buffer_printf(b, "academia_requests_total{op=\"%s\"} %ld\n", metric_op_names[op], requests[op]);
+        }
+    }
+    buffer_puts(b, "# HELP academia_request_errors_total Requests answered with a status other than OK.\n"
+                   "# TYPE academia_request_errors_total counter\n");
+    for (int op = 0; op < METRIC_OPS; op++) {
+        if (metric_op_names[op] != NULL) {
+            buffer_printf(b, "academia_request_errors_total{op=\"%s\"} %ld\n", metric_op_names[op], errors[op]);
+        }
+    }
+    buffer_puts(b, "# HELP academia_request_duration_seconds Time from reading a request to queueing its reply.\n"
+                   "# TYPE academia_request_duration_seconds histogram\n");
+    for (int op = 0; op < METRIC_OPS; op++) {
+        if (metric_op_names[op] == NULL) {
+            continue;
+        }
+        long cumulative = 0;
+        for (int i = 0; i < METRIC_BUCKETS; i++) {
+            cumulative += buckets[op][i];
+            buffer_printf(b, "academia_request_duration_seconds_bucket{op=\"%s\",le=\"%g\"} %ld\n",
+                          metric_op_names[op], metric_bounds_ns[i] / 1e9, cumulative);
+        }
+        buffer_printf(b, "academia_request_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %ld\n",
+                      metric_op_names[op], requests[op]);
+        buffer_printf(b, "academia_request_duration_seconds_sum{op=\"%s\"} %.9f\n", metric_op_names[op], duration_ns[op] / 1e9);
+        buffer_printf(b, "academia_request_duration_seconds_count{op=\"%s\"} %ld\n", metric_op_names[op], requests[op]);
+    }
+
+    long opened = atomic_load(&sessions_opened), closed = atomic_load(&sessions_closed);
+    buffer_printf(b, "# HELP academia_sessions_active Connected sessions.\n"
+                     "# TYPE academia_sessions_active gauge\n"
+                     "academia_sessions_active %ld\n"
+                     "# HELP academia_sessions_total Sessions opened since startup.\n"
+                     "# TYPE academia_sessions_total counter\n"
+                     "academia_sessions_total %ld\n", opened - closed, opened);
+
+    buffer_puts(b, "# HELP academia_lock_acquisitions_total Acquisitions of the global mutexes.\n"
+                   "# TYPE academia_lock_acquisitions_total counter\n");
+    for (int lock = 0; lock < LOCK_COUNT; lock++) {
+        buffer_printf(b, "academia_lock_acquisitions_total{lock=\"%s\"} %ld\n", lock_names[lock], acquired[lock]);
+    }
+    buffer_puts(b, "# HELP academia_lock_contended_total Acquisitions that had to wait for another thread.\n"
+                   "# TYPE academia_lock_contended_total counter\n");
+    for (int lock = 0; lock < LOCK_COUNT; lock++) {
+        buffer_printf(b, "academia_lock_contended_total{lock=\"%s\"} %ld\n", lock_names[lock], contended[lock]);
+    }
+    buffer_puts(b, "# HELP academia_lock_wait_seconds_total Time spent waiting for the global mutexes.\n"
+                   "# TYPE academia_lock_wait_seconds_total counter\n");
+    for (int lock = 0; lock < LOCK_COUNT; lock++) {
+        buffer_printf(b, "academia_lock_wait_seconds_total{lock=\"%s\"} %.9f\n", lock_names[lock], wait_ns[lock] / 1e9);
+    }
+}
+
+// Metrics thread: answer GET /metrics over HTTP, one scrape at a time
+void *metrics_run(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    char request[BUFFER_SIZE];
+
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("Metrics accept failed");
+            }
+            continue;
+        }
+
+        // A scraper that sends nothing does not hold up the next one
+        struct timeval timeout = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t n = read(fd, request, sizeof(request) - 1);
+        if (n > 0) {
+            Buffer body = {0}, reply = {0};
+            request[n] = '\0';
+            if (strncmp(request, "GET /metrics", 12) == 0 && (request[12] == ' ' || request[12] == '?')) {
+                metrics_render(&body);
+                buffer_printf(&reply, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                      "Content-Length: %zu\r\n\r\n", body.len);
+                buffer_append(&reply, body.data, body.len);
+            } else {
+                buffer_puts(&reply, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            }
+            write_all(fd, reply.data, reply.len);
+            buffer_free(&body);
+            buffer_free(&reply);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+// Serve the metrics on 127.0.0.1:config.metrics_port, if set
+void start_metrics() {
+    struct sockaddr_in address = {0};
+    pthread_t thread;
+    int opt = 1;
+
+    if (config.metrics_port == 0) {
+        return;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(config.metrics_port);
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        perror("Metrics listener failed");
+        exit(EXIT_FAILURE);
+    }
+    if (start_thread(&thread, metrics_run, (void *)(intptr_t)fd) != 0) {
+        perror("Thread creation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+    printf("Metrics on http://127.0.0.1:%d/metrics\n", config.metrics_port);
+}
+
+// Order lock profiles by total hold time, longest first
+int lock_profile_compare(const void *a, const void *b) {
+    long x = atomic_load(&(*(LockProfile *const *)a)->hold_ns);
+    long y = atomic_load(&(*(LockProfile *const *)b)->hold_ns);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Print the lock profile, the function that held a mutex longest first
+void lock_profile_report(FILE *out) {
+    LockProfile *rows[LOCK_PROFILE_SLOTS];
+    int count = 0;
+
+    for (int i = 0; i < LOCK_PROFILE_SLOTS; i++) {
+        if (atomic_load(&lock_profiles[i].function) != NULL) {
+            rows[count++] = &lock_profiles[i];
+        }
+    }
+    qsort(rows, count, sizeof(rows[0]), lock_profile_compare);
+
+    fprintf(out, "%-28s %-16s %10s %10s %10s %10s %10s %10s\n", "function", "lock", "acquired", "contended",
+            "wait_ms", "hold_ms", "avg_us", "max_us");
+    for (int i = 0; i < count; i++) {
+        LockProfile *p = rows[i];
+        long acquired = atomic_load(&p->acquired), hold_ns = atomic_load(&p->hold_ns);
+        fprintf(out, "%-28s %-16s %10ld %10ld %10.3f %10.3f %10.3f %10.3f\n", atomic_load(&p->function), p->lock,
+                acquired, atomic_load(&p->contended), atomic_load(&p->wait_ns) / 1e6, hold_ns / 1e6,
+                acquired > 0 ? hold_ns / 1e3 / acquired : 0.0, atomic_load(&p->max_hold_ns) / 1e3);
+    }
+    fflush(out);
+}
+
+// Write one thread's spans that ended at or after since as trace events
+void trace_dump_ring(FILE *out, ThreadMetrics *m, long since, int *events) {
+    static const char *value_keys[TRACE_KINDS] = { "ok", "bytes", NULL, "bytes", "bytes" };
+    static const char *detail_keys[TRACE_KINDS] = { NULL, NULL, "function", "file", NULL };
+    TraceSpan *ring = atomic_load_explicit(&m->trace, memory_order_acquire);
+    TraceSpan span;
+
+    if (ring == NULL) {
+        return;
+    }
+    unsigned long head = atomic_load_explicit(&m->trace_head, memory_order_acquire);
+    for (unsigned long i = head > TRACE_RING_SPANS ? head - TRACE_RING_SPANS : 0; i < head; i++) {
+        seq_load(&span, &ring[i % TRACE_RING_SPANS], sizeof(span));
+        atomic_thread_fence(memory_order_acquire);
+        // The thread may have written over the span since
+        if (i + TRACE_RING_SPANS <= atomic_load_explicit(&m->trace_head, memory_order_relaxed) ||
+            span.end_ns < since || span.kind < 0 || span.kind >= TRACE_KINDS) {
+            continue;
+        }
+
+        fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":%d,\"tid\":%d,\"args\":{\"session\":%d",
+                *events > 0 ? "," : "", span.name, trace_kinds[span.kind], span.start_ns / 1e3,
+                (span.end_ns - span.start_ns) / 1e3, getpid(), m->id, span.session);
+        if (value_keys[span.kind] != NULL) {
+            fprintf(out, ",\"%s\":%d", value_keys[span.kind], span.value);
+        }
+        if (detail_keys[span.kind] != NULL && span.detail != NULL) {
+            fprintf(out, ",\"%s\":\"%s\"", detail_keys[span.kind], span.detail);
+        }
+        fprintf(out, "}}");
+        (*events)++;
+    }
+}
+
+// Write the spans of every thread that ended in the last seconds to
+// trace-<time>-<n>.json in the current directory, in the Chrome trace event
+// format that Perfetto and chrome://tracing open. Returns the number of
+// spans and the file name in path, or -1.
+int trace_dump(long seconds, char *path, size_t size) {
+    static atomic_int dumps;
+    long since = now_ns() - seconds * 1000000000L;
+    int events = 0;
+
+    snprintf(path, size, "trace-%ld-%d.json", (long)time(NULL), atomic_fetch_add(&dumps, 1));
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror("Error creating trace file");
+        return -1;
+    }
+    fprintf(out, "{\"traceEvents\":[");
+    for (ThreadMetrics *m = atomic_load(&metrics_blocks); m != NULL; m = m->next) {
+        trace_dump_ring(out, m, since, &events);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    if (fclose(out) != 0) {
+        perror("Error writing trace file");
+        return -1;
+    }
+    return events;
+}
+
+// Signal thread: exit on SIGINT or SIGTERM once queued record writes reach
+// the disk, print the lock profile on SIGUSR1 and dump the trace on SIGUSR2.
+// Running here rather than in a signal handler, it can take locks and wait
+// like any other thread.
+void *signal_run(void *arg) {
+    sigset_t *signals = arg;
+    char path[64];
+    int sig;
+
+    while (sigwait(signals, &sig) == 0) {
+        if (sig == SIGINT || sig == SIGTERM) {
+            storage_flush();
+            exit(0);
+        } else if (sig == SIGUSR1) {
+            lock_profile_report(stderr);
+        } else {
+            int spans = trace_dump(config.trace, path, sizeof(path));
+            if (spans >= 0) {
+                fprintf(stderr, "Trace of the last %d s written to %s (%d spans)\n", config.trace, path, spans);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Leave SIGINT, SIGTERM, SIGUSR1 (--lock-profile) and SIGUSR2 (--trace) to
+// the signal thread. Called before any other thread starts, so they all
+// inherit the blocked signals.
+void start_signals() {
+    static sigset_t signals;
+    pthread_t thread;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if (config.lock_profile) {
+        sigaddset(&signals, SIGUSR1);
+        printf("Lock profile on SIGUSR1 (kill -USR1 %d)\n", getpid());
+    }
+    if (config.trace > 0) {
+        sigaddset(&signals, SIGUSR2);
+        printf("Trace dump on SIGUSR2 (kill -USR2 %d)\n", getpid());
+    }
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    if (start_thread(&thread, signal_run, &signals) != 0) {
+        perror("Thread creation failed");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+// Seqlocks. A writer, already serialised by a lock, makes the sequence odd
+// while it changes the data. A reader takes no lock: it copies the data and
+// starts over if the sequence was odd or has moved on since.
+void seq_write_begin(atomic_uint *seq) {
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void seq_write_end(atomic_uint *seq) {
+    atomic_fetch_add_explicit(seq, 1, memory_order_release);
+}
+
+unsigned seq_read_begin(atomic_uint *seq) {
+    unsigned start;
+    while ((start = atomic_load_explicit(seq, memory_order_acquire)) & 1) {
+        sched_yield();
+    }
+    return start;
+}
+
+// Nonzero if the copy made since seq_read_begin() must be thrown away
+int seq_read_retry(atomic_uint *seq, unsigned start) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(seq, memory_order_relaxed) != start;
+}
+
+// Copy out of / into seqlocked data a word at a time with relaxed atomics,
+// so a reader overlapping a writer gets a torn copy rather than undefined
+// behaviour. shared must be 4-byte aligned.
+void seq_load(void *dest, const void *shared, size_t size) {
+    const uint32_t *words = shared;
+    size_t i;
+
+    for (i = 0; i < size / 4; i++) {
+        uint32_t word = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+        memcpy((char *)dest + i * 4, &word, 4);
+    }
+    for (i *= 4; i < size; i++) {
+        ((char *)dest)[i] = __atomic_load_n((const char *)shared + i, __ATOMIC_RELAXED);
+    }
+}
+
+void seq_store(void *shared, const void *src, size_t size) {
+    uint32_t *words = shared;
+    size_t i;
+
+    for (i = 0; i < size / 4; i++) {
+        uint32_t word;
+        memcpy(&word, (const char *)src + i * 4, 4);
+        __atomic_store_n(&words[i], word, __ATOMIC_RELAXED);
+    }
+    for (i *= 4; i < size; i++) {
+        __atomic_store_n((char *)shared + i, ((const char *)src)[i], __ATOMIC_RELAXED);
+    }
+}
+
+// File offset of record id
+off_t table_offset(Table *t, int id) {
+    return t->base + (off_t)id * t->record_size;
+}
+
+// Open a record file and, with memory storage, load all of its records. A new
+// file gets a header; an existing one must be in the current format.
+int table_open(Table *t, const char *path, size_t record_size) {
+    struct stat st;
+    FileHeader header;
+
+    t->path = path;
+    t->record_size = record_size;
+    t->base = sizeof(FileHeader);
+    pthread_rwlock_init(&t->lock, NULL);
+    pthread_mutex_init(&t->snapshot.lock, NULL);
+
+    t->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (t->fd == -1 || fstat(t->fd, &st) == -1) {
+        perror("Error opening data file");
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RECORD_MAGIC, RECORD_MAGIC_LEN);
+        header.version = RECORD_VERSION;
+        header.record_size = record_size;
+        if (pwrite(t->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            perror("Error writing data file");
+            return -1;
+        }
+        st.st_size = sizeof(header);
+    } else if (pread(t->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+               memcmp(header.magic, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0 ||
+               header.version != RECORD_VERSION || header.record_size != record_size) {
+        fprintf(stderr, "%s: unsupported data file format, convert it with ./migrate\n", path);
+        return -1;
+    }
+    int count = (st.st_size - t->base) / record_size;
+
+    if (config.storage == STORAGE_MEMORY) {
+        for (int first = 0; first < count; first += TABLE_CHUNK_RECORDS) {
+            int n = count - first < TABLE_CHUNK_RECORDS ? count - first : TABLE_CHUNK_RECORDS;
+            if (table_grow(t, first) < 0 ||
+                pread(t->fd, t->chunks[first / TABLE_CHUNK_RECORDS], n * record_size,
+                      table_offset(t, first)) != (ssize_t)(n * record_size)) {
+                perror("Error loading data file");
+                return -1;
+            }
+        }
+    } else if (config.storage == STORAGE_MMAP) {
+        // Map room for the largest table, so the mapping never moves under a
+        // reader; pages past the end of the file are only touched after
+        // table_grow() extends it
+        t->map_records = TABLE_MAX_CHUNKS * TABLE_CHUNK_RECORDS;
+        if (count > t->map_records) {
+            fprintf(stderr, "%s: too many records\n", path);
+            return -1;
+        }
+        t->map = mmap(NULL, table_offset(t, t->map_records), PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+        if (t->map == MAP_FAILED) {
+            t->map = NULL;
+            perror("Error mapping data file");
+            return -1;
+        }
+    }
+    atomic_store(&t->count, count);
+    return 0;
+}
+
+// Make room for record id: allocate its chunk (memory storage) or extend
+// the file under its mapping (mmap storage)
+int table_grow(Table *t, int id) {
+    int chunk = id / TABLE_CHUNK_RECORDS;
+
+    if (config.storage == STORAGE_MMAP) {
+        if (id >= t->map_records || ftruncate(t->fd, table_offset(t, id + 1)) == -1) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (chunk >= TABLE_MAX_CHUNKS) {
+        return -1;
+    }
+    if (t->chunks[chunk] == NULL) {
+        t->chunks[chunk] = calloc(TABLE_CHUNK_RECORDS, t->record_size);
+        if (t->chunks[chunk] == NULL) {
+            return -1;
+        }
+    }
+    if (config.persist == PERSIST_ASYNC && id >= t->dirty_cap) {
+        // The writer reads the flags under the lock, so swap them under it too
+        int cap = (chunk + 1) * TABLE_CHUNK_RECORDS;
+        pthread_rwlock_wrlock(&t->lock);
+        char *dirty = realloc(t->dirty, cap);
+        if (dirty != NULL) {
+            memset(dirty + t->dirty_cap, 0, cap - t->dirty_cap);
+            t->dirty = dirty;
+            t->dirty_cap = cap;
+        }
+        pthread_rwlock_unlock(&t->lock);
+        if (dirty == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Address of a record in memory or mmap storage
+char *table_slot(Table *t, int id) {
+    if (t->map != NULL) {
+        return t->map + table_offset(t, id);
+    }
+    return t->chunks[id / TABLE_CHUNK_RECORDS] + (size_t)(id % TABLE_CHUNK_RECORDS) * t->record_size;
+}
+
+int table_count(Table *t) {
+    return atomic_load(&t->count);
+}
+
+// Copy record id into record
+Status table_read(Table *t, int id, void *record) {
+    // An operation sees the changes it has not committed yet
+    if (wal_txn != NULL) {
+        int i = wal_find(t, id);
+        if (i >= 0) {
+            memcpy(record, wal_txn->entry.data + wal_txn->changes[i].offset, t->record_size);
+            return STATUS_OK;
+        }
+    }
+
+    if (id < 0 || id >= table_count(t)) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (config.storage == STORAGE_FILE) {
+        long start = trace_now();
+        ssize_t n = pread(t->fd, record, t->record_size, table_offset(t, id));
+        trace_span(TRACE_FILE, "pread", t->path, trace_session, start, n);
+        return n == (ssize_t)t->record_size ? STATUS_OK : STATUS_NOT_FOUND;
+    }
+
+    atomic_uint *seq = &t->seq[id % RECORD_STRIPES];
+    unsigned start;
+    do {
+        start = seq_read_begin(seq);
+        seq_load(record, table_slot(t, id), t->record_size);
+    } while (seq_read_retry(seq, start));
+    return STATUS_OK;
+}
+
+// Copy record into its slot (memory or mmap storage, lock held)
+void table_store(Table *t, int id, const void *record) {
+    atomic_uint *seq = &t->seq[id % RECORD_STRIPES];
+    seq_write_begin(seq);
+    seq_store(table_slot(t, id), record, t->record_size);
+    seq_write_end(seq);
+}
+
+// Change record id. With the log enabled the change is part of the running
+// operation and stored when it commits; otherwise it is stored right away.
+Status table_write(Table *t, int id, const void *record) {
+    if (wal_txn != NULL) {
+        return wal_stash(t, id, record);
+    }
+    return table_put(t, id, record);
+}
+
+// Store record id and persist it according to the storage configuration
+Status table_put(Table *t, int id, const void *record) {
+    int queued = 0;
+
+    if (config.storage == STORAGE_MMAP) {
+        pthread_rwlock_wrlock(&t->lock);
+        snapshot_keep(t, id);
+        table_store(t, id, record);
+        Status status = table_sync(t, id, 1);
+        pthread_rwlock_unlock(&t->lock);
+        return status;
+    }
+
+    if (config.storage == STORAGE_MEMORY) {
+        pthread_rwlock_wrlock(&t->lock);
+        snapshot_keep(t, id);
+        table_store(t, id, record);
+        if (config.persist == PERSIST_ASYNC) {
+            // The writer copies the latest version, so one queued write per record is enough
+            if (!t->dirty[id]) {
+                t->dirty[id] = 1;
+                queued = 1;
+            }
+            pthread_rwlock_unlock(&t->lock);
+            if (queued) {
+                persist_enqueue(t, id);
+            }
+            return STATUS_OK;
+        }
+        pthread_rwlock_unlock(&t->lock);
+    }
+
+    // File storage writers share the lock; it only keeps snapshot_begin() out
+    if (config.storage == STORAGE_FILE) {
+        pthread_rwlock_rdlock(&t->lock);
+        snapshot_keep(t, id);
+    }
+    long start = trace_now();
+    ssize_t written = pwrite(t->fd, record, t->record_size, table_offset(t, id));
+    trace_span(TRACE_FILE, "pwrite", t->path, trace_session, start, written);
+    if (config.storage == STORAGE_FILE) {
+        pthread_rwlock_unlock(&t->lock);
+    }
+    if (written != (ssize_t)t->record_size) {
+        perror("Error writing data file");
+        return STATUS_ERROR;
+    }
+    return STATUS_OK;
+}
+
+// Add a record after the last one; its ID is the previous table_count()
+Status table_append(Table *t, const void *record) {
+    int id = table_count(t);
+
+    if (config.storage != STORAGE_FILE && table_grow(t, id) < 0) {
+        return STATUS_ERROR;
+    }
+    Status status = table_write(t, id, record);
+    if (status == STATUS_OK && wal_txn == NULL) {
+        atomic_store(&t->count, id + 1);
+    }
+    return status;
+}
+
+// Add count records after the last one; their IDs start at the previous
+// table_count(). They go to the data file in one write rather than one per
+// record: nobody can read or change them before the count moves past them,
+// so with async persistence they bypass the writer's queue too. With the log
+// enabled they are part of the running operation, which must not have
+// appended anything else.
+Status table_append_many(Table *t, const void *records, int count) {
+    int first = table_count(t);
+    size_t size = (size_t)count * t->record_size;
+    const char *record = records;
+    Status status = STATUS_OK;
+
+    if (count == 0) {
+        return STATUS_OK;
+    }
+    if (config.storage == STORAGE_MEMORY) {
+        for (int id = first; id < first + count; id = (id / TABLE_CHUNK_RECORDS + 1) * TABLE_CHUNK_RECORDS) {
+            if (table_grow(t, id) < 0) {
+                return STATUS_ERROR;
+            }
+        }
+    }
+    if (config.storage != STORAGE_FILE && table_grow(t, first + count - 1) < 0) {
+        return STATUS_ERROR;
+    }
+
+    if (wal_txn != NULL) {
+        for (int i = 0; i < count && status == STATUS_OK; i++) {
+            status = wal_add(t, first + i, record + i * t->record_size);
+        }
+        return status;
+    }
+
+    if (config.storage != STORAGE_FILE) {
+        pthread_rwlock_wrlock(&t->lock);
+        for (int i = 0; i < count; i++) {
+            table_store(t, first + i, record + i * t->record_size);
+        }
+        if (t->map != NULL) {
+            status = table_sync(t, first, count);
+        }
+        pthread_rwlock_unlock(&t->lock);
+    }
+    if (t->map == NULL) {
+        long start = trace_now();
+        ssize_t written = pwrite(t->fd, records, size, table_offset(t, first));
+        trace_span(TRACE_FILE, "pwrite", t->path, trace_session, start, written);
+        if (written != (ssize_t)size) {
+            perror("Error writing data file");
+            status = STATUS_ERROR;
+        }
+    }
+    if (status == STATUS_OK) {
+        atomic_store(&t->count, first + count);
+    }
+    return status;
+}
+
+// Store a record replayed from the log; table_write_back() writes it to its
+// data file once, however many entries changed it
+Status table_restore(Table *t, int id, const void *record) {
+    if (id < 0 || id > table_count(t) || table_grow(t, id) < 0) {
+        return STATUS_ERROR;
+    }
+    table_store(t, id, record);
+    t->dirty[id] = 1;
+    if (id == table_count(t)) {
+        atomic_store(&t->count, id + 1);
+    }
+    return STATUS_OK;
+}
+
+// Write every record marked dirty to the data file (startup, before the
+// background writer runs)
+void table_write_back(Table *t) {
+    for (int id = 0; id < table_count(t); id++) {
+        if (t->dirty[id]) {
+            t->dirty[id] = 0;
+            if (pwrite(t->fd, table_slot(t, id), t->record_size, table_offset(t, id)) != (ssize_t)t->record_size) {
+                perror("Error writing data file");
+            }
+        }
+    }
+}
+
+// Keep the current version of record id for a running export before it is
+// changed (table lock held). Records added after the snapshot, or already
+// exported, are not kept.
+void snapshot_keep(Table *t, int id) {
+    TableSnapshot *snap = &t->snapshot;
+
+    if (!snap->active || id >= snap->count) {
+        return;
+    }
+    mutex_lock(&snap->lock);
+    if (id >= snap->cursor && !snap->failed) {
+        char ***block = &snap->saved[id / SNAPSHOT_CHUNK];
+        if (*block == NULL) {
+            *block = calloc(SNAPSHOT_CHUNK, sizeof(char *));
+        }
+        char **kept = *block != NULL ? &(*block)[id % SNAPSHOT_CHUNK] : NULL;
+        if (kept != NULL && *kept == NULL) {
+            *kept = malloc(t->record_size);
+            if (*kept != NULL && table_read(t, id, *kept) != STATUS_OK) {
+                free(*kept);
+                *kept = NULL;
+            }
+        }
+        snap->failed = kept == NULL || *kept == NULL;
+    }
+    mutex_unlock(&snap->lock);
+}
+
+// Read record id as it was when the snapshot was taken. A writer keeps the
+// old version under the snapshot lock before changing the record, so a record
+// with no kept version still holds the snapshot's version while it is read.
+Status snapshot_read(Table *t, int id, void *record) {
+    TableSnapshot *snap = &t->snapshot;
+    Status status = STATUS_OK;
+
+    if (id < 0 || id >= snap->count) {
+        return STATUS_NOT_FOUND;
+    }
+    mutex_lock(&snap->lock);
+    char **block = snap->saved[id / SNAPSHOT_CHUNK];
+    if (snap->failed) {
+        status = STATUS_ERROR;
+    } else if (block != NULL && block[id % SNAPSHOT_CHUNK] != NULL) {
+        memcpy(record, block[id % SNAPSHOT_CHUNK], t->record_size);
+    } else {
+        status = table_read(t, id, record);
+    }
+    mutex_unlock(&snap->lock);
+    return status;
+}
+
+// Free the versions kept in a block of the snapshot (snapshot lock held, or
+// the snapshot inactive)
+void snapshot_free_block(TableSnapshot *snap, int block) {
+    if (snap->saved[block] != NULL) {
+        for (int i = 0; i < SNAPSHOT_CHUNK; i++) {
+            free(snap->saved[block][i]);
+        }
+        free(snap->saved[block]);
+        snap->saved[block] = NULL;
+    }
+}
+
+// The export has read every record below cursor; stop keeping them
+void snapshot_advance(Table *t, int cursor) {
+    TableSnapshot *snap = &t->snapshot;
+
+    mutex_lock(&snap->lock);
+    for (int block = snap->cursor / SNAPSHOT_CHUNK; block < cursor / SNAPSHOT_CHUNK; block++) {
+        snapshot_free_block(snap, block);
+    }
+    snap->cursor = cursor;
+    mutex_unlock(&snap->lock);
+}
+
+// Snapshot the student, faculty and course tables at one instant for an
+// export. With the log enabled no commit is half stored at that instant.
+// Returns -1 if another export holds the snapshots.
+int snapshot_begin() {
+    Table *tables[] = { &student_table, &faculty_table, &course_table };
+    int result = 0;
+
+    if (atomic_exchange(&export_running, 1)) {
+        return -1;
+    }
+    if (config.wal != WAL_OFF) {
+        // No commit can start while the lock is held; let those still storing finish
+        mutex_lock(&wal.lock);
+        while (atomic_load(&wal.storing) > 0) {
+            sched_yield();
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        pthread_rwlock_wrlock(&tables[i]->lock);
+    }
+    for (int i = 0; i < 3 && result == 0; i++) {
+        TableSnapshot *snap = &tables[i]->snapshot;
+        snap->count = table_count(tables[i]);
+        snap->cursor = 0;
+        snap->failed = 0;
+        snap->saved = calloc(snap->count / SNAPSHOT_CHUNK + 1, sizeof(char **));
+        if (snap->saved == NULL) {
+            result = -1;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        tables[i]->snapshot.active = result == 0;
+        pthread_rwlock_unlock(&tables[i]->lock);
+    }
+    if (config.wal != WAL_OFF) {
+        mutex_unlock(&wal.lock);
+    }
+
+    if (result < 0) {
+        for (int i = 0; i < 3; i++) {
+            free(tables[i]->snapshot.saved);
+            tables[i]->snapshot.saved = NULL;
+        }
+        atomic_store(&export_running, 0);
+    }
+    return result;
+}
+
+// Drop the snapshots and every version kept for them
+void snapshot_end() {
+    Table *tables[] = { &student_table, &faculty_table, &course_table };
+
+    for (int i = 0; i < 3; i++) {
+        TableSnapshot *snap = &tables[i]->snapshot;
+        pthread_rwlock_wrlock(&tables[i]->lock);
+        snap->active = 0;
+        pthread_rwlock_unlock(&tables[i]->lock);
+        for (int block = 0; block <= snap->count / SNAPSHOT_CHUNK; block++) {
+            snapshot_free_block(snap, block);
+        }
+        free(snap->saved);
+        snap->saved = NULL;
+    }
+    atomic_store(&export_running, 0);
+}
+
+// Apply the msync policy to the pages holding count records from id (mmap
+// storage, lock held)
+Status table_sync(Table *t, int id, int count) {
+    if (config.msync == MSYNC_NONE) {
+        return STATUS_OK;
+    }
+
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)table_slot(t, id) & ~(page - 1);
+    uintptr_t end = (uintptr_t)table_slot(t, id) + count * t->record_size;
+    long traced = trace_now();
+    int result = msync((void *)start, end - start, config.msync == MSYNC_SYNC ? MS_SYNC : MS_ASYNC);
+    trace_span(TRACE_FILE, "msync", t->path, trace_session, traced, end - start);
+    if (result == -1) {
+        perror("Error syncing data file");
+        return STATUS_ERROR;
+    }
+    return STATUS_OK;
+}
+
+// Queue a changed record for the background writer. If the queue is full and
+// cannot grow, waits for the writer to make room.
+void persist_enqueue(Table *t, int id) {
+    mutex_lock(&persist.lock);
+    while (persist.count == persist.capacity) {
+        int capacity = persist.capacity ? persist.capacity * 2 : 1024;
+        DirtyRecord *items = malloc(capacity * sizeof(DirtyRecord));
+        if (items == NULL) {
+            if (persist.capacity == 0) {
+                abort();
+            }
+            mutex_wait(&persist.advanced, &persist.lock);
+            continue;
+        }
+        for (int i = 0; i < persist.count; i++) {
+            items[i] = persist.items[(persist.head + i) % persist.capacity];
+        }
+        free(persist.items);
+        persist.items = items;
+        persist.capacity = capacity;
+        persist.head = 0;
+    }
+    persist.items[(persist.head + persist.count) % persist.capacity] = (DirtyRecord){ t, id };
+    persist.count++;
+    persist.queued++;
+    pthread_cond_signal(&persist.not_empty);
+    mutex_unlock(&persist.lock);
+}
+
+// Background writer for async persistence: writes the current version of
+// each changed record
+void *persist_run(void *arg) {
+    (void)arg;
+    while (1) {
+        mutex_lock(&persist.lock);
+        while (persist.count == 0) {
+            mutex_wait(&persist.not_empty, &persist.lock);
+        }
+        DirtyRecord item = persist.items[persist.head];
+        persist.head = (persist.head + 1) % persist.capacity;
+        persist.count--;
+        mutex_unlock(&persist.lock);
+
+        Table *t = item.table;
+        char record[t->record_size];
+        pthread_rwlock_wrlock(&t->lock);
+        t->dirty[item.id] = 0;
+        memcpy(record, table_slot(t, item.id), t->record_size);
+        pthread_rwlock_unlock(&t->lock);
+
+        // The copy may hold changes up to the last committed log entry; none
+        // of them may reach the data file before the log has them. Every
+        // operation waits for its own entry, so this never waits for long.
+        wal_wait(wal_appended());
+
+        long start = trace_now();
+        ssize_t written = pwrite(t->fd, record, t->record_size, table_offset(t, item.id));
+        trace_span(TRACE_FILE, "pwrite", t->path, -1, start, written);
+        if (written != (ssize_t)t->record_size) {
+            perror("Error writing data file");
+        }
+
+        mutex_lock(&persist.lock);
+        persist.written++;
+        pthread_cond_broadcast(&persist.advanced);
+        mutex_unlock(&persist.lock);
+    }
+    return NULL;
+}
+
+// Wait until the background writer has stored every record queued so far.
+// Records queued meanwhile are not waited for, so this ends under load too.
+void persist_drain() {
+    mutex_lock(&persist.lock);
+    long queued = persist.queued;
+    while (persist.written < queued) {
+        mutex_wait(&persist.advanced, &persist.lock);
+    }
+    mutex_unlock(&persist.lock);
+}
+
+// Wait until the background writer has stored every changed record, and
+// until mapped data files are written back. With the log, finish with a
+// checkpoint, so a clean shutdown leaves nothing to replay.
+void storage_flush() {
+    Table *tables[] = { &admin_table, &student_table, &faculty_table, &course_table };
+
+    seat_flush();
+    persist_drain();
+
+    for (int i = 0; i < 4; i++) {
+        Table *t = tables[i];
+        if (t->map != NULL) {
+            pthread_rwlock_rdlock(&t->lock);
+            msync(t->map, table_offset(t, table_count(t)), MS_SYNC);
+            pthread_rwlock_unlock(&t->lock);
+        }
+    }
+    wal_checkpoint();
+}
+
+// FNV-1a of a log entry, continuing from hash
+uint32_t wal_checksum(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Start collecting the changes of an operation on this thread (log enabled)
+void wal_begin(WalTxn *txn) {
+    WalEntry header = {0};
+
+    if (config.wal == WAL_OFF) {
+        return;
+    }
+    memset(txn, 0, sizeof(*txn));
+    buffer_append(&txn->entry, &header, sizeof(header));
+    wal_txn = txn;
+}
+
+// Index of record id of t among the running operation's changes, or -1
+int wal_find(Table *t, int id) {
+    for (int i = 0; i < wal_txn->count; i++) {
+        if (wal_txn->changes[i].table == t && wal_txn->changes[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Add a changed record to the running operation's entry
+Status wal_stash(Table *t, int id, const void *record) {
+    WalTxn *txn = wal_txn;
+    int i = wal_find(t, id);
+
+    if (i >= 0) {
+        memcpy(txn->entry.data + txn->changes[i].offset, record, t->record_size);
+        return STATUS_OK;
+    }
+    return wal_add(t, id, record);
+}
+
+// Add a record the running operation has not changed before to its entry
+Status wal_add(Table *t, int id, const void *record) {
+    WalTxn *txn = wal_txn;
+
+    if (txn->count == txn->capacity) {
+        int capacity = txn->capacity ? txn->capacity * 2 : 4;
+        WalChange *changes = realloc(txn->changes, capacity * sizeof(WalChange));
+        if (changes == NULL) {
+            return STATUS_ERROR;
+        }
+        txn->changes = changes;
+        txn->capacity = capacity;
+    }
+
+    WalRecord header = { 0, (uint32_t)id };
+    while (wal_tables[header.table] != t) {
+        header.table++;
+    }
+    buffer_append(&txn->entry, &header, sizeof(header));
+    txn->changes[txn->count++] = (WalChange){ t, id, txn->entry.len };
+    buffer_append(&txn->entry, record, t->record_size);
+    return STATUS_OK;
+}
+
+// Log the running operation's changes as one entry, then store them. Called
+// before the operation's locks are released, so entries for the same record
+// are logged in the order they are stored. Returns the entry's LSN (0 if
+// nothing changed) for wal_durable().
+uint64_t wal_commit() {
+    WalTxn *txn = wal_txn;
+    uint64_t lsn = 0;
+
+    if (txn == NULL) {
+        return 0;
+    }
+    wal_txn = NULL;
+
+    if (txn->count > 0) {
+        WalEntry header;
+        header.length = txn->entry.len - sizeof(WalEntry);
+        uint32_t hash = wal_checksum(2166136261u, txn->entry.data + sizeof(WalEntry), header.length);
+
+        mutex_lock(&wal.lock);
+        lsn = header.lsn = ++wal.appended;
+        header.checksum = wal_checksum(hash, &header.lsn, sizeof(header.lsn));
+        memcpy(txn->entry.data, &header, sizeof(header));
+        if (config.wal == WAL_OP) {
+            if (write_all(wal.fd, txn->entry.data, txn->entry.len) < 0) {
+                perror("Error writing log");
+                wal.failed = 1;
+            }
+        } else {
+            buffer_append(&wal.pending, txn->entry.data, txn->entry.len);
+            pthread_cond_signal(&wal.work);
+        }
+        atomic_fetch_add(&wal.storing, 1);
+        mutex_unlock(&wal.lock);
+
+        for (int i = 0; i < txn->count; i++) {
+            WalChange *change = &txn->changes[i];
+            table_put(change->table, change->id, txn->entry.data + change->offset);
+            if (change->id >= table_count(change->table)) {
+                atomic_store(&change->table->count, change->id + 1);
+            }
+        }
+        atomic_fetch_sub(&wal.storing, 1);
+    }
+
+    free(txn->entry.data);
+    free(txn->changes);
+    return lsn;
+}
+
+// LSN of the last committed entry
+uint64_t wal_appended() {
+    mutex_lock(&wal.lock);
+    uint64_t lsn = wal.appended;
+    mutex_unlock(&wal.lock);
+    return lsn;
+}
+
+// Sync the log for an operation with --wal op. Each operation syncs for
+// itself; one sync covers every entry written before it.
+void wal_sync(uint64_t lsn) {
+    mutex_lock(&wal.lock);
+    if (wal.done < lsn && !wal.failed) {
+        uint64_t written = wal.appended;
+        mutex_unlock(&wal.lock);
+        long start = trace_now();
+        int synced = fdatasync(wal.fd) == 0;
+        trace_span(TRACE_FILE, "fdatasync", "wal.log", trace_session, start, 0);
+        mutex_lock(&wal.lock);
+        if (!synced) {
+            perror("Error syncing log");
+            wal.failed = 1;
+        } else if (written > wal.done) {
+            wal.done = written;
+        }
+        pthread_cond_broadcast(&wal.advanced);
+    }
+    mutex_unlock(&wal.lock);
+}
+
+// Wait until the log holds entries up to lsn: written to wal.log with
+// --wal none, synced to the disk otherwise
+Status wal_wait(uint64_t lsn) {
+    if (lsn == 0) {
+        return STATUS_OK;
+    }
+
+    long start = trace_now();
+    mutex_lock(&wal.lock);
+    while (wal.done < lsn && !wal.failed) {
+        mutex_wait(&wal.advanced, &wal.lock);
+    }
+    Status status = wal.failed ? STATUS_ERROR : STATUS_OK;
+    mutex_unlock(&wal.lock);
+    trace_span(TRACE_FILE, "wal wait", "wal.log", trace_session, start, 0);
+    return status;
+}
+
+// Finish an operation once its log entry is as durable as --wal asks; called
+// after the operation's locks are released, so others can join the group
+Status wal_durable(Status status, uint64_t lsn) {
+    if (config.wal == WAL_NONE) {
+        return status;
+    }
+    if (config.wal == WAL_OP) {
+        wal_sync(lsn);
+    }
+    Status logged = wal_wait(lsn);
+    return status == STATUS_OK ? logged : status;
+}
+
+// Log writer (--wal none and group commit): writes the pending entries in
+// one go and, for group commit, syncs them with a single fdatasync
+void *wal_run(void *arg) {
+    Buffer batch = {0};
+    (void)arg;
+
+    while (1) {
+        mutex_lock(&wal.lock);
+        while (wal.pending.len == 0) {
+            mutex_wait(&wal.work, &wal.lock);
+        }
+        if (config.wal == WAL_GROUP && config.wal_window > 0) {
+            // Give other operations the window to join this group
+            mutex_unlock(&wal.lock);
+            usleep(config.wal_window);
+            mutex_lock(&wal.lock);
+        }
+        Buffer writing = wal.pending;
+        wal.pending = batch;
+        batch = writing;
+        uint64_t lsn = wal.appended;
+        wal.writing = 1;
+        mutex_unlock(&wal.lock);
+
+        long start = trace_now();
+        int ok = write_all(wal.fd, batch.data, batch.len) == 0 &&
+                 (config.wal == WAL_NONE || fdatasync(wal.fd) == 0);
+        trace_span(TRACE_FILE, config.wal == WAL_NONE ? "write" : "write+fdatasync", "wal.log", -1, start, batch.len);
+        batch.len = 0;
+
+        mutex_lock(&wal.lock);
+        if (!ok) {
+            perror("Error writing log");
+            wal.failed = 1;
+        }
+        wal.done = lsn;
+        wal.writing = 0;
+        pthread_cond_broadcast(&wal.advanced);
+        mutex_unlock(&wal.lock);
+    }
+    return NULL;
+}
+
+// Redo the complete entries at the start of a log, in order, into memory.
+// Stops at the first torn or corrupt entry, which a crash can leave at the
+// end, or at an entry that does not follow *last, which is set to the last
+// LSN replayed. Returns the number of entries replayed, or -1 if a record
+// could not be stored.
+int wal_replay(const char *path, const char *data, size_t size, uint64_t *last) {
+    size_t pos = 0;
+    int entries = 0;
+
+    while (size - pos >= sizeof(WalEntry)) {
+        WalEntry header;
+        memcpy(&header, data + pos, sizeof(header));
+        const char *body = data + pos + sizeof(header);
+        if (header.length > size - pos - sizeof(header) ||
+            wal_checksum(wal_checksum(2166136261u, body, header.length), &header.lsn, sizeof(header.lsn)) != header.checksum ||
+            (*last != 0 && header.lsn != *last + 1)) {
+            break;
+        }
+
+        for (size_t at = 0; at < header.length;) {
+            WalRecord record;
+            memcpy(&record, body + at, sizeof(record));
+            Table *t = record.table < 4 ? wal_tables[record.table] : NULL;
+            at += sizeof(record);
+            if (t == NULL || at + t->record_size > header.length ||
+                table_restore(t, (int)record.id, body + at) != STATUS_OK) {
+                fprintf(stderr, "%s: cannot replay entry %llu\n", path, (unsigned long long)header.lsn);
+                return -1;
+            }
+            at += t->record_size;
+        }
+        *last = header.lsn;
+        entries++;
+        pos += sizeof(header) + header.length;
+    }
+
+    if (pos < size) {
+        fprintf(stderr, "%s: discarding %zu bytes after the last complete entry\n", path, size - pos);
+    }
+    return entries;
+}
+
+// Replay one log file; a missing file has no entries
+int wal_replay_file(const char *path, uint64_t *last) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    char *data = malloc(st.st_size > 0 ? st.st_size : 1);
+    if (data == NULL || pread(fd, data, st.st_size, 0) != st.st_size) {
+        perror("Error reading log");
+        free(data);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    int entries = wal_replay(path, data, st.st_size, last);
+    free(data);
+    return entries;
+}
+
+// Open wal.log and replay what was logged since the last checkpoint: wal.old
+// if a checkpoint was cut short, then wal.log. The data files loaded before
+// are the snapshot the log continues from. Every replayed record is written
+// once and synced before the logs are emptied. Then start the log writer
+// unless every operation writes its own entry.
+int wal_open() {
+    uint64_t last = 0;
+    struct stat st;
+
+    wal.fd = open("wal.log", O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (wal.fd == -1 || fstat(wal.fd, &st) == -1) {
+        perror("Error opening log");
+        return -1;
+    }
+
+    long start = now_ns();
+    int old_entries = wal_replay_file("wal.old", &last);
+    int entries = old_entries >= 0 ? wal_replay_file("wal.log", &last) : -1;
+    if (entries < 0) {
+        return -1;
+    }
+    entries += old_entries;
+    // Empty a log that holds anything, even only a torn entry: new entries
+    // are appended, and recovery would stop at the torn bytes before them
+    if (st.st_size > 0 || access("wal.old", F_OK) == 0) {
+        for (int i = 0; i < 4; i++) {
+            table_write_back(wal_tables[i]);
+            if (fsync(wal_tables[i]->fd) == -1) {
+                perror("Error syncing data file");
+                return -1;
+            }
+        }
+        // wal.old goes first: replaying it over newer records without the
+        // wal.log entries that follow would undo them
+        if ((unlink("wal.old") == -1 && errno != ENOENT) || sync_directory() == -1 ||
+            ftruncate(wal.fd, 0) == -1 || fdatasync(wal.fd) == -1) {
+            perror("Error emptying log");
+            return -1;
+        }
+        printf("Replayed %d log entries in %.0f ms\n", entries, (now_ns() - start) / 1e6);
+    }
+
+    if (config.wal != WAL_OP) {
+        pthread_t writer;
+        if (start_thread(&writer, wal_run, NULL) != 0) {
+            perror("Thread creation failed");
+            return -1;
+        }
+        pthread_detach(writer);
+    }
+    return 0;
+}
+
+// Sync the data directory, so renamed and removed files stay that way
+int sync_directory() {
+    int fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        return -1;
+    }
+    int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+// Start a checkpoint: once every entry logged so far is written, synced and
+// stored in memory, move wal.log to wal.old and log to a new wal.log.
+// Commits wait meanwhile, but only for one sync. Returns 1 if the log was
+// moved, 0 if nothing was logged since the last checkpoint or it failed.
+int wal_rotate() {
+    int rotated = 0;
+
+    mutex_lock(&wal.lock);
+    while (wal.writing) {
+        mutex_wait(&wal.advanced, &wal.lock);
+    }
+    // No commit can start while the lock is held; let those still storing finish
+    while (atomic_load(&wal.storing) > 0) {
+        sched_yield();
+    }
+    if (wal.appended > wal.rotated && !wal.failed) {
+        if (write_all(wal.fd, wal.pending.data, wal.pending.len) < 0 || fdatasync(wal.fd) == -1) {
+            perror("Error writing log");
+            wal.failed = 1;
+        } else {
+            wal.pending.len = 0;
+            wal.done = wal.appended;
+            pthread_cond_broadcast(&wal.advanced);
+
+            // wal.fd keeps its number, so the log writer and wal_sync() need
+            // not know about the switch
+            int fd = open("wal.new", O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+            if (fd == -1 || rename("wal.log", "wal.old") == -1 || rename("wal.new", "wal.log") == -1 ||
+                dup2(fd, wal.fd) == -1 || sync_directory() == -1) {
+                perror("Error starting a new log");
+            } else {
+                wal.rotated = wal.appended;
+                rotated = 1;
+            }
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+    mutex_unlock(&wal.lock);
+    return rotated;
+}
+
+// Checkpoint (--wal): move the log aside, wait until the background writer
+// has stored every record changed before, sync the data files and delete the
+// old log. The data files, though written record by record, then hold every
+// change in wal.old, so recovery only replays wal.log. A checkpoint that
+// fails to sync keeps wal.old and finishes next time.
+void wal_checkpoint() {
+    if (config.wal == WAL_OFF) {
+        return;
+    }
+
+    mutex_lock(&wal.checkpoint);
+    if (!wal.old_log) {
+        wal.old_log = wal_rotate();
+    }
+    if (wal.old_log) {
+        persist_drain();
+        int synced = 1;
+        for (int i = 0; i < 4; i++) {
+            if (fsync(wal_tables[i]->fd) == -1) {
+                perror("Error syncing data file");
+                synced = 0;
+            }
+        }
+        if (synced && (unlink("wal.old") == -1 || sync_directory() == -1)) {
+            perror("Error removing old log");
+        } else if (synced) {
+            wal.old_log = 0;
+        }
+    }
+    mutex_unlock(&wal.checkpoint);
+}
+
+// Checkpoint writer (--wal): keeps the log replayed at startup to what
+// --checkpoint seconds of operations wrote
+void *checkpoint_run(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(config.checkpoint);
+        wal_checkpoint();
+    }
+    return NULL;
+}
+
+// FNV-1a hash of a name
+uint32_t name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+    return hash;
+}
+
+// Look up name; the entry is valid until the index is next changed
+IndexEntry *index_find(NameIndex *idx, const char *name) {
+    if (idx->count == 0) {
+        return NULL;
+    }
+
+    uint32_t hash = name_hash(name);
+    int mask = idx->capacity - 1;
+    for (int i = hash & mask; idx->entries[i].id >= 0; i = (i + 1) & mask) {
+        if (idx->entries[i].hash == hash && strcmp(idx->entries[i].name, name) == 0) {
+            return &idx->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Move the entries into a table of the given capacity
+int index_resize(NameIndex *idx, int capacity) {
+    IndexEntry *entries = malloc(capacity * sizeof(IndexEntry));
+    if (entries == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < capacity; i++) {
+        entries[i].id = -1;
+    }
+
+    for (int i = 0; i < idx->capacity; i++) {
+        if (idx->entries[i].id >= 0) {
+            int j = idx->entries[i].hash & (capacity - 1);
+            while (entries[j].id >= 0) {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = idx->entries[i];
+        }
+    }
+    free(idx->entries);
+    idx->entries = entries;
+    idx->capacity = capacity;
+    return 0;
+}
+
+// Add or replace the entry for name
+int index_insert(NameIndex *idx, const char *name, int id) {
+    IndexEntry *entry = index_find(idx, name);
+    if (entry != NULL) {
+        entry->id = id;
+        return 0;
+    }
+
+    // Keep the table at most three quarters full
+    if ((idx->count + 1) * 4 > idx->capacity * 3 &&
+        index_resize(idx, idx->capacity ? idx->capacity * 2 : INDEX_MIN_CAPACITY) < 0) {
+        return -1;
+    }
+
+    uint32_t hash = name_hash(name);
+    int mask = idx->capacity - 1;
+    int i = hash & mask;
+    while (idx->entries[i].id >= 0) {
+        i = (i + 1) & mask;
+    }
+    copy_field(idx->entries[i].name, name);
+    idx->entries[i].hash = hash;
+    idx->entries[i].id = id;
+    idx->entries[i].roster = NULL;
+    idx->count++;
+    return 0;
+}
+
+// Size the index for count names in all, so adding up to that many never resizes
+int index_reserve(NameIndex *idx, int count) {
+    int capacity = INDEX_MIN_CAPACITY;
+    while (count * 4 > capacity * 3) {
+        capacity *= 2;
+    }
+    return capacity > idx->capacity ? index_resize(idx, capacity) : 0;
+}
+
+// Remove the entry for name, shifting later entries of its probe run back
+void index_remove(NameIndex *idx, const char *name) {
+    IndexEntry *entry = index_find(idx, name);
+    if (entry == NULL) {
+        return;
+    }
+
+    int mask = idx->capacity - 1;
+    int hole = entry - idx->entries;
+    for (int i = (hole + 1) & mask; idx->entries[i].id >= 0; i = (i + 1) & mask) {
+        int home = idx->entries[i].hash & mask;
+        // An entry may fill the hole unless its home slot lies after the hole
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            idx->entries[hole] = idx->entries[i];
+            hole = i;
+        }
+    }
+    idx->entries[hole].id = -1;
+    idx->count--;
+}
+
+// Position of student_id in a roster, or where it would be inserted
+int roster_position(CourseRoster *r, int student_id) {
+    int low = 0, high = r->count;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (r->array->ids[mid] < student_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Give an empty roster room for capacity students, so filling it at startup
+// never copies the array
+int roster_reserve(CourseRoster *r, int capacity) {
+    if (r->array != NULL || capacity == 0) {
+        return 0;
+    }
+    r->array = malloc(sizeof(RosterIds) + capacity * sizeof(int));
+    if (r->array == NULL) {
+        return -1;
+    }
+    r->array->capacity = capacity;
+    r->array->retired = NULL;
+    return 0;
+}
+
+// Record that student_id is enrolled; called with the course's record lock held
+int roster_add(CourseRoster *r, int student_id) {
+    RosterIds *array = r->array;
+    int pos = roster_position(r, student_id);
+    if (pos < r->count && array->ids[pos] == student_id) {
+        return 0;
+    }
+    if (array == NULL || r->count == array->capacity) {
+        int capacity = array != NULL ? array->capacity * 2 : 8;
+        RosterIds *grown = malloc(sizeof(RosterIds) + capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        grown->capacity = capacity;
+        grown->retired = array;
+        if (array != NULL) {
+            memcpy(grown->ids, array->ids, r->count * sizeof(int));
+        }
+        __atomic_store_n(&r->array, grown, __ATOMIC_RELEASE);
+        array = grown;
+    }
+
+    seq_write_begin(&r->seq);
+    for (int k = r->count; k > pos; k--) {
+        __atomic_store_n(&array->ids[k], array->ids[k - 1], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&array->ids[pos], student_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->count, r->count + 1, __ATOMIC_RELAXED);
+    seq_write_end(&r->seq);
+    return 0;
+}
+
+void roster_remove(CourseRoster *r, int student_id) {
+    int pos = roster_position(r, student_id);
+    if (pos < r->count && r->array->ids[pos] == student_id) {
+        seq_write_begin(&r->seq);
+        for (int k = pos; k < r->count - 1; k++) {
+            __atomic_store_n(&r->array->ids[k], r->array->ids[k + 1], __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&r->count, r->count - 1, __ATOMIC_RELAXED);
+        seq_write_end(&r->seq);
+    }
+}
+
+// Copy a roster's student IDs into *ids, growing it (and *capacity) as
+// needed, without taking the course lock. Returns the number copied, or -1
+// if out of memory.
+int roster_copy(CourseRoster *r, int **ids, int *capacity) {
+    unsigned start;
+    int count;
+
+    do {
+        start = seq_read_begin(&r->seq);
+        RosterIds *array = __atomic_load_n(&r->array, __ATOMIC_ACQUIRE);
+        count = __atomic_load_n(&r->count, __ATOMIC_RELAXED);
+        if (array == NULL || count > array->capacity) {
+            // Empty, or the count is newer than the array; the check below retries
+            count = 0;
+            continue;
+        }
+        if (count > *capacity) {
+            int *grown = realloc(*ids, array->capacity * sizeof(int));
+            if (grown == NULL) {
+                return -1;
+            }
+            *ids = grown;
+            *capacity = array->capacity;
+        }
+        seq_load(*ids, array->ids, count * sizeof(int));
+    } while (seq_read_retry(&r->seq, start));
+    return count;
+}
+
+// Put student_id at the end of a course's waitlist; called with the course's
+// record lock held. A full array is compacted if half of it was served,
+// otherwise replaced by a larger one and kept like a roster array.
+int waitlist_add(CourseRoster *r, int student_id) {
+    RosterIds *array = r->waiting;
+    int end = r->waiting_head + r->waiting_count;
+
+    if (array == NULL || (end == array->capacity && r->waiting_count > array->capacity / 2)) {
+        int capacity = array != NULL ? array->capacity * 2 : 8;
+        RosterIds *grown = malloc(sizeof(RosterIds) + capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        grown->capacity = capacity;
+        grown->retired = array;
+        if (array != NULL) {
+            memcpy(grown->ids, array->ids + r->waiting_head, r->waiting_count * sizeof(int));
+        }
+        seq_write_begin(&r->seq);
+        __atomic_store_n(&r->waiting, grown, __ATOMIC_RELEASE);
+        __atomic_store_n(&r->waiting_head, 0, __ATOMIC_RELAXED);
+        seq_write_end(&r->seq);
+        array = grown;
+    } else if (end == array->capacity) {
+        seq_write_begin(&r->seq);
+        for (int k = 0; k < r->waiting_count; k++) {
+            __atomic_store_n(&array->ids[k], array->ids[r->waiting_head + k], __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&r->waiting_head, 0, __ATOMIC_RELAXED);
+        seq_write_end(&r->seq);
+    }
+
+    seq_write_begin(&r->seq);
+    __atomic_store_n(&array->ids[r->waiting_head + r->waiting_count], student_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->waiting_count, r->waiting_count + 1, __ATOMIC_RELAXED);
+    seq_write_end(&r->seq);
+    return 0;
+}
+
+// Take the student at the head of a course's waitlist, or -1 if it is empty;
+// called with the course's record lock held
+int waitlist_pop(CourseRoster *r) {
+    if (r->waiting_count == 0) {
+        return -1;
+    }
+    int student_id = r->waiting->ids[r->waiting_head];
+    seq_write_begin(&r->seq);
+    __atomic_store_n(&r->waiting_head, r->waiting_count > 1 ? r->waiting_head + 1 : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->waiting_count, r->waiting_count - 1, __ATOMIC_RELAXED);
+    seq_write_end(&r->seq);
+    return student_id;
+}
+
+// Take student_id off a course's waitlist, keeping the others in order.
+// Returns -1 if the student was not waiting.
+int waitlist_remove(CourseRoster *r, int student_id) {
+    int *ids = r->waiting != NULL ? r->waiting->ids + r->waiting_head : NULL;
+    int pos = 0;
+
+    while (pos < r->waiting_count && ids[pos] != student_id) {
+        pos++;
+    }
+    if (pos == r->waiting_count) {
+        return -1;
+    }
+    seq_write_begin(&r->seq);
+    for (int k = pos; k < r->waiting_count - 1; k++) {
+        __atomic_store_n(&ids[k], ids[k + 1], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&r->waiting_count, r->waiting_count - 1, __ATOMIC_RELAXED);
+    seq_write_end(&r->seq);
+    return 0;
+}
+
+// Students waiting for a seat in a course; exact with the course's record lock held
+int waitlist_length(CourseRoster *r) {
+    return __atomic_load_n(&r->waiting_count, __ATOMIC_RELAXED);
+}
+
+// Place of student_id on a course's waitlist (1 at the head), or 0 if the
+// student is not waiting. Reads the waitlist without the course lock.
+int waitlist_position(CourseRoster *r, int student_id) {
+    unsigned start;
+    int position;
+
+    do {
+        start = seq_read_begin(&r->seq);
+        RosterIds *array = __atomic_load_n(&r->waiting, __ATOMIC_ACQUIRE);
+        int head = __atomic_load_n(&r->waiting_head, __ATOMIC_RELAXED);
+        int count = __atomic_load_n(&r->waiting_count, __ATOMIC_RELAXED);
+        position = 0;
+        if (array == NULL || head + count > array->capacity) {
+            // Empty, or the fields are newer than the array; the check below retries
+            continue;
+        }
+        for (int k = 0; k < count; k++) {
+            if (__atomic_load_n(&array->ids[head + k], __ATOMIC_RELAXED) == student_id) {
+                position = k + 1;
+                break;
+            }
+        }
+    } while (seq_read_retry(&r->seq, start));
+    return position;
+}
+
+// Waitlist state of a student; with create set it is allocated on first use.
+// Returns NULL if the student has none (or is out of memory).
+StudentWaits *student_waits(int student_id, int create) {
+    int chunk = student_id / TABLE_CHUNK_RECORDS;
+    if (student_id < 0 || chunk >= TABLE_MAX_CHUNKS) {
+        return NULL;
+    }
+
+    StudentWaits **slots = atomic_load(&wait_chunks[chunk]);
+    if (slots == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        // Students of one chunk hold different record locks; the first
+        // allocation to be published wins
+        StudentWaits **fresh = calloc(TABLE_CHUNK_RECORDS, sizeof(StudentWaits *));
+        if (fresh == NULL) {
+            return NULL;
+        }
+        if (!atomic_compare_exchange_strong(&wait_chunks[chunk], &slots, fresh)) {
+            free(fresh);
+        } else {
+            slots = fresh;
+        }
+    }
+
+    StudentWaits **slot = &slots[student_id % TABLE_CHUNK_RECORDS];
+    if (*slot == NULL && create) {
+        *slot = calloc(1, sizeof(StudentWaits));
+    }
+    return *slot;
+}
+
+// Forget that a student waits for course_id (student's record lock held)
+void student_waits_drop(StudentWaits *w, int course_id) {
+    for (int i = 0; i < w->waiting_count; i++) {
+        if (w->waiting[i] == course_id) {
+            memmove(&w->waiting[i], &w->waiting[i + 1], (w->waiting_count - i - 1) * sizeof(int));
+            w->waiting_count--;
+            return;
+        }
+    }
+}
+
+// ID of the course called name, or -1. *roster, if not NULL, receives the
+// course's roster, which stays valid after the index changes.
+int course_lookup(const char *name, CourseRoster **roster) {
+    pthread_rwlock_rdlock(&course_index_lock);
+    IndexEntry *entry = index_find(&course_index, name);
+    int id = entry != NULL ? entry->id : -1;
+    if (roster != NULL) {
+        *roster = entry != NULL ? entry->roster : NULL;
+    }
+    pthread_rwlock_unlock(&course_index_lock);
+    return id;
+}
+
+// Add a new course name with an empty roster and seats free seats. Called
+// with course_mutex held.
+int course_intern(const char *name, int id, int seats) {
+    CourseRoster *roster = calloc(1, sizeof(CourseRoster));
+    if (roster == NULL || seat_set(id, seats) < 0) {
+        free(roster);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&course_index_lock);
+    int result = index_insert(&course_index, name, id);
+    if (result == 0) {
+        index_find(&course_index, name)->roster = roster;
+    }
+    pthread_rwlock_unlock(&course_index_lock);
+    if (result < 0) {
+        free(roster);
+    }
+    return result;
+}
+
+// Index every interned course name and the students enrolled in each course.
+// Rosters are sized from a first pass over the students, then filled by
+// course ID without a name lookup per enrollment.
+int course_index_build() {
+    Course course;
+    Student student;
+    int count = table_count(&course_table);
+    int students = table_count(&student_table);
+    CourseRoster **rosters = malloc((count > 0 ? count : 1) * sizeof(CourseRoster *));
+    int *enrolled = calloc(count > 0 ? count : 1, sizeof(int));
+    int result = rosters != NULL && enrolled != NULL ? index_reserve(&course_index, count) : -1;
+
+    for (int id = 0; result == 0 && id < students; id++) {
+        if (table_read(&student_table, id, &student) != STATUS_OK) {
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < student.course_count; i++) {
+            if (student.courses[i] < 0 || student.courses[i] >= count) {
+                result = -1;
+                break;
+            }
+            enrolled[student.courses[i]]++;
+        }
+    }
+    for (int id = 0; result == 0 && id < count; id++) {
+        if (table_read(&course_table, id, &course) != STATUS_OK || course_intern(course.name, id, 0) < 0) {
+            result = -1;
+            break;
+        }
+        course_lookup(course.name, &rosters[id]);
+        result = roster_reserve(rosters[id], enrolled[id]);
+    }
+    for (int id = 0; result == 0 && id < students; id++) {
+        if (table_read(&student_table, id, &student) != STATUS_OK) {
+            result = -1;
+            break;
+        }
+        for (int i = 0; result == 0 && i < student.course_count; i++) {
+            result = roster_add(rosters[student.courses[i]], id);
+        }
+    }
+
+    // Free seats follow from the rosters, so counts the seat writer had not
+    // stored yet are recovered
+    for (int id = 0; result == 0 && id < count; id++) {
+        if (table_read(&course_table, id, &course) != STATUS_OK) {
+            result = -1;
+            break;
+        }
+        int seats = course.faculty_id >= 0 && course.capacity > rosters[id]->count ? course.capacity - rosters[id]->count : 0;
+        seat_set(id, seats);
+        if (seats != course.seats) {
+            atomic_store(&seat_counter(id)->dirty, 1);
+        }
+    }
+
+    free(rosters);
+    free(enrolled);
+    return result;
+}
+
+// Seat counter of course id
+SeatCounter *seat_counter(int id) {
+    return &seat_chunks[id / TABLE_CHUNK_RECORDS][id % TABLE_CHUNK_RECORDS];
+}
+
+// Start a new generation of course id's seat counter with seats free seats.
+// Called with the course's record lock or course_mutex held.
+int seat_set(int id, int seats) {
+    int chunk = id / TABLE_CHUNK_RECORDS;
+    if (chunk >= TABLE_MAX_CHUNKS) {
+        return -1;
+    }
+    if (seat_chunks[chunk] == NULL) {
+        SeatCounter *counters = aligned_alloc(sizeof(SeatCounter), TABLE_CHUNK_RECORDS * sizeof(SeatCounter));
+        if (counters == NULL) {
+            return -1;
+        }
+        memset(counters, 0, TABLE_CHUNK_RECORDS * sizeof(SeatCounter));
+        seat_chunks[chunk] = counters;
+    }
+
+    SeatCounter *c = seat_counter(id);
+    uint64_t old = atomic_load(&c->seats);
+    atomic_store(&c->seats, ((old >> 32) + 1) << 32 | (uint32_t)seats);
+    if (id >= atomic_load(&seat_courses)) {
+        atomic_store(&seat_courses, id + 1);
+    }
+    return 0;
+}
+
+// Free seats of course id
+int seat_count(int id) {
+    return id >= 0 && id < atomic_load(&seat_courses) ? (int)(uint32_t)atomic_load(&seat_counter(id)->seats) : 0;
+}
+
+uint32_t seat_generation(int id) {
+    return atomic_load(&seat_counter(id)->seats) >> 32;
+}
+
+// Take a seat in course id without locking. Returns the seats left, or -1 if
+// the course is full; *generation receives the generation the seat is from.
+int seat_reserve(int id, uint32_t *generation) {
+    SeatCounter *c = seat_counter(id);
+    uint64_t v = atomic_load(&c->seats);
+
+    while ((uint32_t)v > 0) {
+        if (atomic_compare_exchange_weak(&c->seats, &v, v - 1)) {
+            *generation = v >> 32;
+            return (int)(uint32_t)v - 1;
+        }
+    }
+    return -1;
+}
+
+// Give a seat back, unless the course was added or removed since it was taken
+void seat_release(int id, uint32_t generation) {
+    SeatCounter *c = seat_counter(id);
+    uint64_t v = atomic_load(&c->seats);
+
+    while (v >> 32 == generation) {
+        if (atomic_compare_exchange_weak(&c->seats, &v, v + 1)) {
+            atomic_store(&c->dirty, 1);
+            return;
+        }
+    }
+}
+
+// Write the current seat count of course id to its record. Called with the
+// course's record lock held.
+Status seat_store(int id) {
+    Course course;
+    Status status = table_read(&course_table, id, &course);
+    if (status == STATUS_OK) {
+        course.seats = seat_count(id);
+        status = table_write(&course_table, id, &course);
+    }
+    if (status != STATUS_OK) {
+        atomic_store(&seat_counter(id)->dirty, 1);
+    }
+    return status;
+}
+
+// Store the current seat count of every changed course in its record
+void seat_flush() {
+    int count = atomic_load(&seat_courses);
+
+    for (int id = 0; id < count; id++) {
+        if (!atomic_exchange(&seat_counter(id)->dirty, 0)) {
+            continue;
+        }
+        record_lock(course_locks, id);
+        seat_store(id);
+        record_unlock(course_locks, id);
+    }
+}
+
+// Seat writer thread: enrollments only change the counters, this keeps
+// courses.dat close behind
+void *seat_writer_run(void *arg) {
+    (void)arg;
+    while (1) {
+        usleep(SEAT_FLUSH_MS * 1000);
+        seat_flush();
+    }
+    return NULL;
+}
+
+// ID of the user called username, or -1
+int user_lookup(NameIndex *idx, const char *username) {
+    pthread_rwlock_rdlock(&names_lock);
+    IndexEntry *entry = index_find(idx, username);
+    int id = entry != NULL ? entry->id : -1;
+    pthread_rwlock_unlock(&names_lock);
+    return id;
+}
+
+// Point new_name at user id, dropping old_name (NULL for a new user). Called
+// with the role's student_mutex or faculty_mutex held, so checks made under
+// it stay valid.
+int user_rename(NameIndex *idx, const char *old_name, const char *new_name, int id) {
+    pthread_rwlock_wrlock(&names_lock);
+    if (old_name != NULL) {
+        IndexEntry *entry = index_find(idx, old_name);
+        if (entry != NULL && entry->id == id) {
+            index_remove(idx, old_name);
+        }
+    }
+    int result = index_insert(idx, new_name, id);
+    pthread_rwlock_unlock(&names_lock);
+    return result;
+}
+
+// Add the users of an import batch, the rows with status STATUS_OK, in one
+// pass under names_lock. Called with the role's mutex held, like user_rename().
+int user_add_rows(NameIndex *idx, const ImportRow *rows, int count) {
+    int result = 0;
+
+    pthread_rwlock_wrlock(&names_lock);
+    if (index_reserve(idx, idx->count + count) < 0) {
+        result = -1;
+    }
+    for (int i = 0; i < count && result == 0; i++) {
+        if (rows[i].status == STATUS_OK) {
+            result = index_insert(idx, rows[i].username, rows[i].id);
+        }
+    }
+    pthread_rwlock_unlock(&names_lock);
+    return result;
+}
+
+// Index every student and faculty username. A name used twice keeps its
+// lowest ID.
+int user_index_build() {
+    Student student;
+    Faculty faculty;
+
+    if (index_reserve(&student_names, table_count(&student_table)) < 0 ||
+        index_reserve(&faculty_names, table_count(&faculty_table)) < 0) {
+        return -1;
+    }
+    for (int id = 0; id < table_count(&student_table); id++) {
+        if (table_read(&student_table, id, &student) != STATUS_OK) {
+            return -1;
+        }
+        if (index_find(&student_names, student.username) == NULL &&
+            index_insert(&student_names, student.username, id) < 0) {
+            return -1;
+        }
+    }
+    for (int id = 0; id < table_count(&faculty_table); id++) {
+        if (table_read(&faculty_table, id, &faculty) != STATUS_OK) {
+            return -1;
+        }
+        if (index_find(&faculty_names, faculty.username) == NULL &&
+            index_insert(&faculty_names, faculty.username, id) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Thread body for user_index_build(); stores its result in *arg
+void *user_index_run(void *arg) {
+    *(int *)arg = user_index_build();
+    return NULL;
+}
+
+// Take the stripe of record id if it is free; returns 0 on success
+int record_trylock(RecordLock *locks, int id) {
+    return pthread_mutex_trylock(&locks[(unsigned)id % RECORD_STRIPES].mutex);
+}
+
+// Record locks of a role's table
+RecordLock *role_locks(const char *role) {
+    return strcmp(role, "student") == 0 ? student_locks : faculty_locks;
+}
+
+// Authenticate user
+int authenticate_user(char *username, char *password, char *role) {
+    if (strcmp(role, "admin") == 0) {
+        Admin admin;
+        if (table_read(&admin_table, 0, &admin) != STATUS_OK) {
+            return -1;
+        }
+
+        if (strcmp(admin.username, username) == 0 && strcmp(admin.password, password) == 0) {
+            return 0; // Success for admin
+        }
+    } else if (strcmp(role, "faculty") == 0) {
+        // The record is checked again in case the user was renamed meanwhile
+        Faculty faculty;
+        int id = user_lookup(&faculty_names, username);
+
+        if (id >= 0 && table_read(&faculty_table, id, &faculty) == STATUS_OK &&
+            strcmp(faculty.username, username) == 0 && strcmp(faculty.password, password) == 0) {
+            return id; // Return faculty ID
+        }
+    } else if (strcmp(role, "student") == 0) {
+        Student student;
+        int id = user_lookup(&student_names, username);
+
+        if (id >= 0 && table_read(&student_table, id, &student) == STATUS_OK &&
+            strcmp(student.username, username) == 0 && strcmp(student.password, password) == 0 && student.active) {
+            return id; // Return student ID
+        }
+    }
+
+    return -1; // Authentication failed
+}
+
+// Add student (Admin function)
+Status add_student_locked(const char *username, const char *password, int *student_id) {
+    Student new_student;
+
+    memset(&new_student, 0, sizeof(Student));
+    copy_field(new_student.username, username);
+    copy_field(new_student.password, password);
+
+    // Usernames are unique, so login can find a student by name
+    if (user_lookup(&student_names, new_student.username) >= 0) {
+        return STATUS_EXISTS;
+    }
+
+    // Initialize other fields
+    new_student.active = 1;
+    new_student.course_count = 0;
+
+    // Determine student ID (next record in the table)
+    new_student.id = table_count(&student_table);
+
+    Status status = table_append(&student_table, &new_student);
+    *student_id = new_student.id;
+    if (status == STATUS_OK && user_rename(&student_names, NULL, new_student.username, new_student.id) < 0) {
+        return STATUS_ERROR;
+    }
+    return status;
+}
+
+// Add faculty (Admin function)
+Status add_faculty_locked(const char *username, const char *password, int *faculty_id) {
+    Faculty new_faculty;
+
+    memset(&new_faculty, 0, sizeof(Faculty));
+    copy_field(new_faculty.username, username);
+    copy_field(new_faculty.password, password);
+
+    if (user_lookup(&faculty_names, new_faculty.username) >= 0) {
+        return STATUS_EXISTS;
+    }
+
+    // Initialize other fields
+    new_faculty.course_count = 0;
+
+    // Determine faculty ID (next record in the table)
+    new_faculty.id = table_count(&faculty_table);
+
+    Status status = table_append(&faculty_table, &new_faculty);
+    *faculty_id = new_faculty.id;
+    if (status == STATUS_OK && user_rename(&faculty_names, NULL, new_faculty.username, new_faculty.id) < 0) {
+        return STATUS_ERROR;
+    }
+    return status;
+}
+
+// Add a batch of students or faculty (Admin function). Rows the parser
+// rejected are skipped; the others must have a username that is new to the
+// role and to the batch. Accepted rows get consecutive IDs from *first_id in
+// row order and are written with one append, then indexed together.
+Status import_users_locked(const char *role, ImportRow *rows, int count, int *first_id, int *added) {
+    int student = strcmp(role, "student") == 0;
+    Table *t = student ? &student_table : &faculty_table;
+    NameIndex *names = student ? &student_names : &faculty_names;
+    NameIndex batch = {0};
+    char *records = calloc(count > 0 ? count : 1, t->record_size);
+    Status status = STATUS_OK;
+    int n = 0;
+
+    *first_id = table_count(t);
+    *added = 0;
+    if (records == NULL || index_reserve(&batch, count) < 0) {
+        status = STATUS_ERROR;
+    }
+
+    pthread_rwlock_rdlock(&names_lock);
+    for (int i = 0; i < count && status == STATUS_OK; i++) {
+        ImportRow *row = &rows[i];
+        if (row->status != STATUS_OK) {
+            continue;
+        }
+        if (index_find(names, row->username) != NULL || index_find(&batch, row->username) != NULL) {
+            row->status = STATUS_EXISTS;
+            continue;
+        }
+        index_insert(&batch, row->username, i);
+
+        row->id = *first_id + n;
+        if (student) {
+            Student *new_student = (Student *)(records + (size_t)n * t->record_size);
+            new_student->id = row->id;
+            copy_field(new_student->username, row->username);
+            copy_field(new_student->password, row->password);
+            new_student->active = 1;
+        } else {
+            Faculty *new_faculty = (Faculty *)(records + (size_t)n * t->record_size);
+            new_faculty->id = row->id;
+            copy_field(new_faculty->username, row->username);
+            copy_field(new_faculty->password, row->password);
+        }
+        n++;
+    }
+    pthread_rwlock_unlock(&names_lock);
+
+    if (status == STATUS_OK) {
+        status = table_append_many(t, records, n);
+    }
+    if (status == STATUS_OK && user_add_rows(names, rows, count) < 0) {
+        status = STATUS_ERROR;
+    }
+    if (status == STATUS_OK) {
+        *added = n;
+    }
+    free(batch.entries);
+    free(records);
+    return status;
+}
+
+// Activate/Deactivate student (Admin function)
+Status toggle_student_status_locked(int student_id, int *active) {
+    // Find the student by ID
+    Student student;
+    Status status = table_read(&student_table, student_id, &student);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // Toggle active status
+    student.active = !student.active;
+
+    *active = student.active;
+    return table_write(&student_table, student_id, &student);
+}
+
+// Update student/faculty details (Admin function). NULL keeps the current value.
+Status update_details_locked(char *role, int id, const char *username, const char *password) {
+    Status status;
+    char old_name[50], new_name[50];
+
+    if (username != NULL) {
+        copy_field(new_name, username);
+    }
+
+    if (strcmp(role, "student") == 0) { // Update student
+        // Find the student by ID
+        Student student;
+        status = table_read(&student_table, id, &student);
+        if (status != STATUS_OK) {
+            return status;
+        }
+
+        // A new username must not belong to another student
+        if (username != NULL) {
+            int owner = user_lookup(&student_names, new_name);
+            if (owner >= 0 && owner != id) {
+                return STATUS_EXISTS;
+            }
+        }
+
+        // Apply new details
+        strcpy(old_name, student.username);
+        if (username != NULL) {
+            copy_field(student.username, username);
+        }
+        if (password != NULL) {
+            copy_field(student.password, password);
+        }
+
+        status = table_write(&student_table, id, &student);
+        if (status == STATUS_OK && username != NULL && user_rename(&student_names, old_name, new_name, id) < 0) {
+            return STATUS_ERROR;
+        }
+        return status;
+    } else { // Update faculty
+        // Find the faculty by ID
+        Faculty faculty;
+        status = table_read(&faculty_table, id, &faculty);
+        if (status != STATUS_OK) {
+            return status;
+        }
+
+        if (username != NULL) {
+            int owner = user_lookup(&faculty_names, new_name);
+            if (owner >= 0 && owner != id) {
+                return STATUS_EXISTS;
+            }
+        }
+
+        // Apply new details
+        strcpy(old_name, faculty.username);
+        if (username != NULL) {
+            copy_field(faculty.username, username);
+        }
+        if (password != NULL) {
+            copy_field(faculty.password, password);
+        }
+
+        status = table_write(&faculty_table, id, &faculty);
+        if (status == STATUS_OK && username != NULL && user_rename(&faculty_names, old_name, new_name, id) < 0) {
+            return STATUS_ERROR;
+        }
+        return status;
+    }
+}
+
+// Read one student record by ID
+Status read_student(int student_id, Student *student) {
+    return table_read(&student_table, student_id, student);
+}
+
+// Read one faculty record by ID
+Status read_faculty(int faculty_id, Faculty *faculty) {
+    return table_read(&faculty_table, faculty_id, faculty);
+}
+
+// Append a course record to a malloc'd CourseInfo list. Returns -1 if out of
+// memory, leaving the list as it was.
+int course_info_append(CourseInfo **courses, int *count, int *capacity, const Course *course) {
+    if (*count == *capacity) {
+        CourseInfo *grown = realloc(*courses, *capacity * 2 * sizeof(CourseInfo));
+        if (grown == NULL) {
+            return -1;
+        }
+        *courses = grown;
+        *capacity *= 2;
+    }
+    strcpy((*courses)[*count].name, course->name);
+    (*courses)[*count].seats = seat_count(course->id);
+    (*courses)[*count].capacity = course->capacity;
+    (*count)++;
+    return 0;
+}
+
+// Collect the courses that still have seats, grouped by faculty. *courses is
+// malloc'd and must be freed by the caller. Each record is read whole, so no
+// record lock is needed; the list is not a snapshot across records.
+Status list_available_courses(CourseInfo **courses, int *count) {
+    Faculty faculty;
+    Course course;
+    int capacity = 16;
+    int faculty_count = table_count(&faculty_table);
+
+    *courses = malloc(capacity * sizeof(CourseInfo));
+    if (*courses == NULL) {
+        return STATUS_ERROR;
+    }
+    *count = 0;
+
+    for (int id = 0; id < faculty_count; id++) {
+        if (table_read(&faculty_table, id, &faculty) != STATUS_OK) {
+            break;
+        }
+        for (int i = 0; i < faculty.course_count; i++) {
+            if (seat_count(faculty.courses[i]) > 0 && table_read(&course_table, faculty.courses[i], &course) == STATUS_OK &&
+                course_info_append(courses, count, &capacity, &course) < 0) {
+                free(*courses);
+                *courses = NULL;
+                return STATUS_ERROR;
+            }
+        }
+    }
+
+    return STATUS_OK;
+}
+
+// Collect the courses a faculty member offers, in the order they were added.
+// *courses is malloc'd and must be freed by the caller.
+Status list_offered_courses(int faculty_id, CourseInfo **courses, int *count) {
+    Faculty faculty;
+    Course course;
+    int capacity = MAX_COURSES;
+
+    Status status = table_read(&faculty_table, faculty_id, &faculty);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    *courses = malloc(capacity * sizeof(CourseInfo));
+    if (*courses == NULL) {
+        return STATUS_ERROR;
+    }
+    *count = 0;
+    for (int i = 0; i < faculty.course_count; i++) {
+        if (table_read(&course_table, faculty.courses[i], &course) == STATUS_OK &&
+            course_info_append(courses, count, &capacity, &course) < 0) {
+            free(*courses);
+            *courses = NULL;
+            return STATUS_ERROR;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+// Check that a student may enroll in course_id (-1 for an unknown course)
+Status enroll_check(const Student *student, int course_id) {
+    // Check if already enrolled
+    for (int i = 0; course_id >= 0 && i < student->course_count; i++) {
+        if (student->courses[i] == course_id) {
+            return STATUS_EXISTS;
+        }
+    }
+
+    if (student->course_count >= MAX_COURSES) {
+        return STATUS_LIMIT;
+    }
+    return STATUS_OK;
+}
+
+// Enroll in a course (Student function) with a seat already reserved from
+// the given generation of the course's seat counter
+Status enroll_course_locked(int student_id, int course_id, CourseRoster *roster, uint32_t generation) {
+    Student student;
+    Status status = table_read(&student_table, student_id, &student);
+    if (status == STATUS_OK) {
+        status = enroll_check(&student, course_id);
+    }
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // The seat is void if the course was removed or added again meanwhile
+    if (seat_generation(course_id) != generation) {
+        return STATUS_UNAVAILABLE;
+    }
+
+    // Add course to student's enrolled courses
+    student.courses[student.course_count] = course_id;
+    student.course_count++;
+
+    status = table_write(&student_table, student_id, &student);
+    if (status == STATUS_OK && roster_add(roster, student_id) < 0) {
+        return STATUS_ERROR;
+    }
+    return status;
+}
+
+// Unenroll from a course (Student function)
+Status unenroll_course_locked(int student_id, int course_id, CourseRoster *roster) {
+    // Read student record
+    Student student;
+    Status status = table_read(&student_table, student_id, &student);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // Find and remove the course
+    int course_found = 0;
+    for (int i = 0; course_id >= 0 && i < student.course_count; i++) {
+        if (student.courses[i] == course_id) {
+            course_found = 1;
+            // Shift remaining courses
+            for (int j = i; j < student.course_count - 1; j++) {
+                student.courses[j] = student.courses[j + 1];
+            }
+            student.course_count--;
+            break;
+        }
+    }
+
+    if (!course_found) {
+        return STATUS_NOT_ENROLLED;
+    }
+
+    // Update student record
+    status = table_write(&student_table, student_id, &student);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    roster_remove(roster, student_id);
+
+    // Increase available seats for the course, unless a student is waiting
+    // for it; unenroll_course() then hands the seat over
+    if (roster->waiting_count == 0) {
+        seat_release(course_id, seat_generation(course_id));
+    }
+    return STATUS_OK;
+}
+
+// Enroll through the course's combining queue (--enroll combine). Whoever
+// gets the course's record lock applies every queued request in one pass;
+// the others wait for their result without touching the course.
+Status enroll_combined(int student_id, int course_id, CourseRoster *roster, int *seats_left) {
+    SeatCounter *c = seat_counter(course_id);
+    CombineRequest request = { student_id, 0, STATUS_OK, 0, 0, 0, NULL };
+
+    request.next = atomic_load(&c->queue);
+    while (!atomic_compare_exchange_weak(&c->queue, &request.next, &request)) {
+    }
+
+    while (!atomic_load(&request.done)) {
+        if (record_trylock(course_locks, course_id) == 0) {
+            combine_run(course_id, roster);
+            record_unlock(course_locks, course_id);
+        } else {
+            sched_yield();
+        }
+    }
+
+    if (request.status == STATUS_OK && seats_left != NULL) {
+        *seats_left = request.seats_left;
+    }
+    return wal_durable(request.status, request.promoted > request.lsn ? request.promoted : request.lsn);
+}
+
+// Apply the queued enrollments of a course, oldest first, so seats go out in
+// arrival order. Called with the course's record lock held; the course record
+// is written once for the whole pass. Failed requests are finished last, so
+// their replies also wait for the waitlist promotions of the seats they freed.
+void combine_run(int course_id, CourseRoster *roster) {
+    SeatCounter *c = seat_counter(course_id);
+    CombineRequest *queue = atomic_exchange(&c->queue, NULL);
+    CombineRequest *fifo = NULL;
+    CombineRequest *failed = NULL;
+    int enrolled = 0;
+    WalTxn txn;
+
+    while (queue != NULL) {
+        CombineRequest *next = queue->next;
+        queue->next = fifo;
+        fifo = queue;
+        queue = next;
+    }
+
+    while (fifo != NULL) {
+        CombineRequest *request = fifo;
+        uint32_t generation;
+
+        // The request belongs to a waiting thread that may return once done is set
+        fifo = request->next;
+        int left = seat_reserve(course_id, &generation);
+        if (left < 0) {
+            request->status = STATUS_UNAVAILABLE;
+        } else {
+            record_lock(student_locks, request->student_id);
+            wal_begin(&txn);
+            request->status = enroll_course_locked(request->student_id, course_id, roster, generation);
+            request->lsn = wal_commit();
+            record_unlock(student_locks, request->student_id);
+            if (request->status == STATUS_OK) {
+                request->seats_left = left;
+                enrolled++;
+            } else {
+                seat_release(course_id, generation);
+                request->next = failed;
+                failed = request;
+                continue;
+            }
+        }
+        atomic_store(&request->done, 1);
+    }
+
+    if (enrolled > 0) {
+        atomic_store(&c->dirty, 0);
+        seat_store(course_id);
+    }
+
+    // Seats of failed enrollments belong to the waitlist
+    uint64_t lsn = 0;
+    if (roster->waiting_count > 0) {
+        waitlist_promote(course_id, roster, 0, &lsn);
+    }
+    while (failed != NULL) {
+        CombineRequest *request = failed;
+        failed = request->next;
+        request->promoted = lsn;
+        atomic_store(&request->done, 1);
+    }
+}
+
+// Give seats of course_id to the students at the head of its waitlist, oldest
+// first, and leave each a notice for view_waitlists. With held set the caller
+// freed a seat without returning it to the counter, so no other enrollment
+// can take it first; it goes back to the counter if nobody is waiting. Called
+// with the course's record lock held and no student lock. Each promotion is
+// logged as its own entry; *lsn receives the last.
+void waitlist_promote(int course_id, CourseRoster *roster, int held, uint64_t *lsn) {
+    WalTxn txn;
+
+    while (roster->waiting_count > 0) {
+        uint32_t generation = seat_generation(course_id);
+        if (!held && seat_reserve(course_id, &generation) < 0) {
+            break;
+        }
+        held = 0;
+
+        int student_id = waitlist_pop(roster);
+        record_lock(student_locks, student_id);
+        wal_begin(&txn);
+        Status status = enroll_course_locked(student_id, course_id, roster, generation);
+        uint64_t student_lsn = wal_commit();
+        StudentWaits *w = student_waits(student_id, 0);
+        if (w != NULL) {
+            student_waits_drop(w, course_id);
+            if (status == STATUS_OK && w->promoted_count < MAX_WAITLISTS) {
+                w->promoted[w->promoted_count++] = course_id;
+            }
+        }
+        record_unlock(student_locks, student_id);
+
+        // A student who can no longer enroll (e.g. at the course limit) is
+        // dropped and the seat passes on
+        if (status != STATUS_OK) {
+            held = 1;
+        }
+        if (student_lsn != 0) {
+            *lsn = student_lsn;
+        }
+    }
+
+    if (held) {
+        seat_release(course_id, seat_generation(course_id));
+    }
+    atomic_store(&seat_counter(course_id)->dirty, 1);
+}
+
+// Empty the waitlist of a course that is no longer offered. Called with the
+// course's record lock held; takes each waiting student's lock in turn.
+void waitlist_clear(int course_id, CourseRoster *roster) {
+    int student_id;
+
+    while ((student_id = waitlist_pop(roster)) >= 0) {
+        record_lock(student_locks, student_id);
+        StudentWaits *w = student_waits(student_id, 0);
+        if (w != NULL) {
+            student_waits_drop(w, course_id);
+        }
+        record_unlock(student_locks, student_id);
+    }
+}
+
+// Join the waitlist of a full course (Student function). Seats freed since
+// go to the students already waiting first; if one is still free the student
+// is enrolled at once and *position is 0. Joining again only reports the
+// position. Called with the course's record lock held.
+Status join_waitlist_locked(int student_id, int course_id, CourseRoster *roster, int *position, uint64_t *lsn) {
+    Student student;
+    Course course;
+    uint32_t generation;
+    WalTxn txn;
+
+    if (roster->waiting_count > 0) {
+        waitlist_promote(course_id, roster, 0, lsn);
+    }
+    Status status = table_read(&course_table, course_id, &course);
+    if (status == STATUS_OK && course.faculty_id < 0) {
+        status = STATUS_UNAVAILABLE;
+    }
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    record_lock(student_locks, student_id);
+    wal_begin(&txn);
+    status = table_read(&student_table, student_id, &student);
+    if (status == STATUS_OK) {
+        status = enroll_check(&student, course_id);
+    }
+    StudentWaits *w = status == STATUS_OK ? student_waits(student_id, 1) : NULL;
+    if (status == STATUS_OK && w == NULL) {
+        status = STATUS_ERROR;
+    }
+
+    if (status != STATUS_OK) {
+        // Nothing to do
+    } else if ((*position = waitlist_position(roster, student_id)) > 0) {
+        // Already waiting
+    } else if (roster->waiting_count == 0 && seat_reserve(course_id, &generation) >= 0) {
+        status = enroll_course_locked(student_id, course_id, roster, generation);
+        if (status != STATUS_OK) {
+            seat_release(course_id, generation);
+        }
+        atomic_store(&seat_counter(course_id)->dirty, 1);
+    } else if (w->waiting_count >= MAX_WAITLISTS) {
+        status = STATUS_LIMIT;
+    } else if (waitlist_add(roster, student_id) < 0) {
+        status = STATUS_ERROR;
+    } else {
+        w->waiting[w->waiting_count++] = course_id;
+        *position = roster->waiting_count;
+    }
+
+    uint64_t student_lsn = wal_commit();
+    if (student_lsn != 0) {
+        *lsn = student_lsn;
+    }
+    record_unlock(student_locks, student_id);
+    return status;
+}
+
+// Leave a course's waitlist (Student function). Called with the course's
+// record lock held.
+Status leave_waitlist_locked(int student_id, int course_id, CourseRoster *roster) {
+    if (waitlist_remove(roster, student_id) < 0) {
+        return STATUS_NOT_ENROLLED;
+    }
+    record_lock(student_locks, student_id);
+    StudentWaits *w = student_waits(student_id, 0);
+    if (w != NULL) {
+        student_waits_drop(w, course_id);
+    }
+    record_unlock(student_locks, student_id);
+    return STATUS_OK;
+}
+
+// View the waitlists a student is on, with their positions, followed by the
+// courses they got a seat in from a waitlist since they last looked
+// (position 0), which are then forgotten. Takes only the student's record
+// lock; positions are read without the course locks. *waits is malloc'd and
+// must be freed by the caller.
+Status view_waitlists(int student_id, WaitlistInfo **waits, int *count) {
+    StudentWaits copy = {0};
+    Course course;
+    CourseRoster *roster;
+
+    if (student_id < 0 || student_id >= table_count(&student_table)) {
+        return STATUS_NOT_FOUND;
+    }
+    // Allocated first, so a failure leaves the promotion notices in place
+    *waits = malloc(2 * MAX_WAITLISTS * sizeof(WaitlistInfo));
+    if (*waits == NULL) {
+        return STATUS_ERROR;
+    }
+    record_lock(student_locks, student_id);
+    StudentWaits *w = student_waits(student_id, 0);
+    if (w != NULL) {
+        copy = *w;
+        w->promoted_count = 0;
+    }
+    record_unlock(student_locks, student_id);
+
+    *count = 0;
+    for (int i = 0; i < copy.waiting_count + copy.promoted_count; i++) {
+        int waiting = i < copy.waiting_count;
+        int course_id = waiting ? copy.waiting[i] : copy.promoted[i - copy.waiting_count];
+        if (table_read(&course_table, course_id, &course) != STATUS_OK) {
+            continue;
+        }
+        WaitlistInfo *info = &(*waits)[*count];
+        info->position = 0;
+        if (waiting) {
+            // A student given a seat meanwhile is reported next time
+            course_lookup(course.name, &roster);
+            info->position = waitlist_position(roster, student_id);
+            if (info->position == 0) {
+                continue;
+            }
+        }
+        strcpy(info->name, course.name);
+        (*count)++;
+    }
+    return STATUS_OK;
+}
+
+// View enrolled courses (Student function). *courses is malloc'd and must be
+// freed by the caller.
+Status view_enrolled_courses(int student_id, CourseInfo **courses, int *count) {
+    Student student;
+    Course course;
+    int capacity = MAX_COURSES;
+
+    Status status = table_read(&student_table, student_id, &student);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    *courses = malloc(capacity * sizeof(CourseInfo));
+    if (*courses == NULL) {
+        return STATUS_ERROR;
+    }
+    *count = 0;
+    for (int i = 0; i < student.course_count; i++) {
+        if (table_read(&course_table, student.courses[i], &course) == STATUS_OK &&
+            course_info_append(courses, count, &capacity, &course) < 0) {
+            free(*courses);
+            *courses = NULL;
+            return STATUS_ERROR;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+// Change password (Common function for student and faculty)
+Status change_password_locked(char *role, int id, const char *old_password, const char *new_password) {
+    Status status;
+
+    if (strcmp(role, "student") == 0) {
+        Student student;
+        status = table_read(&student_table, id, &student);
+        if (status != STATUS_OK) {
+            return status;
+        }
+
+        // Verify old password
+        if (strcmp(student.password, old_password) != 0) {
+            return STATUS_WRONG_PASSWORD;
+        }
+
+        // Update password
+        copy_field(student.password, new_password);
+        return table_write(&student_table, id, &student);
+    } else if (strcmp(role, "faculty") == 0) {
+        Faculty faculty;
+        status = table_read(&faculty_table, id, &faculty);
+        if (status != STATUS_OK) {
+            return status;
+        }
+
+        // Verify old password
+        if (strcmp(faculty.password, old_password) != 0) {
+            return STATUS_WRONG_PASSWORD;
+        }
+
+        // Update password
+        copy_field(faculty.password, new_password);
+        return table_write(&faculty_table, id, &faculty);
+    }
+
+    return STATUS_OK;
+}
+
+// Add a new course (Faculty function). A name that was offered before keeps
+// its course_id; -1 interns a new one.
+Status add_course_locked(int faculty_id, const char *name, int course_id, int seats) {
+    Course course;
+    Status status;
+
+    // Course names are unique across all faculty
+    if (course_id >= 0) {
+        status = table_read(&course_table, course_id, &course);
+        if (status != STATUS_OK) {
+            return status;
+        }
+        if (course.faculty_id >= 0) {
+            return STATUS_EXISTS;
+        }
+    } else {
+        memset(&course, 0, sizeof(Course));
+        course.id = table_count(&course_table);
+        strcpy(course.name, name);
+    }
+
+    // Read faculty record
+    Faculty faculty;
+    status = table_read(&faculty_table, faculty_id, &faculty);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // Check if faculty can add more courses
+    if (faculty.course_count >= MAX_COURSES) {
+        return STATUS_LIMIT;
+    }
+
+    course.faculty_id = faculty_id;
+    course.seats = seats; // Available seats
+    course.capacity = seats; // Store initial seats
+
+    status = course_id >= 0 ? table_write(&course_table, course.id, &course) : table_append(&course_table, &course);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    if (course_id >= 0 ? seat_set(course_id, seats) < 0 : course_intern(name, course.id, seats) < 0) {
+        return STATUS_ERROR;
+    }
+
+    // Add course to faculty's course list
+    faculty.courses[faculty.course_count] = course.id;
+    faculty.course_count++; // Increment the course count
+
+    return table_write(&faculty_table, faculty_id, &faculty);
+}
+
+// Remove an offered course (Faculty function). Updates the faculty and course
+// records; remove_course_students() then updates the enrolled students.
+Status remove_course_locked(int faculty_id, int course_id) {
+    // Read faculty record
+    Faculty faculty;
+    Status status = table_read(&faculty_table, faculty_id, &faculty);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // Find and remove the course
+    int course_found = 0;
+    for (int i = 0; course_id >= 0 && i < faculty.course_count; i++) {
+        if (faculty.courses[i] == course_id) {
+            course_found = 1;
+            // Shift remaining courses
+            for (int j = i; j < faculty.course_count - 1; j++) {
+                faculty.courses[j] = faculty.courses[j + 1];
+            }
+            faculty.course_count--;
+            break;
+        }
+    }
+
+    if (!course_found) {
+        return STATUS_NOT_ENROLLED;
+    }
+
+    // Update faculty record
+    status = table_write(&faculty_table, faculty_id, &faculty);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // The name stays interned; the course record just stops being offered
+    Course course;
+    status = table_read(&course_table, course_id, &course);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    course.faculty_id = -1;
+    course.seats = 0;
+    course.capacity = 0;
+    status = table_write(&course_table, course.id, &course);
+    if (status == STATUS_OK) {
+        seat_set(course_id, 0);
+    }
+    return status;
+}
+
+// Remove a course that is no longer offered from the students on its roster
+// and take them off the roster. Called with the course's record lock held;
+// takes each student's lock in turn and logs each student as its own entry,
+// setting *lsn to the last one. A student whose record cannot be updated stays
+// on the roster, and the first such failure is returned after the rest are done.
+Status remove_course_students(int course_id, CourseRoster *roster, uint64_t *lsn) {
+    Status status = STATUS_OK;
+    Student student;
+    WalTxn txn;
+
+    // From the end, so removing a student does not move the ones still to do
+    for (int k = roster->count - 1; k >= 0; k--) {
+        int id = roster->array->ids[k];
+        Status updated = STATUS_OK;
+        record_lock(student_locks, id);
+        wal_begin(&txn);
+        if (table_read(&student_table, id, &student) != STATUS_OK) {
+            updated = STATUS_UNAVAILABLE;
+        }
+        for (int i = 0; updated == STATUS_OK && i < student.course_count; i++) {
+            if (student.courses[i] == course_id) {
+                // Remove course from student
+                for (int j = i; j < student.course_count - 1; j++) {
+                    student.courses[j] = student.courses[j + 1];
+                }
+                student.course_count--;
+
+                // Write back updated student record
+                if (table_write(&student_table, id, &student) != STATUS_OK) {
+                    updated = STATUS_UNAVAILABLE;
+                }
+                break;
+            }
+        }
+        uint64_t student_lsn = wal_commit();
+        if (student_lsn != 0) {
+            *lsn = student_lsn;
+        }
+        record_unlock(student_locks, id);
+
+        if (updated == STATUS_OK) {
+            roster_remove(roster, id);
+        } else if (status == STATUS_OK) {
+            status = updated;
+        }
+    }
+    return status;
+}
+
+// View enrollments in courses (Faculty function). Lists the faculty's courses
+// and the students on each course's roster; *roster is grouped by index into
+// *courses. Both lists are malloc'd and must be freed by the caller; on
+// failure they are freed here and set to NULL.
+Status view_enrollments(int faculty_id, CourseInfo **courses, int *course_count, RosterEntry **roster, int *count) {
+    Status status = list_offered_courses(faculty_id, courses, course_count);
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    int capacity = 16, ids_capacity = 0;
+    int *ids = NULL;
+    *roster = malloc(capacity * sizeof(RosterEntry));
+    *count = 0;
+    if (*roster == NULL) {
+        status = STATUS_ERROR;
+    }
+
+    // Copy each course's roster without blocking enrollments in it. A course
+    // removed before it was listed (capacity 0) may still be emptying its roster.
+    for (int i = 0; status == STATUS_OK && i < *course_count; i++) {
+        CourseRoster *course_roster;
+        if ((*courses)[i].capacity == 0 || course_lookup((*courses)[i].name, &course_roster) < 0) {
+            continue;
+        }
+
+        int n = roster_copy(course_roster, &ids, &ids_capacity);
+        if (n < 0) {
+            status = STATUS_ERROR;
+            break;
+        }
+        if (*count + n > capacity) {
+            while (*count + n > capacity) {
+                capacity *= 2;
+            }
+            RosterEntry *grown = realloc(*roster, capacity * sizeof(RosterEntry));
+            if (grown == NULL) {
+                status = STATUS_ERROR;
+                break;
+            }
+            *roster = grown;
+        }
+        for (int k = 0; k < n; k++) {
+            (*roster)[*count].course = i;
+            (*roster)[*count].id = ids[k];
+            (*count)++;
+        }
+    }
+    free(ids);
+
+    // Then look up the students' names
+    Student student;
+    for (int k = 0; status == STATUS_OK && k < *count; k++) {
+        if (table_read(&student_table, (*roster)[k].id, &student) != STATUS_OK) {
+            status = STATUS_ERROR;
+            break;
+        }
+        strcpy((*roster)[k].username, student.username);
+    }
+
+    if (status != STATUS_OK) {
+        free(*courses);
+        free(*roster);
+        *courses = NULL;
+        *roster = NULL;
+        *count = 0;
+    }
+    return status;
+}
+
+// Export every enrollment (Admin function). Begin takes a snapshot of the
+// student, faculty and course tables; next then returns the rows of one
+// student at a time while enrollments carry on. Changes made meanwhile keep
+// the old versions of the records they touch until the export has read them.
+Status export_enrollments_begin(EnrollmentExport *e) {
+    if (snapshot_begin() < 0) {
+        return STATUS_UNAVAILABLE;
+    }
+    e->next = 0;
+    e->count = student_table.snapshot.count;
+    return STATUS_OK;
+}
+
+// Rows of the next student, one per enrolled course (at most MAX_COURSES)
+Status export_enrollments_next(EnrollmentExport *e, EnrollmentRow *rows, int *count) {
+    Student student;
+    Course course;
+    Faculty faculty;
+
+    *count = 0;
+    if (snapshot_read(&student_table, e->next, &student) != STATUS_OK) {
+        return STATUS_ERROR;
+    }
+    for (int i = 0; i < student.course_count; i++) {
+        EnrollmentRow *row = &rows[(*count)++];
+        if (snapshot_read(&course_table, student.courses[i], &course) != STATUS_OK) {
+            return STATUS_ERROR;
+        }
+        row->student_id = student.id;
+        strcpy(row->student, student.username);
+        row->course_id = course.id;
+        strcpy(row->course, course.name);
+        row->faculty_id = course.faculty_id;
+        row->faculty[0] = '\0';
+        if (course.faculty_id >= 0) {
+            if (snapshot_read(&faculty_table, course.faculty_id, &faculty) != STATUS_OK) {
+                return STATUS_ERROR;
+            }
+            strcpy(row->faculty, faculty.username);
+        }
+    }
+
+    // Changes to the students exported so far need not be kept any more
+    e->next++;
+    snapshot_advance(&student_table, e->next);
+    return STATUS_OK;
+}
+
+void export_enrollments_end(EnrollmentExport *e) {
+    snapshot_end();
+    e->next = e->count;
+}
+
+// Check if a course is currently offered (Helper function)
+int check_course_exists(const char *course_name) {
+    int course_id = course_lookup(course_name, NULL);
+    Course course;
+
+    return course_id >= 0 && table_read(&course_table, course_id, &course) == STATUS_OK && course.faculty_id >= 0;
+}
+
+// Storage operations that modify records. Each wraps its _locked variant in
+// the locks it needs, taken in the order given at the global variables: a
+// student or faculty name change also holds the role's mutex, and enrolling
+// locks just one course and one student, so enrollments in different courses
+// run in parallel. Seats are reserved before any lock is taken. With the log
+// enabled, the changes are committed as one entry before the locks are
+// released, and the reply waits for the entry after they are.
+
+Status add_student(const char *username, const char *password, int *student_id) {
+    WalTxn txn;
+
+    mutex_lock(&student_mutex);
+    wal_begin(&txn);
+    Status status = add_student_locked(username, password, student_id);
+    uint64_t lsn = wal_commit();
+    mutex_unlock(&student_mutex);
+    return wal_durable(status, lsn);
+}
+
+Status add_faculty(const char *username, const char *password, int *faculty_id) {
+    WalTxn txn;
+
+    mutex_lock(&faculty_mutex);
+    wal_begin(&txn);
+    Status status = add_faculty_locked(username, password, faculty_id);
+    uint64_t lsn = wal_commit();
+    mutex_unlock(&faculty_mutex);
+    return wal_durable(status, lsn);
+}
+
+Status import_users(const char *role, ImportRow *rows, int count, int *first_id, int *added) {
+    pthread_mutex_t *mutex = strcmp(role, "student") == 0 ? &student_mutex : &faculty_mutex;
+    WalTxn txn;
+
+    mutex_lock(mutex);
+    wal_begin(&txn);
+    Status status = import_users_locked(role, rows, count, first_id, added);
+    uint64_t lsn = wal_commit();
+    mutex_unlock(mutex);
+    return wal_durable(status, lsn);
+}
+
+Status toggle_student_status(int student_id, int *active) {
+    WalTxn txn;
+
+    record_lock(student_locks, student_id);
+    wal_begin(&txn);
+    Status status = toggle_student_status_locked(student_id, active);
+    uint64_t lsn = wal_commit();
+    record_unlock(student_locks, student_id);
+    return wal_durable(status, lsn);
+}
+
+Status update_details(char *role, int id, const char *username, const char *password) {
+    pthread_mutex_t *names = strcmp(role, "student") == 0 ? &student_mutex : &faculty_mutex;
+    WalTxn txn;
+
+    if (username != NULL) {
+        mutex_lock(names);
+    }
+    record_lock(role_locks(role), id);
+    wal_begin(&txn);
+    Status status = update_details_locked(role, id, username, password);
+    uint64_t lsn = wal_commit();
+    record_unlock(role_locks(role), id);
+    if (username != NULL) {
+        mutex_unlock(names);
+    }
+    return wal_durable(status, lsn);
+}
+
+Status enroll_course(int student_id, const char *course_name, int *seats_left) {
+    char name[50];
+    CourseRoster *roster;
+    Student student;
+    uint32_t generation;
+    WalTxn txn;
+
+    copy_field(name, course_name);
+    int course_id = course_lookup(name, &roster);
+
+    // Turn away repeats, full schedules and full courses without locking.
+    // The seat is taken with compare-and-swap, so a course is never oversold.
+    Status status = table_read(&student_table, student_id, &student);
+    if (status == STATUS_OK) {
+        status = enroll_check(&student, course_id);
+    }
+    if (status != STATUS_OK) {
+        return status;
+    }
+
+    // Seats go to the waitlist first, in the order students joined it
+    if (course_id >= 0 && waitlist_length(roster) > 0) {
+        return STATUS_UNAVAILABLE;
+    }
+    if (config.enroll == ENROLL_COMBINE && course_id >= 0) {
+        return seat_count(course_id) > 0 ? enroll_combined(student_id, course_id, roster, seats_left)
+                                         : STATUS_UNAVAILABLE;
+    }
+    int left = course_id >= 0 ? seat_reserve(course_id, &generation) : -1;
+    if (left < 0) {
+        return STATUS_UNAVAILABLE;
+    }
+
+    record_lock(course_locks, course_id);
+    record_lock(student_locks, student_id);
+    wal_begin(&txn);
+    status = enroll_course_locked(student_id, course_id, roster, generation);
+    uint64_t lsn = wal_commit();
+    record_unlock(student_locks, student_id);
+    record_unlock(course_locks, course_id);
+
+    if (status != STATUS_OK) {
+        seat_release(course_id, generation);
+        // Students who joined the waitlist while the seat was taken get it
+        if (waitlist_length(roster) > 0) {
+            record_lock(course_locks, course_id);
+            waitlist_promote(course_id, roster, 0, &lsn);
+            record_unlock(course_locks, course_id);
+        }
+        // The caller's reply waits for the promotions' entries too
+        return wal_durable(status, lsn);
+    }
+    atomic_store(&seat_counter(course_id)->dirty, 1);
+    if (seats_left != NULL) {
+        *seats_left = left;
+    }
+    return wal_durable(STATUS_OK, lsn);
+}
+
+Status unenroll_course(int student_id, const char *course_name) {
+    char name[50];
+    CourseRoster *roster;
+    WalTxn txn;
+
+    copy_field(name, course_name);
+    int course_id = course_lookup(name, &roster);
+    if (course_id >= 0) {
+        record_lock(course_locks, course_id);
+    }
+    record_lock(student_locks, student_id);
+    wal_begin(&txn);
+    Status status = unenroll_course_locked(student_id, course_id, roster);
+    uint64_t lsn = wal_commit();
+    record_unlock(student_locks, student_id);
+    if (status == STATUS_OK && roster->waiting_count > 0) {
+        waitlist_promote(course_id, roster, 1, &lsn);
+    }
+    if (course_id >= 0) {
+        record_unlock(course_locks, course_id);
+    }
+    return wal_durable(status, lsn);
+}
+
+// Logged as one entry for the student, after one per student promoted first
+Status join_waitlist(int student_id, const char *course_name, int *position) {
+    char name[50];
+    CourseRoster *roster;
+    uint64_t lsn = 0;
+
+    copy_field(name, course_name);
+    int course_id = course_lookup(name, &roster);
+    if (course_id < 0) {
+        return STATUS_UNAVAILABLE;
+    }
+    record_lock(course_locks, course_id);
+    Status status = join_waitlist_locked(student_id, course_id, roster, position, &lsn);
+    record_unlock(course_locks, course_id);
+    return wal_durable(status, lsn);
+}
+
+Status leave_waitlist(int student_id, const char *course_name) {
+    char name[50];
+    CourseRoster *roster;
+
+    copy_field(name, course_name);
+    int course_id = course_lookup(name, &roster);
+    if (course_id < 0) {
+        return STATUS_NOT_ENROLLED;
+    }
+    record_lock(course_locks, course_id);
+    Status status = leave_waitlist_locked(student_id, course_id, roster);
+    record_unlock(course_locks, course_id);
+    return status;
+}
+
+Status change_password(char *role, int id, const char *old_password, const char *new_password) {
+    WalTxn txn;
+
+    record_lock(role_locks(role), id);
+    wal_begin(&txn);
+    Status status = change_password_locked(role, id, old_password, new_password);
+    uint64_t lsn = wal_commit();
+    record_unlock(role_locks(role), id);
+    return wal_durable(status, lsn);
+}
+
+Status add_course(int faculty_id, const char *course_name, int seats) {
+    char name[50];
+    WalTxn txn;
+
+    copy_field(name, course_name);
+
+    // course_mutex keeps the ID a new name will get free until it is interned
+    mutex_lock(&course_mutex);
+    int course_id = course_lookup(name, NULL);
+    int lock_id = course_id >= 0 ? course_id : table_count(&course_table);
+    record_lock(course_locks, lock_id);
+    record_lock(faculty_locks, faculty_id);
+    wal_begin(&txn);
+    Status status = add_course_locked(faculty_id, name, course_id, seats);
+    uint64_t lsn = wal_commit();
+    record_unlock(faculty_locks, faculty_id);
+    record_unlock(course_locks, lock_id);
+    mutex_unlock(&course_mutex);
+    return wal_durable(status, lsn);
+}
+
+// Logged per lock scope: one entry for the faculty and course records, then
+// one per enrolled student
+Status remove_course(int faculty_id, const char *course_name) {
+    char name[50];
+    CourseRoster *roster;
+    WalTxn txn;
+
+    copy_field(name, course_name);
+    int course_id = course_lookup(name, &roster);
+    if (course_id >= 0) {
+        record_lock(course_locks, course_id);
+    }
+    record_lock(faculty_locks, faculty_id);
+    wal_begin(&txn);
+    Status status = remove_course_locked(faculty_id, course_id);
+    uint64_t lsn = wal_commit();
+    record_unlock(faculty_locks, faculty_id);
+    if (status == STATUS_OK) {
+        status = remove_course_students(course_id, roster, &lsn);
+        waitlist_clear(course_id, roster);
+    }
+    if (course_id >= 0) {
+        record_unlock(course_locks, course_id);
+    }
+    return wal_durable(status, lsn);
+}
@@ -0,0 +1,246 @@
+/**
+ * Storage benchmark for Academia Portal
+ * Compares the storage backends on the server's own storage functions
+ *
+ * Build: gcc -O2 storage_bench.c -o storage_bench -lpthread
+ * Run:   ./storage_bench [students] [iterations] [directory]
+ *
+ * Every backend runs in its own process on fresh data files in a temporary
+ * directory under the given one (default: current directory), so put that
+ * on the disk the server will use. The syscalls column counts pread, pwrite,
+ * ftruncate, msync and fdatasync calls per operation. enroll-4t runs the
+ * enroll loop on 4 threads at once, each with its own students, which is
+ * where group commit (wal/group) shares syncs between operations. import adds
+ * as many students again through import_users in batches of
+ * BENCH_IMPORT_BATCH, for comparison with append.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Count the data file system calls made by the storage layer
+static atomic_long bench_syscalls;
+#define COUNTED(call) (atomic_fetch_add(&bench_syscalls, 1), call)
+#define pread(...) COUNTED(pread(__VA_ARGS__))
+#define pwrite(...) COUNTED(pwrite(__VA_ARGS__))
+#define ftruncate(...) COUNTED(ftruncate(__VA_ARGS__))
+#define msync(...) COUNTED(msync(__VA_ARGS__))
+#define fdatasync(...) COUNTED(fdatasync(__VA_ARGS__))
+
+#define ACADEMIA_NO_MAIN
+#include "server.c"
+
+#define BENCH_FACULTY 20
+#define BENCH_COURSES_PER_FACULTY 5
+#define BENCH_THREADS 4
+#define BENCH_IMPORT_BATCH 1000
+
+typedef struct {
+    const char *name;
+    StorageMode storage;
+    PersistMode persist;
+    MsyncPolicy msync;
+    WalPolicy wal;
+} BenchBackend;
+
+static const BenchBackend backends[] = {
+    { "file",         STORAGE_FILE,   PERSIST_SYNC,  MSYNC_NONE,  WAL_OFF },
+    { "memory",       STORAGE_MEMORY, PERSIST_SYNC,  MSYNC_NONE,  WAL_OFF },
+    { "memory/async", STORAGE_MEMORY, PERSIST_ASYNC, MSYNC_NONE,  WAL_OFF },
+    { "mmap",         STORAGE_MMAP,   PERSIST_SYNC,  MSYNC_NONE,  WAL_OFF },
+    { "mmap/async",   STORAGE_MMAP,   PERSIST_SYNC,  MSYNC_ASYNC, WAL_OFF },
+    { "mmap/sync",    STORAGE_MMAP,   PERSIST_SYNC,  MSYNC_SYNC,  WAL_OFF },
+    { "wal/none",     STORAGE_MEMORY, PERSIST_ASYNC, MSYNC_NONE,  WAL_NONE },
+    { "wal/op",       STORAGE_MEMORY, PERSIST_ASYNC, MSYNC_NONE,  WAL_OP },
+    { "wal/group",    STORAGE_MEMORY, PERSIST_ASYNC, MSYNC_NONE,  WAL_GROUP },
+};
+
+// Work for one thread of the parallel enroll loop
+typedef struct {
+    int thread;
+    int students;
+    int iterations;
+} EnrollJob;
+
+static long bench_start_ns;
+static long bench_start_calls;
+
+static void bench_begin() {
+    bench_start_calls = atomic_load(&bench_syscalls);
+    bench_start_ns = now_ns();
+}
+
+static void bench_end(const char *backend, const char *op, int ops) {
+    long ns = now_ns() - bench_start_ns;
+    long calls = atomic_load(&bench_syscalls) - bench_start_calls;
+    printf("%-14s %-9s %10.0f %10.2f\n", backend, op, (double)ns / ops, (double)calls / ops);
+}
+
+// Enroll and unenroll random courses; thread t only uses students t, t + n, ...
+static void *bench_enroll(void *arg) {
+    EnrollJob *job = arg;
+    int total_courses = BENCH_FACULTY * BENCH_COURSES_PER_FACULTY;
+    unsigned seed = job->thread + 1;
+    char course[50];
+
+    for (int i = 0; i < job->iterations; i++) {
+        int c = rand_r(&seed) % total_courses;
+        int student = (i * BENCH_THREADS + job->thread) % job->students;
+        sprintf(course, "Course %d-%d", c / BENCH_COURSES_PER_FACULTY, c % BENCH_COURSES_PER_FACULTY);
+        enroll_course(student, course, NULL);
+        unenroll_course(student, course);
+    }
+    return NULL;
+}
+
+// Run every operation against one backend; called in a child process
+static void bench_backend(const BenchBackend *b, int students, int iterations) {
+    char username[50], password[50], course[50];
+    char student_role[] = "student";
+    int id, total_courses = BENCH_FACULTY * BENCH_COURSES_PER_FACULTY;
+    Student student;
+
+    config.storage = b->storage;
+    config.persist = b->persist;
+    config.msync = b->msync;
+    config.wal = b->wal;
+    srand(1);
+
+    // Keep the server's start-up messages out of the results
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    freopen("/dev/null", "w", stdout);
+    initialize_files();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    for (int f = 0; f < BENCH_FACULTY; f++) {
+        sprintf(username, "faculty%d", f);
+        add_faculty(username, "secret", &id);
+        for (int c = 0; c < BENCH_COURSES_PER_FACULTY; c++) {
+            sprintf(course, "Course %d-%d", f, c);
+            add_course(id, course, MAX_SEATS);
+        }
+    }
+
+    bench_begin();
+    for (int i = 0; i < students; i++) {
+        sprintf(username, "student%d", i);
+        add_student(username, "secret", &id);
+    }
+    bench_end(b->name, "append", students);
+
+    ImportRow *rows = calloc(BENCH_IMPORT_BATCH, sizeof(ImportRow));
+    int added;
+    bench_begin();
+    for (int first = 0; first < students; first += BENCH_IMPORT_BATCH) {
+        int n = students - first < BENCH_IMPORT_BATCH ? students - first : BENCH_IMPORT_BATCH;
+        for (int i = 0; i < n; i++) {
+            sprintf(rows[i].username, "imported%d", first + i);
+            strcpy(rows[i].password, "secret");
+            rows[i].status = STATUS_OK;
+        }
+        import_users("student", rows, n, &id, &added);
+    }
+    bench_end(b->name, "import", students);
+    free(rows);
+
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        read_student(rand() % students, &student);
+    }
+    bench_end(b->name, "read", iterations);
+
+    strcpy(password, "secret");
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        sprintf(username, "student%d", rand() % students);
+        authenticate_user(username, password, student_role);
+    }
+    bench_end(b->name, "login", iterations);
+
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        change_password(student_role, i % students, "secret", "secret");
+    }
+    bench_end(b->name, "update", iterations);
+
+    bench_begin();
+    for (int i = 0; i < iterations; i++) {
+        int c = rand() % total_courses;
+        sprintf(course, "Course %d-%d", c / BENCH_COURSES_PER_FACULTY, c % BENCH_COURSES_PER_FACULTY);
+        enroll_course(i % students, course, NULL);
+        unenroll_course(i % students, course);
+    }
+    bench_end(b->name, "enroll", iterations);
+
+    pthread_t threads[BENCH_THREADS];
+    EnrollJob jobs[BENCH_THREADS];
+    bench_begin();
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        jobs[t] = (EnrollJob){ t, students, iterations / BENCH_THREADS };
+        pthread_create(&threads[t], NULL, bench_enroll, &jobs[t]);
+    }
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    bench_end(b->name, "enroll-4t", iterations / BENCH_THREADS * BENCH_THREADS);
+
+    bench_begin();
+    storage_flush();
+    bench_end(b->name, "flush", 1);
+}
+
+int main(int argc, char *argv[]) {
+    int students = argc > 1 ? atoi(argv[1]) : 2000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+    const char *dir = argc > 3 ? argv[3] : ".";
+
+    if (students <= 0 || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [students] [iterations] [directory]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%d students, %d faculty, %d iterations\n", students, BENCH_FACULTY, iterations);
+    printf("%-14s %-9s %10s %10s\n", "backend", "op", "ns/op", "syscalls");
+    fflush(stdout);
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/academia-bench-XXXXXX", dir);
+        if (mkdtemp(path) == NULL) {
+            perror("Error creating benchmark directory");
+            return EXIT_FAILURE;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (chdir(path) == -1) {
+                perror("Error entering benchmark directory");
+                _exit(EXIT_FAILURE);
+            }
+            bench_backend(&backends[i], students, iterations);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+        waitpid(pid, NULL, 0);
+
+        const char *files[] = { "admin.dat", "students.dat", "faculty.dat", "courses.dat", "wal.log" };
+        for (int f = 0; f < 5; f++) {
+            char file[PATH_MAX + 16];
+            snprintf(file, sizeof(file), "%s/%s", path, files[f]);
+            unlink(file);
+        }
+        rmdir(path);
+    }
+    return 0;
+}